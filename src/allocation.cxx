@@ -0,0 +1,250 @@
+/**
+ * @file      allocation.cxx
+ * @brief     Replacement of the global operator new / delete which counts the allocations of every thread.
+ *            (Built with -DCOUNT_ALLOCATIONS only; see allocation.h.)
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <cstdlib>
+#include <new>
+
+#include "allocation.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+// Exception specifications of the replaced operators. (Dynamic ones are not allowed since C++17.)
+#if __cplusplus >= 201103L
+#define NEW_THROWS
+#define NO_THROW noexcept
+#else
+#define NEW_THROWS throw(std::bad_alloc)
+#define NO_THROW   throw()
+#endif
+
+// Thread-local, so that the event loop is not slowed down by the writer threads sharing a counter.
+static __thread unsigned long long nAllocations   = 0;
+static __thread unsigned long long nDeallocations = 0;
+static __thread unsigned long long nBytes         = 0;
+
+
+
+static inline void* CountedAllocate(std::size_t size)
+{/*{{{*/
+  nAllocations++;
+  nBytes += size;
+  return malloc(size ? size : 1);
+}/*}}}*/
+
+
+
+static inline void* CountedAlignedAllocate(std::size_t size, std::size_t alignment)
+{/*{{{*/
+  nAllocations++;
+  nBytes += size;
+  void* p;
+  if( alignment < sizeof(void*) ) alignment = sizeof(void*);
+  return ( posix_memalign(&p, alignment, size ? size : 1) == 0 ) ? p : NULL;
+}/*}}}*/
+
+
+
+static inline void CountedFree(void* p)
+{/*{{{*/
+  if( !p ) return;
+  nDeallocations++;
+  free(p);
+}/*}}}*/
+
+
+
+void* operator new(std::size_t size) NEW_THROWS
+{/*{{{*/
+  void* p = CountedAllocate(size);
+  if( !p ) throw std::bad_alloc();
+  return p;
+}/*}}}*/
+
+
+
+void* operator new[](std::size_t size) NEW_THROWS
+{/*{{{*/
+  void* p = CountedAllocate(size);
+  if( !p ) throw std::bad_alloc();
+  return p;
+}/*}}}*/
+
+
+
+void* operator new(std::size_t size, const std::nothrow_t&) NO_THROW
+{/*{{{*/
+  return CountedAllocate(size);
+}/*}}}*/
+
+
+
+void* operator new[](std::size_t size, const std::nothrow_t&) NO_THROW
+{/*{{{*/
+  return CountedAllocate(size);
+}/*}}}*/
+
+
+
+void operator delete(void* p) NO_THROW
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete[](void* p) NO_THROW
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete(void* p, const std::nothrow_t&) NO_THROW
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete[](void* p, const std::nothrow_t&) NO_THROW
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+#if __cplusplus >= 201402L
+void operator delete(void* p, std::size_t) NO_THROW
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete[](void* p, std::size_t) NO_THROW
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+#endif
+
+
+
+#ifdef __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t alignment)
+{/*{{{*/
+  void* p = CountedAlignedAllocate(size, (std::size_t)alignment);
+  if( !p ) throw std::bad_alloc();
+  return p;
+}/*}}}*/
+
+
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{/*{{{*/
+  void* p = CountedAlignedAllocate(size, (std::size_t)alignment);
+  if( !p ) throw std::bad_alloc();
+  return p;
+}/*}}}*/
+
+
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{/*{{{*/
+  return CountedAlignedAllocate(size, (std::size_t)alignment);
+}/*}}}*/
+
+
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{/*{{{*/
+  return CountedAlignedAllocate(size, (std::size_t)alignment);
+}/*}}}*/
+
+
+
+void operator delete(void* p, std::align_val_t) noexcept
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+
+
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{/*{{{*/
+  CountedFree(p);
+}/*}}}*/
+#endif
+
+
+
+/**
+ * @brief This function tells whether the allocations are counted.
+ */
+bool IsAllocationCountingEnabled()
+{/*{{{*/
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the counters of the calling thread.
+ */
+AllocationCounters GetThreadAllocations()
+{/*{{{*/
+  AllocationCounters counters;
+  counters.nAllocations   = nAllocations;
+  counters.nDeallocations = nDeallocations;
+  counters.nBytes         = nBytes;
+  return counters;
+}/*}}}*/
+
+#else
+
+bool IsAllocationCountingEnabled()
+{/*{{{*/
+  return false;
+}/*}}}*/
+
+
+
+AllocationCounters GetThreadAllocations()
+{/*{{{*/
+  AllocationCounters counters;
+  counters.nAllocations = counters.nDeallocations = counters.nBytes = 0;
+  return counters;
+}/*}}}*/
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * @file      allocation.h
+ * @brief     Per-thread counters of the heap allocations done through operator new / delete.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _ALLOCATION_H_
+#define _ALLOCATION_H_
+
+/**
+ * @brief Allocations of the calling thread since its start.
+ *
+ * The global operator new / delete are replaced (allocation.cxx) only when the program is built with
+ * "make COUNT_ALLOCATIONS=1" (-DCOUNT_ALLOCATIONS). Every C++ allocation of the process, including the ones
+ * of ACSoft and ROOT and the aligned ones, is then counted. Plain malloc() calls are not counted. In the
+ * default build the allocations are not touched and the counters stay at zero.
+ */
+struct AllocationCounters
+{
+  unsigned long long  nAllocations;
+  unsigned long long  nDeallocations;
+  unsigned long long  nBytes;               // Total bytes requested by the allocations
+};
+
+bool               IsAllocationCountingEnabled();
+AllocationCounters GetThreadAllocations();
+
+#endif
@@ -0,0 +1,272 @@
+/**
+ * @file      bench.cxx
+ * @brief     Benchmark of the output backends (TTree, RNTuple, columnar) on the same sample.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ *
+ * Usage : bin/bench <ACCTOFInt output file> [writer threads] [ntuple page size] [compression]
+ *
+ * The records of the given file are loaded into memory once, written with every backend through
+ * the RecordWriter queue, and read back. Write throughput, file size and read throughput are printed.
+ */
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "RVersion.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
+#include <ROOT/REntry.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,34,0)
+#include <ROOT/RNTupleReader.hxx>
+#else
+#include <ROOT/RNTuple.hxx>
+#endif
+#endif
+
+#include "record.h"
+#include "writer.h"
+#include "columnar.h"
+#include "ntuple.h"
+#include "timer.h"
+
+char releaseName[16] = "ACCTOFInt0.01";
+char softwareName[10] = "ACCTOFInt";
+
+/**
+ * @brief Result of one backend.
+ */
+struct BenchResult
+{
+  const char*  name;
+  double       writeTime;                   // (s)
+  double       readTime;                    // (s)
+  long long    fileSize;                    // (bytes)
+};
+
+
+
+/**
+ * @brief This function returns the size of a file.
+ * @return Size in bytes / -1 : The file does not exist
+ */
+long long GetFileSize(const char* fileName)
+{/*{{{*/
+  struct stat status;
+  if( stat(fileName, &status) != 0 ) return -1;
+  return (long long)status.st_size;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function loads every entry of the ACCTOFInt tree of the sample into memory.
+ * @return Number of loaded records
+ */
+int LoadSample(const char* fileName, std::vector<EventRecord>& records)
+{/*{{{*/
+  TFile* file = TFile::Open(fileName);
+  if( !file || file->IsZombie() ) return 0;
+
+  TTree* tree = (TTree*)file->Get(softwareName);
+  if( !tree ) return 0;
+
+  EventRecord record;
+  ResetRecord(&record);
+  for(int i = 0; i < GetNRecordFields(); i++)
+  {
+    const RecordField& field = GetRecordField(i);
+    if( tree->GetBranch(field.name) ) tree->SetBranchAddress(field.name, (char*)&record + field.offset);
+  }
+
+  Long64_t nEntries = tree->GetEntries();
+  records.reserve(nEntries);
+  for(Long64_t e = 0; e < nEntries; e++)
+  {
+    tree->GetEntry(e);
+    records.push_back(record);
+  }
+
+  file->Close();
+  delete file;
+  return (int)records.size();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes every record through the given sink and measures the elapsed time.
+ * @return (s) Time from the start of the writer until the file is closed / -1 : The sink could not be opened
+ */
+double WriteSample(OutputSink* sink, const std::vector<EventRecord>& records, int nThreads)
+{/*{{{*/
+  double begin = GetMonotonicTime();
+
+  RecordWriter writer(sink, 4096, 4096, 0, nThreads);
+  if( !writer.Start() ) return -1.;
+  for(unsigned int i = 0; i < records.size(); i++)
+  {
+    EventRecord* slot = writer.Acquire();
+    memcpy(slot, &records[i], sizeof(EventRecord));
+    writer.Commit(slot);
+  }
+  writer.Stop();
+
+  return GetMonotonicTime() - begin;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads every column of every entry of the TTree.
+ * @return (s) Elapsed time
+ */
+double ReadTree(const char* fileName)
+{/*{{{*/
+  double begin = GetMonotonicTime();
+
+  TFile* file = TFile::Open(fileName);
+  TTree* tree = (TTree*)file->Get(softwareName);
+  EventRecord record;
+  for(int i = 0; i < GetNRecordFields(); i++)
+    tree->SetBranchAddress(GetRecordField(i).name, (char*)&record + GetRecordField(i).offset);
+  for(Long64_t e = 0; e < tree->GetEntries(); e++) tree->GetEntry(e);
+  file->Close();
+  delete file;
+
+  return GetMonotonicTime() - begin;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads every field of every entry of the RNTuple.
+ * @return (s) Elapsed time / -1 : RNTuple is not available
+ */
+double ReadNTuple(const char* fileName)
+{/*{{{*/
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
+  double begin = GetMonotonicTime();
+
+  std::unique_ptr<ROOT::Experimental::RNTupleReader> reader = ROOT::Experimental::RNTupleReader::Open(softwareName, fileName);
+  std::unique_ptr<ROOT::Experimental::REntry> entry = reader->GetModel().CreateBareEntry();
+  EventRecord record;
+  for(int i = 0; i < GetNRecordFields(); i++)
+    entry->BindRawPtr(GetRecordField(i).name, (char*)&record + GetRecordField(i).offset);
+  for(unsigned long long e = 0; e < reader->GetNEntries(); e++) reader->LoadEntry(e, *entry);
+
+  return GetMonotonicTime() - begin;
+#else
+  return -1.;
+#endif
+}/*}}}*/
+
+
+
+/**
+ * @brief This function maps the columnar file and touches every word of every column.
+ * @return (s) Elapsed time
+ */
+double ReadColumnar(const char* fileName)
+{/*{{{*/
+  double begin = GetMonotonicTime();
+
+  int fd = open(fileName, O_RDONLY);
+  if( fd < 0 ) return -1.;
+  size_t size = (size_t)GetFileSize(fileName);
+  const char* base = (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( base == MAP_FAILED ) return -1.;
+
+  const ColumnarHeader* header = (const ColumnarHeader*)base;
+  const ColumnarColumn* columns = (const ColumnarColumn*)(base + sizeof(ColumnarHeader));
+  volatile unsigned int checksum = 0;
+  for(unsigned int c = 0; c < header->nColumns; c++)
+  {
+    const unsigned int* words = (const unsigned int*)(base + columns[c].offset);
+    unsigned int sum = 0;
+    for(unsigned long long i = 0; i < columns[c].size / 4; i++) sum += words[i];
+    checksum += sum;
+  }
+  munmap((void*)base, size);
+
+  return GetMonotonicTime() - begin;
+}/*}}}*/
+
+
+
+int main(int argc, char* argv[])
+{
+  if( argc < 2 )
+  {
+    std::cerr << "Usage : " << argv[0] << " <ACCTOFInt output file> [writer threads] [ntuple page size] [compression]" << std::endl;
+    return -1;
+  }
+
+  int  nThreads    = ( argc > 2 ) ? atoi(argv[2]) : 1;
+  long pageSize    = ( argc > 3 ) ? atol(argv[3]) : 0;
+  int  compression = ( argc > 4 ) ? atoi(argv[4]) : -1;
+
+  std::vector<EventRecord> records;
+  if( LoadSample(argv[1], records) == 0 )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : No records could be loaded from [" << argv[1] << "]!" << std::endl;
+    return -1;
+  }
+  std::cout << "[" << releaseName << "] " << records.size() << " records are loaded from [" << argv[1] << "]." << std::endl;
+
+  std::vector<BenchResult> results;
+  BenchResult result;
+
+  TreeSink treeSink("bench_tree.root", softwareName, releaseName);
+  result.name      = "TTree";
+  result.writeTime = WriteSample(&treeSink, records, 1);
+  result.fileSize  = GetFileSize("bench_tree.root");
+  result.readTime  = ReadTree("bench_tree.root");
+  results.push_back(result);
+
+  NTupleSink ntupleSink("bench_ntuple.root", softwareName, nThreads, compression, pageSize);
+  result.name      = "RNTuple";
+  result.writeTime = WriteSample(&ntupleSink, records, nThreads);
+  result.fileSize  = GetFileSize("bench_ntuple.root");
+  result.readTime  = result.writeTime > 0. ? ReadNTuple("bench_ntuple.root") : -1.;
+  results.push_back(result);
+
+  ColumnarSink columnarSink("bench_columnar.root");
+  result.name      = "Columnar";
+  result.writeTime = WriteSample(&columnarSink, records, 1);
+  result.fileSize  = GetFileSize("bench_columnar.col");
+  result.readTime  = ReadColumnar("bench_columnar.col");
+  results.push_back(result);
+
+  double nRecords = (double)records.size();
+  std::cout << std::endl;
+  std::cout << std::setw(10) << "Backend" << std::setw(16) << "write (ev/s)" << std::setw(16) << "size (MB)"
+            << std::setw(16) << "bytes/event" << std::setw(16) << "read (ev/s)" << std::endl;
+  for(unsigned int i = 0; i < results.size(); i++)
+  {
+    const BenchResult& r = results[i];
+    if( r.writeTime <= 0. )
+    {
+      std::cout << std::setw(10) << r.name << "  not available" << std::endl;
+      continue;
+    }
+    std::cout << std::setw(10) << r.name
+              << std::setw(16) << nRecords / r.writeTime
+              << std::setw(16) << r.fileSize / 1048576.
+              << std::setw(16) << r.fileSize / nRecords
+              << std::setw(16) << ( r.readTime > 0. ? nRecords / r.readTime : 0. ) << std::endl;
+  }
+
+  return 0;
+}
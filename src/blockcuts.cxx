@@ -0,0 +1,244 @@
+/**
+ * @file      blockcuts.cxx
+ * @brief     Gather of the header and trigger words and the vectorisable bit cut kernels.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <algorithm>
+
+#ifndef __AMSINC__
+#define __AMSINC__
+#include "amschain.h"
+#include "selector.h"
+#endif
+
+#include "timer.h"
+#include "headerindex.h"
+#include "blockcuts.h"
+
+extern char releaseName[16];
+
+#define kNJINJWords     4
+#define kNJErrorWords   24
+#define kPhysicsBits    0x3E                // Bits 1-5 of Level1R::PhysBPatt
+
+
+
+/**
+ * @brief IsScienceRun() : the upper bits of RunType are 0xf.
+ */
+static void ScienceRunKernel(const unsigned int* __restrict__ runType, signed char* __restrict__ pass, unsigned int n)
+{/*{{{*/
+  for(unsigned int k = 0; k < n; k++) pass[k] = ( ( runType[k] >> 12 ) == 0xf );
+}/*}}}*/
+
+
+
+/**
+ * @brief IsHardwareStatusGood() : no error bit in the JINJ status and JError words.
+ */
+static void HardwareStatusKernel(const unsigned int* __restrict__ jinjStatus, const unsigned int* __restrict__ jError, unsigned int stride,
+                                 unsigned int* __restrict__ error, signed char* __restrict__ pass, unsigned int n)
+{/*{{{*/
+  for(unsigned int k = 0; k < n; k++) error[k] = 0;
+  for(int w = 0; w < kNJINJWords; w++)
+  {
+    const unsigned int* word = jinjStatus + w * stride;
+    for(unsigned int k = 0; k < n; k++) error[k] |= ( word[k] >> 8 ) & 0x7F;
+  }
+  for(int w = 0; w < kNJErrorWords; w++)
+  {
+    const unsigned int* word = jError + w * stride;
+    for(unsigned int k = 0; k < n; k++) error[k] |= word[k] & 0x7F;
+  }
+  for(unsigned int k = 0; k < n; k++) pass[k] = ( error[k] == 0 );
+}/*}}}*/
+
+
+
+/**
+ * @brief !IsUnbiasedPhysicsTriggerEvent() : one of the physics bits is set.
+ */
+static void PhysicsTriggerKernel(const unsigned int* __restrict__ physicsPattern, signed char* __restrict__ pass, unsigned int n)
+{/*{{{*/
+  for(unsigned int k = 0; k < n; k++) pass[k] = ( ( physicsPattern[k] & kPhysicsBits ) != 0 );
+}/*}}}*/
+
+
+
+/**
+ * @brief nParticle() == 1, when the number of particles is known.
+ */
+static void SingleParticleKernel(const int* __restrict__ nParticle, signed char* __restrict__ pass, unsigned int n)
+{/*{{{*/
+  for(unsigned int k = 0; k < n; k++) pass[k] = ( nParticle[k] < 0 ) ? -1 : ( nParticle[k] == 1 );
+}/*}}}*/
+
+
+
+/**
+ * @brief This function ORs the JINJ status and JError words of every DAQ event of an event.
+ */
+void BlockCuts::GatherDaqWords(AMSEventR* pev, unsigned int* jinjStatus, unsigned int* jError)
+{/*{{{*/
+  for(int w = 0; w < kNJINJWords; w++)   jinjStatus[w] = 0;
+  for(int w = 0; w < kNJErrorWords; w++) jError[w] = 0;
+  for(int iDaq = 0; iDaq < pev->nDaqEvent(); iDaq++)
+  {
+    DaqEventR* daqEvent = pev->pDaqEvent(iDaq);
+    for(int w = 0; w < kNJINJWords; w++)   jinjStatus[w] |= daqEvent->JINJStatus[w];
+    for(int w = 0; w < kNJErrorWords; w++) jError[w]     |= daqEvent->JError[w];
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reduces the gathered DAQ words to the 7 error bits tested by IsHardwareStatusGood().
+ * @return 0 : Hardware status is good
+ */
+unsigned char BlockCuts::GetDaqErrorBits(const unsigned int* jinjStatus, const unsigned int* jError)
+{/*{{{*/
+  unsigned int error = 0;
+  for(int w = 0; w < kNJINJWords; w++)   error |= ( jinjStatus[w] >> 8 ) & 0x7F;
+  for(int w = 0; w < kNJErrorWords; w++) error |= jError[w] & 0x7F;
+  return (unsigned char)error;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the Level1 physics pattern which decides IsUnbiasedPhysicsTriggerEvent().
+ */
+unsigned int BlockCuts::GetPhysicsPattern(AMSEventR* pev)
+{/*{{{*/
+  int nLevel1 = pev->nLevel1();
+  unsigned int pattern = ( nLevel1 > 0 ) ? (unsigned int)pev->pLevel1(0)->PhysBPatt : kPhysicsBits;   // No Level1 : not unbiased
+  for(int iLevel1 = 1; iLevel1 < nLevel1 && ( pattern & kPhysicsBits ); iLevel1++)
+    pattern = (unsigned int)pev->pLevel1(iLevel1)->PhysBPatt;
+  return pattern;
+}/*}}}*/
+
+
+
+BlockCuts::BlockCuts(unsigned int blockSize)
+  : blockSize(blockSize), first(0), size(0), nLoaded(0), nRejected(0), nFromIndex(0), loadTime(0.), headerIndex(NULL)
+{/*{{{*/
+  if( blockSize == 0 ) return;
+  run.resize(blockSize);
+  event.resize(blockSize);
+  runType.resize(blockSize);
+  jinjStatus.resize(kNJINJWords * blockSize);
+  jError.resize(kNJErrorWords * blockSize);
+  physicsPattern.resize(blockSize);
+  errorBits.resize(blockSize);
+  nParticle.resize(blockSize);
+  passScienceRun.resize(blockSize);
+  passHardwareStatus.resize(blockSize);
+  passPhysicsTrigger.resize(blockSize);
+  passSingleParticle.resize(blockSize);
+  passOutsideSAA.resize(blockSize);
+  rejection.resize(blockSize);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function loads the entries [first, first + blockSize) of the loop and evaluates the cuts on them.
+ */
+void BlockCuts::Load(AMSChain& chain, const std::vector<long long>& entryList, unsigned int first, unsigned int nEntries, const SelectionSet& selections)
+{/*{{{*/
+  double start = GetMonotonicTime();
+  this->first = first;
+  size = ( nEntries - first < blockSize ) ? nEntries - first : blockSize;
+
+  // A block ends at the end of the file of its first entry, so that the survivors never go back to a closed file.
+  Long64_t  firstEntry  = entryList.empty() ? (Long64_t)first : entryList[first];
+  Long64_t* treeOffsets = chain.GetTreeOffset();
+  Long64_t* treeEnd     = std::upper_bound(treeOffsets, treeOffsets + chain.GetNtrees() + 1, firstEntry);
+
+  // Gather
+  for(unsigned int k = 0; k < size; k++)
+  {
+    Long64_t e = entryList.empty() ? (Long64_t)( first + k ) : entryList[first + k];
+    if( k > 0 && treeEnd != treeOffsets + chain.GetNtrees() + 1 && e >= *treeEnd )
+    {
+      size = k;
+      break;
+    }
+    const HeaderIndexRecord* record = headerIndex ? headerIndex->Get(e) : NULL;
+
+    unsigned int status[kNJINJWords], error[kNJErrorWords];
+    if( record )
+    {
+      // The reduced DAQ error bits enter the hardware kernel as one JError word.
+      run[k]            = record->run;
+      event[k]          = record->event;
+      runType[k]        = record->runType;
+      physicsPattern[k] = record->physicsPattern;
+      nParticle[k]      = record->nParticle;
+      passOutsideSAA[k] = ( record->flags & kHeaderInSAA ) ? 0 : 1;
+      for(int w = 0; w < kNJINJWords; w++)   status[w] = 0;
+      for(int w = 0; w < kNJErrorWords; w++) error[w] = 0;
+      error[0] = record->daqError;
+      nFromIndex++;
+    }
+    else
+    {
+      AMSEventR* pev = chain.GetEvent(e);
+      run[k]            = pev->Run();
+      event[k]          = pev->Event();
+      runType[k]        = pev->fHeader.RunType;
+      physicsPattern[k] = GetPhysicsPattern(pev);
+      nParticle[k]      = -1;
+      passOutsideSAA[k] = -1;
+      GatherDaqWords(pev, status, error);
+    }
+    for(int w = 0; w < kNJINJWords; w++)   jinjStatus[w * blockSize + k] = status[w];
+    for(int w = 0; w < kNJErrorWords; w++) jError[w * blockSize + k]     = error[w];
+  }
+
+  // Kernels
+  ScienceRunKernel(&runType[0], &passScienceRun[0], size);
+  HardwareStatusKernel(&jinjStatus[0], &jError[0], blockSize, &errorBits[0], &passHardwareStatus[0], size);
+  PhysicsTriggerKernel(&physicsPattern[0], &passPhysicsTrigger[0], size);
+  SingleParticleKernel(&nParticle[0], &passSingleParticle[0], size);
+
+  // Survivor mask
+  signed char results[kNEventCuts];
+  for(unsigned int k = 0; k < size; k++)
+  {
+    GetResults(first + k, results);
+    rejection[k] = selections.FindEarlyRejection(results);
+    if( rejection[k] >= 0 ) nRejected++;
+  }
+  nLoaded += size;
+  loadTime += GetMonotonicTime() - start;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function gives the event-level results of an entry, indexed by CutType (-1 : not evaluated by the block).
+ */
+void BlockCuts::GetResults(unsigned int i, signed char* results) const
+{/*{{{*/
+  for(int c = 0; c < kNEventCuts; c++) results[c] = -1;
+  results[kCutScienceRun]     = passScienceRun[i - first];
+  results[kCutHardwareStatus] = passHardwareStatus[i - first];
+  results[kCutPhysicsTrigger] = passPhysicsTrigger[i - first];
+  results[kCutSingleParticle] = passSingleParticle[i - first];
+  results[kCutOutsideSAA]     = passOutsideSAA[i - first];
+}/*}}}*/
+
+
+
+void BlockCuts::PrintStatistics()
+{/*{{{*/
+  std::cout << "[" << releaseName << "] BLOCK CUTS     : " << nLoaded << " entries in blocks of " << blockSize << ", "
+            << nRejected << " rejected before the event read";
+  if( nLoaded > 0 ) std::cout << " (" << (double)nRejected / nLoaded * 100. << "%)";
+  if( headerIndex ) std::cout << ", " << nFromIndex << " from the header index";
+  std::cout << ", " << loadTime << " s in the block loads" << std::endl;
+}/*}}}*/
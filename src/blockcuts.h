@@ -0,0 +1,86 @@
+/**
+ * @file      blockcuts.h
+ * @brief     Block-wise evaluation of the header and trigger bit cuts on structure-of-arrays buffers.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _BLOCKCUTS_H_
+#define _BLOCKCUTS_H_
+
+#include <vector>
+
+#include "selection.h"
+
+class AMSChain;
+class AMSEventR;
+class HeaderIndex;
+
+/**
+ * @brief Results of the science-run, hardware and physics-trigger cuts for a block of consecutive entries of the loop.
+ *
+ * Load() gathers RunType, the JINJ status / JError words of the DAQ events and the Level1 physics pattern of
+ * every entry of the block into flat arrays (AMSChain::GetEvent() reads only the header and these two
+ * containers are read on demand, so nothing else of the event is read). The cuts are then evaluated by
+ * branch-free loops over the arrays, which the compiler vectorises. The entries rejected by the shared prefix
+ * of the selections are masked out and never read again by the event loop.
+ *
+ * The DAQ words of several DAQ events are OR-ed together, which gives the same result as the per-event test.
+ * For several Level1 entries the first one without physics bits is kept (the event is then unbiased).
+ *
+ * With a header index (headerindex.h) the fields of the indexed entries are taken from the index instead, which
+ * also gives the single-particle and outside-saa cuts, and the rejected entries are not read at all.
+ */
+class BlockCuts
+{
+  unsigned int                blockSize;
+  unsigned int                first;              // Loop index of the first entry of the loaded block
+  unsigned int                size;               // Number of loaded entries
+
+  // Structure-of-arrays buffers, [k] or [word * blockSize + k] for the entry k of the block
+  std::vector<unsigned int>   run;
+  std::vector<unsigned int>   event;
+  std::vector<unsigned int>   runType;
+  std::vector<unsigned int>   jinjStatus;         // 4 words
+  std::vector<unsigned int>   jError;             // 24 words
+  std::vector<unsigned int>   physicsPattern;
+  std::vector<unsigned int>   errorBits;          // Work buffer of the hardware status kernel
+  std::vector<int>            nParticle;          // -1 : Not known
+
+  std::vector<signed char>    passScienceRun;
+  std::vector<signed char>    passHardwareStatus;
+  std::vector<signed char>    passPhysicsTrigger;
+  std::vector<signed char>    passSingleParticle; // -1 : Not known
+  std::vector<signed char>    passOutsideSAA;     // -1 : Not known
+  std::vector<int>            rejection;          // SelectionSet::FindEarlyRejection() of the entry (-1 : survivor)
+
+  unsigned long               nLoaded;
+  unsigned long               nRejected;
+  unsigned long               nFromIndex;
+  double                      loadTime;           // (s) Time spent in Load(), which is not part of the event latency
+
+  HeaderIndex*                headerIndex;
+
+public:
+  BlockCuts(unsigned int blockSize);
+
+  void SetHeaderIndex(HeaderIndex* index) { headerIndex = index; }
+
+  bool IsEnabled() const { return blockSize > 0; }
+  bool Contains(unsigned int i) const { return i >= first && i < first + size; }
+
+  void Load(AMSChain& chain, const std::vector<long long>& entryList, unsigned int first, unsigned int nEntries, const SelectionSet& selections);
+
+  bool         IsSurvivor(unsigned int i) const   { return rejection[i - first] < 0; }
+  int          GetRejection(unsigned int i) const { return rejection[i - first]; }
+  unsigned int GetRun(unsigned int i) const       { return run[i - first]; }
+  unsigned int GetEvent(unsigned int i) const     { return event[i - first]; }
+  void         GetResults(unsigned int i, signed char* results) const;
+
+  void PrintStatistics();
+
+  static void          GatherDaqWords(AMSEventR* pev, unsigned int* jinjStatus, unsigned int* jError);
+  static unsigned char GetDaqErrorBits(const unsigned int* jinjStatus, const unsigned int* jError);
+  static unsigned int  GetPhysicsPattern(AMSEventR* pev);
+};
+
+#endif
@@ -0,0 +1,422 @@
+/**
+ * @file      classifier.cxx
+ * @brief     Reader of the TMVA BDT weight files into flat forests and the batched forest kernel.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "TXMLEngine.h"
+
+#include "selection.h"
+#include "timer.h"
+#include "classifier.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief This function returns the first child element of an XML node with the given name.
+ * @return NULL : No such child
+ */
+static XMLNodePointer_t FindChild(TXMLEngine& xml, XMLNodePointer_t node, const char* name)
+{/*{{{*/
+  for(XMLNodePointer_t child = xml.GetChild(node); child; child = xml.GetNext(child))
+    if( strcmp(xml.GetNodeName(child), name) == 0 ) return child;
+  return NULL;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the child node of a BDT node at the given position ("l" or "r").
+ * @return NULL : The node is a leaf
+ */
+static XMLNodePointer_t FindDaughter(TXMLEngine& xml, XMLNodePointer_t node, const char* pos)
+{/*{{{*/
+  for(XMLNodePointer_t child = xml.GetChild(node); child; child = xml.GetNext(child))
+  {
+    if( strcmp(xml.GetNodeName(child), "Node") != 0 ) continue;
+    const char* childPos = xml.GetAttr(child, "pos");
+    if( childPos && strcmp(childPos, pos) == 0 ) return child;
+  }
+  return NULL;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns an attribute of an XML node as a number.
+ */
+static double GetNumber(TXMLEngine& xml, XMLNodePointer_t node, const char* name, double defaultValue = 0.)
+{/*{{{*/
+  const char* value = xml.GetAttr(node, name);
+  return value ? atof(value) : defaultValue;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the depth of the deepest leaf below a BDT node.
+ */
+static int MeasureDepth(TXMLEngine& xml, XMLNodePointer_t node)
+{/*{{{*/
+  XMLNodePointer_t left  = FindDaughter(xml, node, "l");
+  XMLNodePointer_t right = FindDaughter(xml, node, "r");
+  if( !left || !right ) return 0;
+
+  int leftDepth  = MeasureDepth(xml, left);
+  int rightDepth = MeasureDepth(xml, right);
+  return 1 + ( leftDepth > rightDepth ? leftDepth : rightDepth );
+}/*}}}*/
+
+
+
+/**
+ * @brief This function fills the padded subtree below the slot with one leaf value.
+ */
+static void FillLeaf(Forest* forest, int tree, int slot, int level, float value)
+{/*{{{*/
+  if( level == forest->depth )
+  {
+    forest->leaf[tree * forest->GetNLeaves() + slot - forest->GetNInternal()] = value;
+    return;
+  }
+
+  forest->feature[tree * forest->GetNInternal() + slot] = 0;
+  forest->cut[tree * forest->GetNInternal() + slot]     = 0.;
+  FillLeaf(forest, tree, 2 * slot + 1, level + 1, value);
+  FillLeaf(forest, tree, 2 * slot + 2, level + 1, value);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function copies a BDT node and its subtree to the slot of the complete tree.
+ *        TMVA sends an event to the right daughter when ( value >= cut ) == cType.
+ * @return false : The node uses Fisher coefficients or an unknown input variable
+ */
+static bool FlattenNode(TXMLEngine& xml, XMLNodePointer_t node, Forest* forest, int tree, int slot, int level, bool useYesNoLeaf)
+{/*{{{*/
+  XMLNodePointer_t left  = FindDaughter(xml, node, "l");
+  XMLNodePointer_t right = FindDaughter(xml, node, "r");
+
+  if( !left || !right )
+  {
+    float value;
+    if( forest->boostType == kBoostGradient ) value = GetNumber(xml, node, "res");
+    else value = useYesNoLeaf ? GetNumber(xml, node, "nType") : GetNumber(xml, node, "purity");
+    FillLeaf(forest, tree, slot, level, value);
+    return true;
+  }
+
+  int variable = (int)GetNumber(xml, node, "IVar", -1.);
+  if( GetNumber(xml, node, "NCoef") != 0. || variable < 0 || variable >= (int)forest->inputField.size() ) return false;
+
+  bool highIsRight = ( GetNumber(xml, node, "cType", 1.) != 0. );
+  forest->feature[tree * forest->GetNInternal() + slot] = variable;
+  forest->cut[tree * forest->GetNInternal() + slot]     = GetNumber(xml, node, "Cut");
+
+  return FlattenNode(xml, highIsRight ? left : right, forest, tree, 2 * slot + 1, level + 1, useYesNoLeaf) &&
+         FlattenNode(xml, highIsRight ? right : left, forest, tree, 2 * slot + 2, level + 1, useYesNoLeaf);
+}/*}}}*/
+
+
+
+ClassifierSet::ClassifierSet(unsigned int batchSize)
+  : batchSize(batchSize), nPending(0), nBatches(0), nEvaluated(0), evaluationTime(0.), flushTime(0.)
+{/*{{{*/
+}/*}}}*/
+
+
+
+ClassifierSet::~ClassifierSet()
+{/*{{{*/
+  for(unsigned int m = 0; m < forests.size(); m++) delete forests[m];
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads the classifier file and the weight files of its models.
+ * @return true : Success / false : Syntax error or a weight file which cannot be used
+ */
+bool ClassifierSet::Load(const char* fileName)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(fileName, "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open the classifier file [" << fileName << "]!" << std::endl;
+    return false;
+  }
+
+  char line[1024];
+  int  nLine = 0;
+  bool good  = true;
+
+  while( good && fgets(line, 1024, fp) != NULL )
+  {
+    nLine++;
+    char keyword[64], column[64], weightFile[512];
+    int  nItems = sscanf(line, "%63s %63s %511s", keyword, column, weightFile);
+    if( nItems < 1 || keyword[0] == '#' ) continue;
+    if( nItems != 3 || strcmp(keyword, "model") != 0 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : Syntax error in the classifier file [" << fileName << "] line " << nLine << "!" << std::endl;
+      good = false;
+      break;
+    }
+
+    Forest* forest = new Forest;
+    forest->column   = column;
+    forest->fileName = weightFile;
+    forests.push_back(forest);
+
+    // The output is a float scalar column. A new name becomes a user column of the record.
+    if( FindRecordField(column) < 0 ) AddUserRecordField(column);
+    forest->outputField = FindRecordField(column);
+    if( forest->outputField < 0 || GetRecordField(forest->outputField).type != 'F' || GetRecordField(forest->outputField).count != 1 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : The classifier column [" << column << "] is not a float scalar and cannot be added!" << std::endl;
+      good = false;
+      break;
+    }
+    good = LoadForest(forest);
+  }
+  fclose(fp);
+  if( !good ) return false;
+
+  records.resize(batchSize);
+  nodes.resize(batchSize);
+  scores.resize(batchSize);
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads a TMVA BDT weight file (MethodSetup XML) into a flat forest.
+ * @return true : Success / false : The file is not a BDT classifier this kernel can evaluate
+ */
+bool ClassifierSet::LoadForest(Forest* forest)
+{/*{{{*/
+  TXMLEngine xml;
+  XMLDocPointer_t doc = xml.ParseFile(forest->fileName.c_str());
+  if( !doc )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to read the TMVA weight file [" << forest->fileName << "]!" << std::endl;
+    return false;
+  }
+
+  XMLNodePointer_t setup           = xml.DocGetRootElement(doc);
+  XMLNodePointer_t options         = FindChild(xml, setup, "Options");
+  XMLNodePointer_t variables       = FindChild(xml, setup, "Variables");
+  XMLNodePointer_t transformations = FindChild(xml, setup, "Transformations");
+  XMLNodePointer_t weights         = FindChild(xml, setup, "Weights");
+  const char*      method          = xml.GetAttr(setup, "Method");
+
+  std::string error;
+  if( !variables || !weights || !method || strncmp(method, "BDT", 3) != 0 ) error = "is not a BDT weight file";
+  else if( transformations && GetNumber(xml, transformations, "NTransformations") != 0. ) error = "has input transformations";
+  else if( GetNumber(xml, weights, "AnalysisType") != 0. ) error = "is not a two-class classifier";
+
+  // Options of the response : BoostType and UseYesNoLeaf.
+  bool useYesNoLeaf = true;
+  forest->boostType = kBoostAdaptive;
+  for(XMLNodePointer_t option = options ? xml.GetChild(options) : NULL; option; option = xml.GetNext(option))
+  {
+    const char* name    = xml.GetAttr(option, "name");
+    const char* content = xml.GetNodeContent(option);
+    if( !name || !content ) continue;
+    if( strcmp(name, "BoostType") == 0 && strcmp(content, "Grad") == 0 ) forest->boostType = kBoostGradient;
+    if( strcmp(name, "UseYesNoLeaf") == 0 ) useYesNoLeaf = ( strcmp(content, "True") == 0 );
+  }
+
+  // Input variables : a record column "name" or an element "name[k]" of an array column.
+  for(XMLNodePointer_t variable = error.empty() ? xml.GetChild(variables) : NULL; variable; variable = xml.GetNext(variable))
+  {
+    if( strcmp(xml.GetNodeName(variable), "Variable") != 0 ) continue;
+    const char* expression = xml.GetAttr(variable, "Expression");
+    char name[64], canonical[96];
+    int  element  = 0;
+    int  nMatched = expression ? sscanf(expression, "%63[A-Za-z0-9_][%d]", name, &element) : 0;
+    if( nMatched == 2 ) snprintf(canonical, sizeof(canonical), "%s[%d]", name, element);
+    else if( nMatched == 1 ) snprintf(canonical, sizeof(canonical), "%s", name);
+    if( nMatched < 1 || strcmp(canonical, expression) != 0 )
+    {
+      error = std::string("has the input variable [") + ( expression ? expression : "" ) + "] which is not a column of the record (define it with --expressions)";
+      break;
+    }
+
+    int field = FindRecordField(name);
+    if( field < 0 || element < 0 || element >= GetRecordField(field).count )
+    {
+      error = std::string("has the input variable [") + expression + "] which is not a column of the record (define it with --expressions)";
+      break;
+    }
+    forest->inputField.push_back(field);
+    forest->inputElement.push_back(element);
+  }
+
+  // Forest : the depth of the deepest tree first, then every tree into its complete layout.
+  std::vector<XMLNodePointer_t> roots;
+  std::vector<double>           boostWeights;
+  for(XMLNodePointer_t tree = error.empty() ? xml.GetChild(weights) : NULL; tree; tree = xml.GetNext(tree))
+  {
+    if( strcmp(xml.GetNodeName(tree), "BinaryTree") != 0 ) continue;
+    XMLNodePointer_t root = FindChild(xml, tree, "Node");
+    if( !root ) continue;
+    roots.push_back(root);
+    boostWeights.push_back(GetNumber(xml, tree, "boostWeight", 1.));
+  }
+
+  forest->nTrees = roots.size();
+  forest->depth  = 0;
+  forest->norm   = 0.;
+  for(int t = 0; t < forest->nTrees; t++)
+  {
+    int depth = MeasureDepth(xml, roots[t]);
+    if( depth > forest->depth ) forest->depth = depth;
+  }
+  if( error.empty() && forest->nTrees == 0 ) error = "has no trees";
+  if( error.empty() && forest->depth > kMaxForestDepth ) error = "has trees deeper than the flat forest supports";
+
+  if( error.empty() )
+  {
+    forest->feature.assign(forest->nTrees * forest->GetNInternal() + 1, 0);
+    forest->cut.assign(forest->nTrees * forest->GetNInternal() + 1, 0.);
+    forest->leaf.assign(forest->nTrees * forest->GetNLeaves(), 0.);
+    for(int t = 0; t < forest->nTrees && error.empty(); t++)
+    {
+      if( !FlattenNode(xml, roots[t], forest, t, 0, 0, useYesNoLeaf) ) error = "has nodes with Fisher cuts or unknown variables";
+      if( forest->boostType == kBoostGradient ) continue;
+
+      // Weighted vote : the boost weight is folded into the leaves, the sum of the weights is the norm.
+      for(int l = 0; l < forest->GetNLeaves(); l++) forest->leaf[t * forest->GetNLeaves() + l] *= boostWeights[t];
+      forest->norm += boostWeights[t];
+    }
+  }
+  xml.FreeDoc(doc);
+
+  if( !error.empty() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : The TMVA weight file [" << forest->fileName << "] " << error << "!" << std::endl;
+    return false;
+  }
+
+  std::cout << "[" << releaseName << "] CLASSIFIER " << forest->column << " : " << forest->nTrees << " trees of depth " << forest->depth << ", "
+            << forest->inputField.size() << " inputs, " << ( forest->boostType == kBoostGradient ? "Grad" : "AdaBoost" ) << " from [" << forest->fileName << "]" << std::endl;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief One tree over the batch. Every step moves all the records one level down, so the loop over the
+ *        records has no branches and the node lookups are gathers.
+ */
+static void ForestTreeKernel(const float* __restrict__ inputs, unsigned int stride, const int* __restrict__ feature, const float* __restrict__ cut,
+                             const float* __restrict__ leaf, int depth, int* __restrict__ node, float* __restrict__ score, unsigned int n)
+{/*{{{*/
+  for(unsigned int k = 0; k < n; k++) node[k] = 0;
+  for(int d = 0; d < depth; d++)
+  {
+    for(unsigned int k = 0; k < n; k++)
+    {
+      int i = node[k];
+      node[k] = 2 * i + 1 + ( inputs[feature[i] * stride + k] >= cut[i] );
+    }
+  }
+
+  int nInternal = ( 1 << depth ) - 1;
+  for(unsigned int k = 0; k < n; k++) score[k] += leaf[node[k] - nInternal];
+}/*}}}*/
+
+
+
+/**
+ * @brief This function evaluates a forest on the first n records of the batch and writes its output column.
+ */
+void ClassifierSet::Evaluate(const Forest* forest, unsigned int n)
+{/*{{{*/
+  // Gather : one column of the batch per input variable.
+  unsigned int nInputs = forest->inputField.size();
+  if( inputs.size() < nInputs * batchSize ) inputs.resize(nInputs * batchSize);
+  for(unsigned int v = 0; v < nInputs; v++)
+  {
+    const RecordField& field = GetRecordField(forest->inputField[v]);
+    size_t offset = field.offset + forest->inputElement[v] * GetRecordFieldSize(field) / field.count;
+    float* column = &inputs[v * batchSize];
+    for(unsigned int k = 0; k < n; k++)
+    {
+      const char* value = (const char*)&records[k] + offset;
+      if( field.type == 'F' )      column[k] = *(const float*)value;
+      else if( field.type == 'I' ) column[k] = (float)*(const int*)value;
+      else                         column[k] = (float)*(const unsigned int*)value;
+    }
+  }
+
+  for(unsigned int k = 0; k < n; k++) scores[k] = 0.;
+  for(int t = 0; t < forest->nTrees; t++)
+    ForestTreeKernel(nInputs ? &inputs[0] : NULL, batchSize, &forest->feature[t * forest->GetNInternal()], &forest->cut[t * forest->GetNInternal()],
+                     &forest->leaf[t * forest->GetNLeaves()], forest->depth, &nodes[0], &scores[0], n);
+
+  size_t outputOffset = GetRecordField(forest->outputField).offset;
+  for(unsigned int k = 0; k < n; k++)
+  {
+    float response;
+    if( forest->boostType == kBoostGradient ) response = 2. / ( 1. + exp(-2. * scores[k]) ) - 1.;
+    else response = ( forest->norm > 1e-30 ) ? scores[k] / forest->norm : 0.;
+    *(float*)((char*)&records[k] + outputOffset) = response;
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function adds a copy of the current candidate to the batch. The caller flushes a full batch (IsFull()).
+ */
+void ClassifierSet::Add(const EventRecord& record, SelectionSet& selections)
+{/*{{{*/
+  if( accepted.size() < batchSize * selections.GetSize() ) accepted.resize(batchSize * selections.GetSize());
+
+  records[nPending] = record;
+  selections.GetAccepted(&accepted[nPending * selections.GetSize()]);
+  nPending++;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function evaluates every forest on the pending records, in the order of the classifier file (so that
+ *        a model can use the output of an earlier one), and commits the records to the selections which accepted them.
+ */
+void ClassifierSet::Flush(SelectionSet& selections)
+{/*{{{*/
+  if( nPending == 0 ) return;
+
+  double start = GetMonotonicTime();
+  for(unsigned int m = 0; m < forests.size(); m++) Evaluate(forests[m], nPending);
+  evaluationTime += GetMonotonicTime() - start;
+  nEvaluated += nPending;
+  nBatches++;
+
+  for(unsigned int k = 0; k < nPending; k++) selections.Commit(records[k], &accepted[k * selections.GetSize()]);
+  nPending = 0;
+  flushTime += GetMonotonicTime() - start;
+}/*}}}*/
+
+
+
+void ClassifierSet::PrintStatistics()
+{/*{{{*/
+  std::cout << "[" << releaseName << "] CLASSIFIERS    : " << forests.size() << " model(s), " << nEvaluated << " candidates in " << nBatches
+            << " batches (at most " << batchSize << ")";
+  if( nEvaluated > 0 ) std::cout << ", " << evaluationTime / nEvaluated * 1e6 << " us / candidate, " << flushTime << " s in the flushes";
+  std::cout << std::endl;
+}/*}}}*/
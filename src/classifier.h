@@ -0,0 +1,111 @@
+/**
+ * @file      classifier.h
+ * @brief     Batched evaluation of TMVA BDT classifiers (e.g. the ECAL shower BDT) on the pending records.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _CLASSIFIER_H_
+#define _CLASSIFIER_H_
+
+#include <string>
+#include <vector>
+
+#include "record.h"
+
+class SelectionSet;
+
+#define kMaxForestDepth   12                // Deeper trees are not accepted (2^depth leaves per tree)
+
+enum ForestBoostType
+{
+  kBoostAdaptive = 0,                       // AdaBoost, Bagging, ... : weighted mean of the leaf types
+  kBoostGradient = 1                        // Grad : 2 / ( 1 + exp(-2 * sum of the leaf responses) ) - 1
+};
+
+/**
+ * @brief A TMVA BDT as a flat forest.
+ *
+ * Every tree is padded to a complete binary tree of the depth of the deepest tree. The internal node i has the
+ * children 2i+1 (value < cut) and 2i+2 (value >= cut), so that a tree is walked by the same number of steps
+ * for every event without pointers or branches. A leaf above the full depth is copied to every padded leaf
+ * below it. The leaves hold their contribution to the response, already multiplied by the boost weight.
+ */
+struct Forest
+{
+  std::string                 column;             // Output column of the record
+  std::string                 fileName;           // TMVA weight file
+  int                         outputField;        // Index of the output column in the record fields
+  int                         boostType;          // One of ForestBoostType
+  float                       norm;               // Sum of the boost weights (kBoostAdaptive)
+
+  int                         depth;
+  int                         nTrees;
+  std::vector<int>            inputField;         // Record field and element of every input variable
+  std::vector<int>            inputElement;
+
+  std::vector<int>            feature;            // [tree * nInternal + node], input variable of the node
+  std::vector<float>          cut;
+  std::vector<float>          leaf;               // [tree * nLeaves + leaf]
+
+  int GetNInternal() const { return ( 1 << depth ) - 1; }
+  int GetNLeaves() const   { return 1 << depth; }
+};
+
+/**
+ * @brief The classifiers of the job and the batch of the records waiting for them.
+ *
+ * Classifier file :
+ *   model <column> <TMVA weight file>   The BDT of the weight file fills <column> (e.g. showerBDT)
+ *   # ...                               Comment
+ *
+ * A column which is not a field of the record becomes a user column (userVariable). The input variables of the
+ * weight file are record columns, "name" or "name[k]". Derived inputs are defined with --expressions, which are
+ * evaluated before the candidate joins the batch. Only BDTs without input transformations are supported.
+ *
+ * The ECAL shower BDT is config/ecalbdt.classifiers. Its inputs are the shower-shape columns of the record
+ * (showerEnergy3C, showerS13R, the leakages, the profile fits, ...), which the event loop copies from the
+ * EcalShowerR of the candidate while the event is loaded. config/TrainEcalBDT.C trains its weight file.
+ *
+ * Add() keeps a copy of the accepted candidate and the acceptance of every selection. When the batch is full
+ * (IsFull()), the caller calls Flush(), which gathers the inputs of the batch into one column per variable, evaluates the forests tree by tree over
+ * the whole batch (the inner loop over the events is vectorised) and commits the records to the selections.
+ * The batch has to be flushed before a run boundary and before the writers are stopped. A flush does the work of
+ * a whole batch, so the event loop keeps it out of the latency of the event which filled the batch; its time
+ * (evaluation and hand-over of the records) is reported by PrintStatistics().
+ */
+class ClassifierSet
+{
+  std::vector<Forest*>        forests;
+  unsigned int                batchSize;
+
+  std::vector<EventRecord>    records;            // Pending records of the batch
+  std::vector<unsigned char>  accepted;           // [record * nSelections + selection]
+  unsigned int                nPending;
+
+  std::vector<float>          inputs;             // [variable * batchSize + record]
+  std::vector<int>            nodes;              // Current node of every record while a tree is walked
+  std::vector<float>          scores;
+
+  unsigned long               nBatches;
+  unsigned long               nEvaluated;
+  double                      evaluationTime;     // (s) Evaluation of the forests
+  double                      flushTime;          // (s) Whole flushes, including the commits to the selections
+
+  bool LoadForest(Forest* forest);
+  void Evaluate(const Forest* forest, unsigned int n);
+
+public:
+  ClassifierSet(unsigned int batchSize);
+  ~ClassifierSet();
+
+  bool IsEnabled() const { return !forests.empty(); }
+  bool IsFull() const    { return nPending == batchSize; }
+
+  bool Load(const char* fileName);
+  void Add(const EventRecord& record, SelectionSet& selections);
+  void Flush(SelectionSet& selections);
+
+  void PrintStatistics();
+};
+
+#endif
@@ -0,0 +1,230 @@
+/**
+ * @file      columnar.cxx
+ * @brief     Columnar output sink. (See columnar.h for the file layout.)
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstring>
+
+#include "TFile.h"
+
+#include "partition.h"
+#include "columnar.h"
+
+extern char releaseName[16];
+
+/**
+ * @brief This function rounds the offset up to the column alignment.
+ * @return Aligned offset
+ */
+static unsigned long long AlignOffset(unsigned long long offset)
+{/*{{{*/
+  return ( offset + COLUMNAR_ALIGNMENT - 1 ) / COLUMNAR_ALIGNMENT * COLUMNAR_ALIGNMENT;
+}/*}}}*/
+
+
+
+ColumnarSink::ColumnarSink(const char* outputFileName)
+  : nRows(0), bufferRows(8192), nBufferedRows(0), spill(NULL), failed(false)
+{/*{{{*/
+  std::string baseName = GetOutputBaseName(outputFileName);
+  fileName       = baseName + ".col";
+  objectFileName = baseName + ".root";
+}/*}}}*/
+
+
+
+ColumnarSink::~ColumnarSink()
+{/*{{{*/
+  for(unsigned int i = 0; i < buffers.size(); i++) delete [] buffers[i];
+  if( spill ) fclose(spill);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function allocates the column buffers and the temporary file.
+ * @return true : The sink is ready / false : The output or a temporary file can not be created
+ */
+bool ColumnarSink::Open()
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(fileName.c_str(), "wb") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the output file [" << fileName << "]!" << std::endl;
+    return false;
+  }
+  fclose(fp);
+
+  if( ( spill = tmpfile() ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create a temporary file for the columnar output!" << std::endl;
+    remove(fileName.c_str());
+    return false;
+  }
+
+  for(int i = 0; i < GetNRecordFields(); i++) buffers.push_back(new char[bufferRows * GetRecordFieldSize(GetRecordField(i))]);
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function appends the buffered part of every column to the temporary file, one chunk per column.
+ * @return true : Written / false : The temporary file can not be written (the output is given up)
+ */
+bool ColumnarSink::Spill()
+{/*{{{*/
+  if( nBufferedRows == 0 || failed ) return !failed;
+
+  // The spills are appended one after another; the chunk of column i starts after the chunks of the columns before it.
+  off_t spillOffset = ftello(spill);
+  if( spillOffset < 0 ) failed = true;
+  spillOffsets.push_back(spillOffset);
+  spillRows.push_back(nBufferedRows);
+
+  for(int i = 0; i < GetNRecordFields() && !failed; i++)
+    if( fwrite(buffers[i], GetRecordFieldSize(GetRecordField(i)), nBufferedRows, spill) != nBufferedRows ) failed = true;
+  nBufferedRows = 0;
+
+  if( failed ) std::cerr << "[" << releaseName << "] ERROR     : Failed to write the temporary file of the columnar output!" << std::endl;
+  return !failed;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function scatters one record into the column buffers.
+ */
+void ColumnarSink::Fill(const EventRecord& record)
+{/*{{{*/
+  for(int i = 0; i < GetNRecordFields(); i++)
+  {
+    const RecordField& field = GetRecordField(i);
+    size_t size = GetRecordFieldSize(field);
+    memcpy(buffers[i] + nBufferedRows * size, (const char*)&record + field.offset, size);
+  }
+
+  nRows++;
+  if( ++nBufferedRows == bufferRows ) Spill();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function keeps an object for <base>.root. The columnar format holds only the event columns.
+ */
+void ColumnarSink::WriteObject(TObject* object)
+{/*{{{*/
+  objects.push_back(object);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the header and the column descriptors and gathers the chunks of every column.
+ * @return true : Every write succeeded / false : The output is incomplete
+ */
+bool ColumnarSink::WriteColumns(FILE* fp, const std::vector<ColumnarColumn>& columns, unsigned long long end)
+{/*{{{*/
+  int nColumns = columns.size();
+
+  ColumnarHeader header;
+  memset(&header, 0, sizeof(ColumnarHeader));
+  memcpy(header.magic, COLUMNAR_MAGIC, 8);
+  header.version    = COLUMNAR_VERSION;
+  header.nColumns   = nColumns;
+  header.nRows      = nRows;
+  header.dataOffset = AlignOffset(sizeof(ColumnarHeader) + nColumns * sizeof(ColumnarColumn));
+  header.alignment  = COLUMNAR_ALIGNMENT;
+
+  if( fwrite(&header, sizeof(ColumnarHeader), 1, fp) != 1 ) return false;
+  if( fwrite(&columns[0], sizeof(ColumnarColumn), nColumns, fp) != (size_t)nColumns ) return false;
+
+  // Copy every column to its aligned offset, one chunk per spill. The gaps are left as holes of the file.
+  std::vector<char> chunk;
+  for(int i = 0; i < nColumns; i++)
+  {
+    if( fseeko(fp, columns[i].offset, SEEK_SET) != 0 ) return false;
+
+    size_t size = GetRecordFieldSize(GetRecordField(i));
+    for(unsigned int j = 0; j < spillOffsets.size(); j++)
+    {
+      off_t chunkOffset = spillOffsets[j];
+      for(int k = 0; k < i; k++) chunkOffset += (off_t)GetRecordFieldSize(GetRecordField(k)) * spillRows[j];
+
+      if( chunk.size() < size * spillRows[j] ) chunk.resize(size * spillRows[j]);
+      if( fseeko(spill, chunkOffset, SEEK_SET) != 0 ) return false;
+      if( fread(&chunk[0], size, spillRows[j], spill) != spillRows[j] ) return false;
+      if( fwrite(&chunk[0], size, spillRows[j], fp) != spillRows[j] ) return false;
+    }
+  }
+
+  // Extend the file to the end of the last (aligned) column.
+  if( end > columns[nColumns - 1].offset + columns[nColumns - 1].size )
+  {
+    if( fseeko(fp, end - 1, SEEK_SET) != 0 ) return false;
+    if( fputc(0, fp) == EOF ) return false;
+  }
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the columnar file. If a write fails, the output is removed.
+ */
+void ColumnarSink::Close()
+{/*{{{*/
+  if( spill == NULL ) return;
+  Spill();
+
+  int nColumns = GetNRecordFields();
+
+  std::vector<ColumnarColumn> columns(nColumns);
+  unsigned long long offset = AlignOffset(sizeof(ColumnarHeader) + nColumns * sizeof(ColumnarColumn));
+  for(int i = 0; i < nColumns; i++)
+  {
+    const RecordField& field = GetRecordField(i);
+    ColumnarColumn& column = columns[i];
+    memset(&column, 0, sizeof(ColumnarColumn));
+    strncpy(column.name, field.name, sizeof(column.name) - 1);
+    column.type        = field.type;
+    column.count       = field.count;
+    column.elementSize = 4;
+    column.offset      = offset;
+    column.size        = nRows * GetRecordFieldSize(field);
+    offset = AlignOffset(offset + column.size);
+  }
+
+  FILE* fp;
+  bool  written = false;
+  if( !failed && ( fp = fopen(fileName.c_str(), "wb") ) != NULL )
+  {
+    written = WriteColumns(fp, columns, offset);
+    if( fclose(fp) != 0 ) written = false;
+  }
+  fclose(spill);
+  spill = NULL;
+
+  if( !written )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to write the columnar file [" << fileName << "]! The incomplete output is removed." << std::endl;
+    remove(fileName.c_str());
+    return;
+  }
+
+  std::cout << "[" << releaseName << "] The columnar file [" << fileName << "] is successfully written. (" << nRows << " rows, " << nColumns << " columns)" << std::endl;
+
+  if( !objects.empty() )
+  {
+    TFile* objectFile = new TFile(objectFileName.c_str(), "RECREATE");
+    if( objectFile && !objectFile->IsZombie() )
+    {
+      for(unsigned int i = 0; i < objects.size(); i++) objectFile->WriteTObject(objects[i]);
+      objectFile->Close();
+    }
+    delete objectFile;
+  }
+}/*}}}*/
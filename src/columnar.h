@@ -0,0 +1,90 @@
+/**
+ * @file      columnar.h
+ * @brief     Uncompressed fixed-width columnar output which can be memory-mapped by the consumers.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ *
+ * File layout (all integers little endian, as written by x86-64):
+ *
+ *   Offset 0 : ColumnarHeader
+ *   Offset sizeof(ColumnarHeader) : nColumns x ColumnarColumn
+ *   Offset ColumnarColumn::offset : nRows x count values of the column, contiguous
+ *
+ * The column data start at multiples of ColumnarHeader::alignment (4096 bytes), so that a consumer
+ * can mmap() the whole file and use (base + offset) directly as a float/int32/uint32 array of
+ * nRows * count elements. Element j of row i is at index i * count + j. The type codes are the
+ * ROOT leaf codes of the ACCTOFInt tree : 'i' (uint32), 'I' (int32), 'F' (float32).
+ */
+#ifndef _COLUMNAR_H_
+#define _COLUMNAR_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "writer.h"
+
+#define COLUMNAR_MAGIC      "ACCTCOL1"
+#define COLUMNAR_VERSION    1
+#define COLUMNAR_ALIGNMENT  4096
+
+struct ColumnarHeader
+{
+  char                magic[8];             // COLUMNAR_MAGIC (not null terminated)
+  unsigned int        version;              // COLUMNAR_VERSION
+  unsigned int        nColumns;             // Number of column descriptors following the header
+  unsigned long long  nRows;                // Number of rows (events)
+  unsigned long long  dataOffset;           // Offset of the first column
+  unsigned int        alignment;            // Alignment of every column offset
+  unsigned int        reserved;
+};
+
+struct ColumnarColumn
+{
+  char                name[64];             // Column name (null terminated), same as the branch name
+  char                type;                 // 'i', 'I' or 'F'
+  char                padding[3];
+  unsigned int        count;                // Elements per row
+  unsigned int        elementSize;          // Bytes per element (4)
+  unsigned int        reserved;
+  unsigned long long  offset;               // Offset of the column data from the beginning of the file
+  unsigned long long  size;                 // Bytes of the column data (nRows * count * elementSize)
+};
+
+/**
+ * @brief Sink writing EventRecord columns into the columnar file.
+ *
+ * Rows are transposed into per-column buffers. A full set of buffers is spilled into one anonymous temporary
+ * file as one chunk per column, back to back. At Close() the header is written and the chunks of every column
+ * are concatenated at its aligned offset. A failed write removes the output instead of leaving a file whose
+ * header claims the full column sizes.
+ * Objects such as hEvtCounter can not be stored in this format and go to <base>.root instead.
+ */
+class ColumnarSink : public OutputSink
+{
+  std::string                      fileName;
+  std::string                      objectFileName;
+  unsigned long long               nRows;
+  unsigned int                     bufferRows;      // Rows kept in memory before the columns are spilled
+  unsigned int                     nBufferedRows;
+  std::vector<char*>               buffers;         // One buffer per column
+  FILE*                            spill;           // Temporary file of the spilled chunks
+  std::vector<unsigned long long>  spillOffsets;    // Offset of every spill in the temporary file
+  std::vector<unsigned int>        spillRows;       // Rows of every spill
+  bool                             failed;          // A write to the temporary file failed
+  std::vector<TObject*>            objects;
+
+  bool Spill();
+  bool WriteColumns(FILE* fp, const std::vector<ColumnarColumn>& columns, unsigned long long end);
+
+public:
+  ColumnarSink(const char* outputFileName);
+  virtual ~ColumnarSink();
+
+  virtual bool Open();
+  virtual void Fill(const EventRecord& record);
+  virtual void WriteObject(TObject* object);
+  virtual void Close();
+};
+
+#endif
@@ -0,0 +1,258 @@
+/**
+ * @file      expression.cxx
+ * @brief     Parser of the expression file and the generation and compilation of its code.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <unistd.h>
+
+#include "RVersion.h"
+#include "TH1D.h"
+#include "TSystem.h"
+#include "TInterpreter.h"
+
+#include "selection.h"
+#include "expression.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief This function checks that a name can be used as a C++ identifier.
+ */
+static bool IsIdentifier(const char* name)
+{/*{{{*/
+  if( !isalpha((unsigned char)name[0]) && name[0] != '_' ) return false;
+  for(const char* c = name; *c; c++)
+    if( !isalnum((unsigned char)*c) && *c != '_' ) return false;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the C++ type of a ROOT leaf type code of the record.
+ */
+static const char* GetFieldType(char type)
+{/*{{{*/
+  switch( type )
+  {
+    case 'i': return "unsigned int";
+    case 'I': return "int";
+    default:  return "float";
+  }
+}/*}}}*/
+
+
+
+ExpressionSet::ExpressionSet()
+  : variablesFunction(NULL), cutsFunction(NULL), weight(1.)
+{/*{{{*/
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads the expression file. Every variable takes a userVariable column of the record.
+ * @return true : Success / false : Syntax error
+ */
+bool ExpressionSet::Load(const char* fileName)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(fileName, "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open the expression file [" << fileName << "]!" << std::endl;
+    return false;
+  }
+
+  char line[1024];
+  int  nLine = 0;
+  bool good  = true;
+
+  while( good && fgets(line, 1024, fp) != NULL )
+  {
+    nLine++;
+    char* line_p;
+    if( ( line_p = strchr(line, '\n') ) != NULL ) *line_p = 0;
+
+    char keyword[64], name[64];
+    int  textOffset = 0;
+    int  nItems = sscanf(line, "%63s %63s %n", keyword, name, &textOffset);
+    if( nItems < 1 || keyword[0] == '#' ) continue;
+
+    // The expression is pasted into the generated function, so it may not end the statement or the function.
+    Expression expression;
+    expression.name = name;
+    expression.text = ( nItems == 2 && textOffset > 0 ) ? line + textOffset : "";
+    expression.slot = -1;
+    if( nItems < 2 || expression.text.empty() || !IsIdentifier(name) || strpbrk(expression.text.c_str(), ";{}#") != NULL )
+    {
+      good = false;
+      break;
+    }
+
+    if( strcmp(keyword, "var") == 0 )
+    {
+      if( ( expression.slot = AddUserRecordField(name) ) < 0 )
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : The variable [" << name << "] is a column already, or more than "
+                  << kMaxUserVariables << " variables are defined!" << std::endl;
+        good = false;
+        break;
+      }
+      variables.push_back(expression);
+    }
+    else if( strcmp(keyword, "cut") == 0 ) cuts.push_back(expression);
+    else good = false;
+  }
+  fclose(fp);
+
+  if( !good )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Syntax error in the expression file [" << fileName << "] line " << nLine << "!" << std::endl;
+    return false;
+  }
+
+  std::cout << "[" << releaseName << "] EXPRESSIONS : " << variables.size() << " variable(s), " << cuts.size() << " cut(s) from [" << fileName << "]" << std::endl;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the C++ code of the expressions. Every column of the record is a macro
+ *        which reads it at its offset, so the generated code does not depend on record.h.
+ */
+std::string ExpressionSet::GenerateSource()
+{/*{{{*/
+  std::string source;
+  char        line[2048];
+
+  source += "// Generated from the expression file\n";
+  source += "#ifdef __CLING__\n#pragma cling optimize(3)\n#endif\n";
+  source += "#include <cmath>\n\n";
+
+  for(int i = 0; i < GetNRecordFields(); i++)
+  {
+    const RecordField& field = GetRecordField(i);
+    if( field.count > 1 ) snprintf(line, sizeof(line), "#define %s ((%s*)(record_ + %lu))\n", field.name, GetFieldType(field.type), (unsigned long)field.offset);
+    else                  snprintf(line, sizeof(line), "#define %s (*(%s*)(record_ + %lu))\n", field.name, GetFieldType(field.type), (unsigned long)field.offset);
+    source += line;
+  }
+
+  source += "\nextern \"C\" void acct_expression_variables(char* record_)\n{\n";
+  for(unsigned int v = 0; v < variables.size(); v++)
+  {
+    snprintf(line, sizeof(line), "  %s = (float)( %s );\n", variables[v].name.c_str(), variables[v].text.c_str());
+    source += line;
+  }
+  source += "}\n";
+
+  source += "\nextern \"C\" int acct_expression_cuts(const char* constRecord_)\n{\n  char* record_ = (char*)constRecord_;\n";
+  for(unsigned int c = 0; c < cuts.size(); c++)
+  {
+    snprintf(line, sizeof(line), "  if( !( %s ) ) return %u;\n", cuts[c].text.c_str(), c);
+    source += line;
+  }
+  source += "  return -1;\n}\n\n";
+
+  for(int i = 0; i < GetNRecordFields(); i++)
+  {
+    snprintf(line, sizeof(line), "#undef %s\n", GetRecordField(i).name);
+    source += line;
+  }
+
+  return source;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function compiles the expressions and books their cut flow.
+ * @return true : Success / false : The code does not compile
+ */
+bool ExpressionSet::Compile()
+{/*{{{*/
+  std::string source = GenerateSource();
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+  // cling compiles the functions to native code when their address is taken.
+  if( gInterpreter->Declare(source.c_str()) )
+  {
+    variablesFunction = (VariablesFunction)gInterpreter->Calc("(long)&acct_expression_variables");
+    cutsFunction      = (CutsFunction)gInterpreter->Calc("(long)&acct_expression_cuts");
+  }
+#else
+  // ACLiC builds an optimized shared library with the system compiler and loads it.
+  char fileName[512];
+  snprintf(fileName, sizeof(fileName), "%s/acct_expression_%d.C", gSystem->TempDirectory(), (int)getpid());
+  FILE* fp = fopen(fileName, "w");
+  if( fp )
+  {
+    fputs(source.c_str(), fp);
+    fclose(fp);
+    if( gSystem->CompileMacro(fileName, "kO") )
+    {
+      variablesFunction = (VariablesFunction)gSystem->DynFindSymbol("*", "acct_expression_variables");
+      cutsFunction      = (CutsFunction)gSystem->DynFindSymbol("*", "acct_expression_cuts");
+    }
+  }
+#endif
+
+  if( !variablesFunction || !cutsFunction )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : The expressions could not be compiled! The generated code is :" << std::endl << source << std::endl;
+    return false;
+  }
+
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function books the cut flow of the expression cuts of every selection.
+ */
+void ExpressionSet::Book(unsigned int nSelections)
+{/*{{{*/
+  if( cuts.empty() ) return;
+
+  // Bin 0 counts the candidates given to the expressions, bin c + 1 the candidates which passed the cut c.
+  for(unsigned int s = 0; s < nSelections; s++)
+  {
+    TH1D* hCutFlow = new TH1D("hExpressionCutFlow", "Expression cuts", cuts.size() + 1, 0., cuts.size() + 1.);
+    hCutFlow->GetXaxis()->SetBinLabel(1, "Candidates");
+    for(unsigned int c = 0; c < cuts.size(); c++) hCutFlow->GetXaxis()->SetBinLabel(c + 2, cuts[c].name.c_str());
+    hCutFlows.push_back(hCutFlow);
+  }
+  accepted.resize(nSelections);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function fills the variables of the record and evaluates the cuts on it. The result is counted in
+ *        the cut flow of every selection which accepted the current candidate.
+ * @return true : Every cut is passed
+ */
+bool ExpressionSet::Evaluate(EventRecord* record, const SelectionSet& selections)
+{/*{{{*/
+  if( !variables.empty() ) variablesFunction((char*)record);
+  if( cuts.empty() ) return true;
+
+  int failed = cutsFunction((const char*)record);
+  int nPassed = ( failed < 0 ) ? (int)cuts.size() : failed;
+
+  selections.GetAccepted(&accepted[0]);
+  for(unsigned int s = 0; s < hCutFlows.size(); s++)
+  {
+    if( !accepted[s] ) continue;
+    for(int c = 0; c <= nPassed; c++) hCutFlows[s]->Fill(c, weight);
+  }
+  return failed < 0;
+}/*}}}*/
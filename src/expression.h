@@ -0,0 +1,71 @@
+/**
+ * @file      expression.h
+ * @brief     User cuts and derived variables over the record, compiled to native code at startup.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _EXPRESSION_H_
+#define _EXPRESSION_H_
+
+#include <string>
+#include <vector>
+
+#include "record.h"
+
+class TH1D;
+class SelectionSet;
+
+/**
+ * @brief The cuts and variables of an expression file.
+ *
+ * Expression file :
+ *   var <name> <C++ expression>      A derived column <name> of the output (float, userVariable of the record)
+ *   cut <name> <C++ expression>      The candidate is stored only when the expression is true
+ *   # ...                            Comment
+ *
+ * The expressions use the columns of the record by name (e.g. trdKAmpLayer[3], the variables defined above
+ * them) and <cmath>. Compile() turns them into two C++ functions, one for the variables and one for the cuts,
+ * which are JIT-compiled by cling (ROOT 6) or compiled by ACLiC (ROOT 5) once, and then called through
+ * function pointers for every candidate.
+ *
+ * Every selection has its own cut flow of the expression cuts (hExpressionCutFlow of its output), which counts
+ * only the candidates accepted by that selection, so that it follows hEvtCounter of the same file.
+ */
+class ExpressionSet
+{
+  struct Expression
+  {
+    std::string   name;
+    std::string   text;
+    int           slot;                     // userVariable index of a variable
+  };
+
+  typedef void (*VariablesFunction)(char* record);
+  typedef int  (*CutsFunction)(const char* record);     // Returns the index of the first failed cut, -1 : passed
+
+  std::vector<Expression>     variables;
+  std::vector<Expression>     cuts;
+  VariablesFunction           variablesFunction;
+  CutsFunction                cutsFunction;
+
+  std::vector<TH1D*>          hCutFlows;          // One cut flow per selection
+  std::vector<unsigned char>  accepted;           // Acceptance of the current candidate by every selection
+  double                      weight;
+
+  std::string GenerateSource();
+
+public:
+  ExpressionSet();
+
+  bool IsEnabled() const { return !variables.empty() || !cuts.empty(); }
+
+  bool Load(const char* fileName);
+  bool Compile();
+  void Book(unsigned int nSelections);
+  void SetWeight(double weight) { this->weight = weight; }
+
+  bool Evaluate(EventRecord* record, const SelectionSet& selections);
+  TH1D* GetCutFlow(unsigned int s) { return ( s < hCutFlows.size() ) ? hCutFlows[s] : NULL; }
+};
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file      filestream.cxx
+ * @brief     File window and release of the finished files of the streaming chain mode.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "TFile.h"
+#include "TChainElement.h"
+
+#ifndef __AMSINC__
+#define __AMSINC__
+#include "amschain.h"
+#include "selector.h"
+#endif
+
+#include "timer.h"
+#include "telemetry.h"
+#include "setupcache.h"
+#include "filestream.h"
+
+extern char releaseName[16];
+
+#define kRSSSamplePeriod 1024               // Entries between two RSS samples
+
+
+
+FileStream::FileStream(int maxOpenFiles)
+  : maxOpenFiles(maxOpenFiles), currentTree(-1), currentVisit(-1), nextPrefetch(0), fileStartTime(0.)
+{/*{{{*/
+}/*}}}*/
+
+
+
+/**
+ * @brief This function takes the file names of the chain and the order in which the entry list visits them.
+ *        No file is opened here. (The tree offsets of the chain are known after GetEntries().)
+ */
+void FileStream::Begin(AMSChain& chain, const std::vector<long long>& entryList)
+{/*{{{*/
+  if( !IsEnabled() ) return;
+
+  TObjArray* chainFiles = chain.GetListOfFiles();
+  for(int i = 0; i < chainFiles->GetEntries(); i++) fileNames.push_back(((TChainElement*)chainFiles->At(i))->GetTitle());
+
+  if( entryList.empty() )
+  {
+    for(unsigned int t = 0; t < fileNames.size(); t++) visits.push_back(t);
+  }
+  else
+  {
+    Long64_t* treeOffsets = chain.GetTreeOffset();
+    for(unsigned int i = 0; i < entryList.size(); i++)
+    {
+      int tree = std::upper_bound(treeOffsets, treeOffsets + fileNames.size(), (Long64_t)entryList[i]) - treeOffsets - 1;
+      if( visits.empty() || visits.back() != tree ) visits.push_back(tree);
+    }
+  }
+
+  std::cout << "[" << releaseName << "] STREAMING CHAIN : " << fileNames.size() << " files (" << visits.size() << " visits), at most "
+            << maxOpenFiles << " open" << std::endl;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes the files opened ahead for the visits before the current one, which the chain
+ *        skipped, and opens ahead the files of the next visits, up to the window.
+ *        TFile::Open() of the chain takes over (and deletes) the pending handle of the file it opens.
+ */
+void FileStream::Prefetch()
+{/*{{{*/
+  std::vector< std::pair<int, TFileOpenHandle*> > kept;
+  for(unsigned int p = 0; p < prefetched.size(); p++)
+  {
+    if( prefetched[p].first > currentVisit ) kept.push_back(prefetched[p]);
+    else if( prefetched[p].first < currentVisit ) delete TFile::Open(prefetched[p].second);
+  }
+  prefetched.swap(kept);
+
+  if( nextPrefetch <= currentVisit ) nextPrefetch = currentVisit + 1;
+  while( nextPrefetch < (int)visits.size() && nextPrefetch < currentVisit + maxOpenFiles )
+  {
+    // A file visited again right after another visit is still open or is reopened by the chain itself.
+    TFileOpenHandle* handle = TFile::AsyncOpen(fileNames[visits[nextPrefetch]].c_str());
+    if( handle ) prefetched.push_back(std::make_pair(nextPrefetch, handle));
+    nextPrefetch++;
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes the statistics of the finished file and releases what was kept for it.
+ */
+void FileStream::FinishFile()
+{/*{{{*/
+  if( currentTree < 0 ) return;
+
+  if( setupCache ) setupCache->ReleaseOtherRuns();
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+
+  long long rss = GetCurrentRSS();
+  if( rss > current.peakRSS ) current.peakRSS = rss;
+  current.endRSS = rss;
+  current.time   = GetMonotonicTime() - fileStartTime;
+  files.push_back(current);
+
+  std::cout << "[" << releaseName << "] FILE DONE : [" << current.name << "] " << current.nEntries << " entries, peak RSS "
+            << current.peakRSS / 1048576 << " MB, RSS after release " << current.endRSS / 1048576 << " MB" << std::endl;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function is called after every read of the event loop. It follows the file changes of the chain.
+ */
+void FileStream::Update(AMSChain& chain)
+{/*{{{*/
+  if( !IsEnabled() ) return;
+
+  int tree = chain.GetTreeNumber();
+  if( tree != currentTree )
+  {
+    FinishFile();
+    currentTree = tree;
+
+    // The visit of the new file : the next one in the order, or, if the loop jumped, the first one after the current.
+    int visit = currentVisit + 1;
+    while( visit < (int)visits.size() && visits[visit] != tree ) visit++;
+    if( visit < (int)visits.size() ) currentVisit = visit;
+
+    current.name     = ( tree >= 0 && tree < (int)fileNames.size() ) ? fileNames[tree] : std::string("");
+    current.nEntries = 0;
+    current.peakRSS  = GetCurrentRSS();
+    current.endRSS   = 0;
+    fileStartTime    = GetMonotonicTime();
+    Prefetch();
+  }
+
+  if( ++current.nEntries % kRSSSamplePeriod == 0 )
+  {
+    long long rss = GetCurrentRSS();
+    if( rss > current.peakRSS ) current.peakRSS = rss;
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes the statistics of the last file and the files opened ahead which were not read.
+ */
+void FileStream::Finish()
+{/*{{{*/
+  if( !IsEnabled() ) return;
+  FinishFile();
+  currentTree = -1;
+
+  for(unsigned int p = 0; p < prefetched.size(); p++) delete TFile::Open(prefetched[p].second);
+  prefetched.clear();
+}/*}}}*/
+
+
+
+void FileStream::PrintStatistics()
+{/*{{{*/
+  if( !IsEnabled() || files.empty() ) return;
+
+  long long maxPeak = 0, firstEnd = files.front().endRSS, lastEnd = files.back().endRSS;
+  for(unsigned int f = 0; f < files.size(); f++) if( files[f].peakRSS > maxPeak ) maxPeak = files[f].peakRSS;
+
+  std::cout << "[" << releaseName << "] STREAMING CHAIN : " << files.size() << " files, largest peak RSS " << maxPeak / 1048576
+            << " MB, RSS after the first file " << firstEnd / 1048576 << " MB, after the last file " << lastEnd / 1048576 << " MB" << std::endl;
+}/*}}}*/
@@ -0,0 +1,64 @@
+/**
+ * @file      filestream.h
+ * @brief     Streaming chain mode : bounded number of open input files and per-file memory report.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _FILESTREAM_H_
+#define _FILESTREAM_H_
+
+#include <string>
+#include <vector>
+
+class AMSChain;
+class TFileOpenHandle;
+
+/**
+ * @brief Follows the files of the chain as the event loop goes through them.
+ *
+ * At most maxOpenFiles files are open : the current file of the chain, and the next maxOpenFiles - 1 files
+ * which are opened ahead asynchronously (TFile::AsyncOpen) so that the remote open overlaps the analysis.
+ * Only the files which the entry list visits are opened ahead, in the order of the visits. A file opened ahead
+ * which the loop never reads (e.g. every entry was rejected by the header index) is closed when the window
+ * moves past it.
+ * When the chain moves to the next file, the finished file is gone with its basket cache and streamer
+ * infos (TChain deletes it), the runs of the setup cache other than the current one are unmapped and the
+ * freed heap is returned to the system, so that the resident memory does not grow with the list.
+ */
+class FileStream
+{
+  struct FileStatistics
+  {
+    std::string   name;
+    long long     nEntries;                 // Entries read from the file
+    long long     peakRSS;                  // (bytes) Largest sampled RSS while the file was current
+    long long     endRSS;                   // (bytes) RSS after the file was released
+    double        time;                     // (s)
+  };
+
+  int                           maxOpenFiles;
+  std::vector<std::string>      fileNames;
+  std::vector<int>              visits;       // Tree numbers of the files in the order the loop visits them
+  int                           currentTree;
+  int                           currentVisit; // Position of the current file in visits
+  int                           nextPrefetch; // Position of the next file to be opened ahead
+  std::vector< std::pair<int, TFileOpenHandle*> > prefetched;  // (position, handle) not yet taken over by the chain
+  FileStatistics                current;
+  double                        fileStartTime;
+  std::vector<FileStatistics>   files;
+
+  void Prefetch();
+  void FinishFile();
+
+public:
+  FileStream(int maxOpenFiles);
+
+  bool IsEnabled() const { return maxOpenFiles > 0; }
+
+  void Begin(AMSChain& chain, const std::vector<long long>& entryList);
+  void Update(AMSChain& chain);
+  void Finish();
+  void PrintStatistics();
+};
+
+#endif
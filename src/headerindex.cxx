@@ -0,0 +1,242 @@
+/**
+ * @file      headerindex.cxx
+ * @brief     Builder and reader of the header index.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TChainElement.h"
+
+#ifndef __AMSINC__
+#define __AMSINC__
+#include "amschain.h"
+#include "selector.h"
+#endif
+
+#include "blockcuts.h"
+#include "headerindex.h"
+
+extern char releaseName[16];
+
+#define kHeaderIndexCompression 208         // LZMA, level 8 : the index is written once and read by every job
+
+
+
+/**
+ * @brief This function returns the part of a path after the last '/'.
+ */
+static std::string GetBaseName(const char* path)
+{/*{{{*/
+  const char* slash = strrchr(path, '/');
+  return slash ? std::string(slash + 1) : std::string(path);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads the header data of every event of the files in the list and writes the index.
+ * @return 0 : Success / -1 : The list or the index file could not be opened
+ */
+int BuildHeaderIndex(const char* listFileName, const char* indexFileName)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(listFileName, "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open file [" << listFileName << "]!" << std::endl;
+    return -1;
+  }
+
+  // Written under a temporary name and renamed, so that a job never opens a half written index.
+  std::string temporaryName = std::string(indexFileName) + ".tmp";
+  TFile* file = new TFile(temporaryName.c_str(), "RECREATE");
+  if( file->IsZombie() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the header index [" << temporaryName << "]!" << std::endl;
+    fclose(fp);
+    delete file;
+    return -1;
+  }
+  file->SetCompressionSettings(kHeaderIndexCompression);
+
+  HeaderIndexRecord record;
+  TTree* records = new TTree("headerIndex", "Header data of every event");
+  records->Branch("header", &record, HEADERINDEX_LEAVES);
+
+  char     path[512];
+  Long64_t nEntries, firstRecord = 0;
+  TTree* files = new TTree("files", "Indexed files");
+  files->Branch("path", path, "path/C");
+  files->Branch("nEntries", &nEntries, "nEntries/L");
+  files->Branch("firstRecord", &firstRecord, "firstRecord/L");
+
+  char  inputFileName[512];
+  char* line_p;
+  unsigned short nFiles = 0;
+  while( fgets(inputFileName, 512, fp) != NULL )
+  {
+    if( ( line_p = strchr(inputFileName, '\n') ) != NULL ) *line_p = 0;
+    if( inputFileName[0] == '\0' ) continue;
+
+    AMSChain chain;
+    if( chain.Add(inputFileName) != 1 || ( nEntries = chain.GetEntries() ) == 0 )
+    {
+      std::cerr << "[" << releaseName << "] WARNING   : Failed to open file [" << inputFileName << "]. It is skipped." << std::endl;
+      continue;
+    }
+
+    for(Long64_t e = 0; e < nEntries; e++)
+    {
+      AMSEventR* pev = chain.GetEvent(e);
+      unsigned int jinjStatus[4], jError[24];
+      BlockCuts::GatherDaqWords(pev, jinjStatus, jError);
+
+      record.entry          = e;
+      record.run            = pev->Run();
+      record.event          = pev->Event();
+      record.time           = pev->UTime();
+      record.runType        = pev->fHeader.RunType;
+      record.thetaS         = pev->fHeader.ThetaS;
+      record.phiS           = pev->fHeader.PhiS;
+      record.nParticle      = pev->nParticle();
+      record.file           = nFiles;
+      record.physicsPattern = (unsigned char)BlockCuts::GetPhysicsPattern(pev);
+      record.daqError       = BlockCuts::GetDaqErrorBits(jinjStatus, jError);
+      record.flags          = pev->IsInSAA() ? kHeaderInSAA : 0;
+      records->Fill();
+    }
+
+    strncpy(path, inputFileName, 511);
+    path[511] = '\0';
+    files->Fill();
+    firstRecord += nEntries;
+    nFiles++;
+
+    std::cout << "[" << releaseName << "] Indexed " << nEntries << " events of [" << inputFileName << "]" << std::endl;
+  }
+  fclose(fp);
+
+  records->Write();
+  files->Write();
+  file->Close();
+  delete file;
+
+  if( rename(temporaryName.c_str(), indexFileName) != 0 )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to rename the header index to [" << indexFileName << "]!" << std::endl;
+    return -1;
+  }
+
+  std::cout << "[" << releaseName << "] HEADER INDEX : " << firstRecord << " events of " << nFiles << " files are written to [" << indexFileName << "]" << std::endl;
+  return 0;
+}/*}}}*/
+
+
+
+HeaderIndex::HeaderIndex()
+  : file(NULL), records(NULL)
+{/*{{{*/
+}/*}}}*/
+
+
+
+HeaderIndex::~HeaderIndex()
+{/*{{{*/
+  if( file ) file->Close();
+  delete file;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function opens the index and matches its files with the files of the chain.
+ * @return true : The index is usable / false : The index could not be read
+ */
+bool HeaderIndex::Open(const char* indexFileName, AMSChain& chain)
+{/*{{{*/
+  file = TFile::Open(indexFileName);
+  if( !file || file->IsZombie() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open the header index [" << indexFileName << "]!" << std::endl;
+    return false;
+  }
+
+  records = (TTree*)file->Get("headerIndex");
+  TTree* files = (TTree*)file->Get("files");
+  if( !records || !files )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : [" << indexFileName << "] is not a header index!" << std::endl;
+    return false;
+  }
+  records->SetBranchAddress("header", &record);
+
+  // File table of the index
+  char     path[512];
+  Long64_t nEntries, firstEntry;
+  files->SetBranchAddress("path", path);
+  files->SetBranchAddress("nEntries", &nEntries);
+  files->SetBranchAddress("firstRecord", &firstEntry);
+
+  std::map<std::string, int>  byPath, byBaseName;
+  std::vector<Long64_t>       indexEntries, indexFirst;
+  for(Long64_t f = 0; f < files->GetEntries(); f++)
+  {
+    files->GetEntry(f);
+    byPath[path] = f;
+    byBaseName[GetBaseName(path)] = f;
+    indexEntries.push_back(nEntries);
+    indexFirst.push_back(firstEntry);
+  }
+
+  // Files of the chain
+  chain.GetEntries();                                       // Fills the tree offsets of the chain
+  Long64_t*  treeOffsets = chain.GetTreeOffset();
+  TObjArray* chainFiles  = chain.GetListOfFiles();
+  int        nTrees      = chainFiles->GetEntries();
+  int        nIndexed    = 0;
+
+  chainOffsets.assign(treeOffsets, treeOffsets + nTrees + 1);
+  firstRecord.assign(nTrees, -1);
+  for(int t = 0; t < nTrees; t++)
+  {
+    const char* fileName = ((TChainElement*)chainFiles->At(t))->GetTitle();
+    int f;
+    if( byPath.count(fileName) ) f = byPath[fileName];
+    else if( byBaseName.count(GetBaseName(fileName)) ) f = byBaseName[GetBaseName(fileName)];
+    else continue;
+
+    if( indexEntries[f] != treeOffsets[t+1] - treeOffsets[t] )
+    {
+      std::cerr << "[" << releaseName << "] WARNING   : The header index of [" << fileName << "] does not match the file. It is not used." << std::endl;
+      continue;
+    }
+    firstRecord[t] = indexFirst[f];
+    nIndexed++;
+  }
+
+  std::cout << "[" << releaseName << "] HEADER INDEX : " << nIndexed << " of " << nTrees << " files are indexed in [" << indexFileName << "]" << std::endl;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads the record of an entry of the chain.
+ * @return Record / NULL : The file of the entry is not indexed
+ */
+const HeaderIndexRecord* HeaderIndex::Get(long long chainEntry)
+{/*{{{*/
+  int t = std::upper_bound(chainOffsets.begin(), chainOffsets.end(), chainEntry) - chainOffsets.begin() - 1;
+  if( t < 0 || t >= (int)firstRecord.size() || firstRecord[t] < 0 ) return NULL;
+
+  long long localEntry = chainEntry - chainOffsets[t];
+  if( records->GetEntry(firstRecord[t] + localEntry) <= 0 || record.entry != localEntry ) return NULL;
+  return &record;
+}/*}}}*/
@@ -0,0 +1,66 @@
+/**
+ * @file      headerindex.h
+ * @brief     Compact header-only index of the input files, used to pre-filter events before they are read.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _HEADERINDEX_H_
+#define _HEADERINDEX_H_
+
+#include <vector>
+
+class TFile;
+class TTree;
+class AMSChain;
+
+#define kHeaderInSAA    0x01                // HeaderIndexRecord::flags : IsInSAA()
+
+/**
+ * @brief Header data of one event. The members are ordered by size, as the leaf list of the index tree expects.
+ */
+struct HeaderIndexRecord
+{
+  long long       entry;                    // Entry in the tree of the file
+  unsigned int    run;
+  unsigned int    event;
+  unsigned int    time;                     // UTime()
+  unsigned int    runType;
+  float           thetaS;                   // ISS position (rad)
+  float           phiS;
+  int             nParticle;
+  unsigned short  file;                     // Index in the file table
+  unsigned char   physicsPattern;           // Level1 PhysBPatt deciding IsUnbiasedPhysicsTriggerEvent() (BlockCuts::GetPhysicsPattern())
+  unsigned char   daqError;                 // Error bits of IsHardwareStatusGood() (BlockCuts::GetDaqErrorBits())
+  unsigned char   flags;
+};
+
+#define HEADERINDEX_LEAVES "entry/L:run/i:event/i:time/i:runType/i:thetaS/F:phiS/F:nParticle/I:file/s:physicsPattern/b:daqError/b:flags/b"
+
+/**
+ * @brief Header index opened for the files of a chain.
+ *
+ * The index is a ROOT file with two compressed trees :
+ *   headerIndex : one HeaderIndexRecord per event, the events of every file in a contiguous range
+ *   files       : path, nEntries and firstRecord of every indexed file
+ * The files of the chain are matched by path, then by base name. A file which is not indexed, or whose
+ * number of entries differs, is left to the event loop.
+ */
+class HeaderIndex
+{
+  TFile*                  file;
+  TTree*                  records;
+  HeaderIndexRecord       record;
+  std::vector<long long>  chainOffsets;     // First chain entry of every tree of the chain, and the total
+  std::vector<long long>  firstRecord;      // First record of every tree of the chain in the index (-1 : not indexed)
+
+public:
+  HeaderIndex();
+  ~HeaderIndex();
+
+  bool Open(const char* indexFileName, AMSChain& chain);
+  const HeaderIndexRecord* Get(long long chainEntry);
+};
+
+int BuildHeaderIndex(const char* listFileName, const char* indexFileName);
+
+#endif
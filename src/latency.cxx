@@ -0,0 +1,384 @@
+/**
+ * @file      latency.cxx
+ * @brief     Event loop stage timer with streaming quantiles and the list of the slowest events.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "TH1D.h"
+#include "TTree.h"
+#include "TString.h"
+
+#include "timer.h"
+#include "writer.h"
+#include "latency.h"
+
+extern char releaseName[16];
+
+static const char*  stageNames[kNStages + 1] = { "read", "cuts", "acsoft", "fill", "write", "total" };
+static const double quantileLevels[3]        = { 0.5, 0.99, 0.999 };
+static const char*  quantileNames[3]         = { "p50", "p99", "p99.9" };
+
+// Binning of the latency histograms in log10(t/s)
+static const int    nLogBins  = 80;
+static const double logMin    = -7.;
+static const double logMax    = 1.;
+
+
+
+P2Quantile::P2Quantile(double p)
+  : p(p), count(0)
+{/*{{{*/
+  for(int i = 0; i < 5; i++) height[i] = position[i] = desired[i] = increment[i] = 0.;
+}/*}}}*/
+
+
+
+/**
+ * @brief Piecewise-parabolic prediction of the height of marker i moved by d.
+ * @return Predicted height
+ */
+double P2Quantile::Parabolic(int i, double d)
+{/*{{{*/
+  return height[i] + d / ( position[i+1] - position[i-1] ) *
+    ( ( position[i] - position[i-1] + d ) * ( height[i+1] - height[i] ) / ( position[i+1] - position[i] ) +
+      ( position[i+1] - position[i] - d ) * ( height[i] - height[i-1] ) / ( position[i] - position[i-1] ) );
+}/*}}}*/
+
+
+
+/**
+ * @brief Linear prediction of the height of marker i moved by d. (Used when the parabola is not monotonic.)
+ * @return Predicted height
+ */
+double P2Quantile::Linear(int i, double d)
+{/*{{{*/
+  int j = i + (int)d;
+  return height[i] + d * ( height[j] - height[i] ) / ( position[j] - position[i] );
+}/*}}}*/
+
+
+
+/**
+ * @brief This function adds one observation.
+ */
+void P2Quantile::Add(double x)
+{/*{{{*/
+  if( count < 5 )
+  {
+    height[count++] = x;
+    if( count == 5 )
+    {
+      std::sort(height, height + 5);
+      for(int i = 0; i < 5; i++) position[i] = i + 1;
+      desired[0] = 1.; desired[1] = 1. + 2. * p; desired[2] = 1. + 4. * p; desired[3] = 3. + 2. * p; desired[4] = 5.;
+      increment[0] = 0.; increment[1] = p / 2.; increment[2] = p; increment[3] = ( 1. + p ) / 2.; increment[4] = 1.;
+    }
+    return;
+  }
+
+  int k;
+  if( x < height[0] )       { height[0] = x; k = 0; }
+  else if( x >= height[4] ) { height[4] = x; k = 3; }
+  else
+  {
+    k = 0;
+    while( k < 3 && x >= height[k+1] ) k++;
+  }
+
+  for(int i = k + 1; i < 5; i++) position[i] += 1.;
+  for(int i = 0; i < 5; i++) desired[i] += increment[i];
+
+  for(int i = 1; i <= 3; i++)
+  {
+    double d = desired[i] - position[i];
+    if( ( d >= 1. && position[i+1] - position[i] > 1. ) || ( d <= -1. && position[i-1] - position[i] < -1. ) )
+    {
+      d = ( d > 0. ) ? 1. : -1.;
+      double candidate = Parabolic(i, d);
+      if( height[i-1] < candidate && candidate < height[i+1] ) height[i] = candidate;
+      else height[i] = Linear(i, d);
+      position[i] += d;
+    }
+  }
+
+  count++;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the current estimate of the quantile.
+ * @return Estimate (exact while less than five observations are given)
+ */
+double P2Quantile::GetValue() const
+{/*{{{*/
+  if( count == 0 ) return 0.;
+  if( count >= 5 ) return height[2];
+
+  double sorted[5];
+  memcpy(sorted, height, sizeof(double) * count);
+  std::sort(sorted, sorted + count);
+  return sorted[(int)( p * ( count - 1 ) + 0.5 )];
+}/*}}}*/
+
+
+
+/**
+ * @brief Ordering of the slow event heap : the fastest of the kept events is at the front.
+ */
+static bool IsSlower(const SlowEvent& a, const SlowEvent& b)
+{/*{{{*/
+  return a.total > b.total;
+}/*}}}*/
+
+
+
+LatencyMonitor::LatencyMonitor(unsigned int nSlowEvents)
+  : inEvent(false), currentStage(kStageRead), lastMark(0.), nSlowEvents(nSlowEvents), nEvents(0)
+{/*{{{*/
+  for(int s = 0; s < kNStages; s++) stageAllocations[s] = stageBytes[s] = 0.;
+  lastAllocations = GetThreadAllocations();
+  for(int s = 0; s <= kNStages; s++)
+  {
+    for(int q = 0; q < 3; q++) quantiles[s][q] = P2Quantile(quantileLevels[q]);
+    logHistogram[s].assign(nLogBins + 2, 0.);
+  }
+  memset(&current, 0, sizeof(SlowEvent));
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes the previous event (if any) and starts the timer of a new one.
+ */
+void LatencyMonitor::BeginEvent(long long entry)
+{/*{{{*/
+  EndEvent();
+
+  memset(&current, 0, sizeof(SlowEvent));
+  current.entry = entry;
+  currentStage  = kStageRead;
+  inEvent       = true;
+  lastAllocations = GetThreadAllocations();
+  lastMark      = GetMonotonicTime();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function stores the identity of the current event for the slow event list.
+ */
+void LatencyMonitor::SetEventId(unsigned int run, unsigned int event)
+{/*{{{*/
+  current.run   = run;
+  current.event = event;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes the given stage. The time since the previous mark is assigned to it.
+ */
+void LatencyMonitor::Mark(int stage)
+{/*{{{*/
+  double now = GetMonotonicTime();
+  current.stage[stage] += now - lastMark;
+  AccountAllocations(stage);
+  lastMark     = now;
+  currentStage = ( stage + 1 < kNStages ) ? stage + 1 : stage;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function stops the clock of the current event. The time since the previous mark goes to the running stage.
+ */
+void LatencyMonitor::Suspend()
+{/*{{{*/
+  if( !inEvent ) return;
+  current.stage[currentStage] += GetMonotonicTime() - lastMark;
+  AccountAllocations(currentStage);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function restarts the clock of the current event after Suspend().
+ */
+void LatencyMonitor::Resume()
+{/*{{{*/
+  if( !inEvent ) return;
+  lastAllocations = GetThreadAllocations();
+  lastMark        = GetMonotonicTime();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function assigns the allocations since the previous mark to the given stage.
+ */
+void LatencyMonitor::AccountAllocations(int stage)
+{/*{{{*/
+  AllocationCounters now = GetThreadAllocations();
+  stageAllocations[stage] += (double)( now.nAllocations - lastAllocations.nAllocations );
+  stageBytes[stage]       += (double)( now.nBytes - lastAllocations.nBytes );
+  lastAllocations = now;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes the current event (if any) and feeds its stage times to the estimators.
+ */
+void LatencyMonitor::EndEvent()
+{/*{{{*/
+  if( !inEvent ) return;
+
+  current.stage[currentStage] += GetMonotonicTime() - lastMark;
+  AccountAllocations(currentStage);
+  inEvent = false;
+  nEvents++;
+
+  current.total = 0.;
+  for(int s = 0; s < kNStages; s++) current.total += current.stage[s];
+
+  for(int s = 0; s <= kNStages; s++)
+  {
+    double t = ( s == kNStages ) ? current.total : current.stage[s];
+    for(int q = 0; q < 3; q++) quantiles[s][q].Add(t);
+
+    int bin = 0;                                            // Underflow (also t == 0)
+    if( t > 0. )
+    {
+      double x = log10(t);
+      if( x >= logMax ) bin = nLogBins + 1;                 // Overflow
+      else if( x >= logMin ) bin = 1 + (int)( ( x - logMin ) / ( logMax - logMin ) * nLogBins );
+    }
+    logHistogram[s][bin] += 1.;
+  }
+
+  if( nSlowEvents == 0 ) return;
+  if( slowEvents.size() < nSlowEvents )
+  {
+    slowEvents.push_back(current);
+    std::push_heap(slowEvents.begin(), slowEvents.end(), IsSlower);
+  }
+  else if( current.total > slowEvents.front().total )
+  {
+    std::pop_heap(slowEvents.begin(), slowEvents.end(), IsSlower);
+    slowEvents.back() = current;
+    std::push_heap(slowEvents.begin(), slowEvents.end(), IsSlower);
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes the last event of the loop.
+ */
+void LatencyMonitor::Finish()
+{/*{{{*/
+  EndEvent();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function prints the quantiles of every stage.
+ */
+void LatencyMonitor::Print()
+{/*{{{*/
+  std::cout << "[" << releaseName << "] EVENT LATENCY (ms)        p50        p99      p99.9" << std::endl;
+  for(int s = 0; s <= kNStages; s++)
+  {
+    std::cout << "[" << releaseName << "]   " << Form("%-8s %16.4f %10.4f %10.4f", stageNames[s],
+      1e3 * quantiles[s][0].GetValue(), 1e3 * quantiles[s][1].GetValue(), 1e3 * quantiles[s][2].GetValue()) << std::endl;
+  }
+
+  if( nEvents > 0 && IsAllocationCountingEnabled() )
+  {
+    std::cout << "[" << releaseName << "] HEAP ALLOCATIONS / EVENT  count      bytes" << std::endl;
+    for(int s = 0; s < kNStages; s++)
+    {
+      std::cout << "[" << releaseName << "]   " << Form("%-8s %16.1f %10.0f", stageNames[s],
+        stageAllocations[s] / nEvents, stageBytes[s] / nEvents) << std::endl;
+    }
+  }
+
+  if( !slowEvents.empty() )
+  {
+    const SlowEvent& slowest = *std::min_element(slowEvents.begin(), slowEvents.end(), IsSlower);
+    std::cout << "[" << releaseName << "]   Slowest event : Run " << slowest.run << " Event " << slowest.event
+              << " (" << 1e3 * slowest.total << " ms)" << std::endl;
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function builds the latency histograms, the quantile summary and the slowEvents tree and hands them to the writer.
+ */
+void LatencyMonitor::AddObjects(RecordWriter* writer)
+{/*{{{*/
+  for(int s = 0; s <= kNStages; s++)
+  {
+    TH1D* hLatency = new TH1D(Form("hLatency_%s", stageNames[s]), Form("Event loop latency (%s);log_{10}(t / s);Events", stageNames[s]), nLogBins, logMin, logMax);
+    for(int bin = 0; bin <= nLogBins + 1; bin++) hLatency->SetBinContent(bin, logHistogram[s][bin]);
+    hLatency->SetEntries(quantiles[s][0].GetCount());
+    writer->AddObject(hLatency);
+  }
+
+  TH1D* hQuantiles = new TH1D("hLatencyQuantiles", "Event loop latency quantiles;;t (s)", 3 * ( kNStages + 1 ), 0., 3. * ( kNStages + 1 ));
+  for(int s = 0; s <= kNStages; s++)
+  {
+    for(int q = 0; q < 3; q++)
+    {
+      int bin = 3 * s + q + 1;
+      hQuantiles->GetXaxis()->SetBinLabel(bin, Form("%s %s", stageNames[s], quantileNames[q]));
+      hQuantiles->SetBinContent(bin, quantiles[s][q].GetValue());
+    }
+  }
+  writer->AddObject(hQuantiles);
+
+  // The allocation histograms exist only in a build which counts the allocations (allocation.h).
+  if( IsAllocationCountingEnabled() )
+  {
+    TH1D* hAllocations = new TH1D("hAllocationsPerEvent", "Heap allocations per event;;Allocations / event", kNStages, 0., (float)kNStages);
+    TH1D* hBytes       = new TH1D("hAllocatedBytesPerEvent", "Allocated bytes per event;;Bytes / event", kNStages, 0., (float)kNStages);
+    for(int s = 0; s < kNStages; s++)
+    {
+      hAllocations->GetXaxis()->SetBinLabel(s + 1, stageNames[s]);
+      hBytes->GetXaxis()->SetBinLabel(s + 1, stageNames[s]);
+      if( nEvents == 0 ) continue;
+      hAllocations->SetBinContent(s + 1, stageAllocations[s] / nEvents);
+      hBytes->SetBinContent(s + 1, stageBytes[s] / nEvents);
+    }
+    writer->AddObject(hAllocations);
+    writer->AddObject(hBytes);
+  }
+
+  // Slowest events, the slowest first. The tree stays in memory until the writer stores it.
+  std::vector<SlowEvent> sorted(slowEvents);
+  std::sort(sorted.begin(), sorted.end(), IsSlower);
+
+  SlowEvent slowEvent;
+  TTree* tSlowEvents = new TTree("slowEvents", "Slowest events of the event loop");
+  tSlowEvents->SetDirectory(0);
+  tSlowEvents->Branch("nRun", &slowEvent.run, "nRun/i");
+  tSlowEvents->Branch("nEvent", &slowEvent.event, "nEvent/i");
+  tSlowEvents->Branch("entry", &slowEvent.entry, "entry/L");
+  tSlowEvents->Branch("total", &slowEvent.total, "total/D");
+  tSlowEvents->Branch("stage", slowEvent.stage, Form("stage[%d]/D", kNStages));
+  for(unsigned int i = 0; i < sorted.size(); i++)
+  {
+    slowEvent = sorted[i];
+    tSlowEvents->Fill();
+  }
+  tSlowEvents->ResetBranchAddresses();
+  writer->AddObject(tSlowEvents);
+}/*}}}*/
@@ -0,0 +1,113 @@
+/**
+ * @file      latency.h
+ * @brief     Per-event wall time of the event loop stages, streaming quantiles and the slowest events.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <vector>
+
+#include "allocation.h"
+
+class RecordWriter;
+
+enum LatencyStage
+{
+  kStageRead   = 0,             // AMSChain::GetEvent()
+  kStageCuts   = 1,             // Basic cut processes
+  kStageACSoft = 2,             // ACSoft event building, TRD tracking and particle filling
+  kStageFill   = 3,             // Filling of the EventRecord
+  kStageWrite  = 4,             // Hand-over to the writer (including the waits for a free slot)
+  kNStages     = 5
+};
+
+/**
+ * @brief Streaming estimator of one quantile with the P-square algorithm (Jain and Chlamtac, 1985).
+ *
+ * Five markers are kept, so the memory does not grow with the number of observations.
+ */
+class P2Quantile
+{
+  double  p;                                // Quantile to be estimated (0 < p < 1)
+  long    count;                            // Number of observations
+  double  height[5];                        // Marker heights
+  double  position[5];                      // Actual marker positions
+  double  desired[5];                       // Desired marker positions
+  double  increment[5];                     // Increments of the desired positions
+
+  double  Parabolic(int i, double d);
+  double  Linear(int i, double d);
+
+public:
+  P2Quantile(double p = 0.5);
+
+  void    Add(double x);
+  double  GetValue() const;
+  long    GetCount() const { return count; }
+};
+
+/**
+ * @brief One of the slowest events.
+ */
+struct SlowEvent
+{
+  unsigned int  run;
+  unsigned int  event;
+  long long     entry;
+  double        total;                      // (s) Sum of the stage times
+  double        stage[kNStages];            // (s) Time of every stage
+};
+
+/**
+ * @brief Stage timer of the event loop.
+ *
+ * BeginEvent() starts an event (and closes the previous one), Mark() closes a stage, EndEvent()
+ * closes the event. The time which is not marked when the event is closed (e.g. an event rejected
+ * in the cuts) is assigned to the stage which was running. Only the entries which are read are
+ * events : the work between EndEvent() and BeginEvent() (the block cut loads, the entries rejected
+ * by the block cuts) is not part of the latency. Suspend() and Resume() keep the work of the
+ * loop which is not caused by the current event (the classifier batches) out of it as well.
+ *
+ * The heap allocations of the calling thread (allocation.h) are accounted to the stages in the same way,
+ * in a build with COUNT_ALLOCATIONS=1.
+ *
+ * The histograms and the slowEvents tree belong to the job. With several selections, AddObjects() is called
+ * with the writer of the first selection only, so they are found in its output and nowhere else.
+ */
+class LatencyMonitor
+{
+  bool                    inEvent;
+  int                     currentStage;
+  double                  lastMark;
+  SlowEvent               current;
+
+  P2Quantile              quantiles[kNStages + 1][3];   // p50, p99, p99.9 per stage and for the total
+  std::vector<double>     logHistogram[kNStages + 1];   // Counts in log10 bins of the time
+  unsigned int            nSlowEvents;
+  std::vector<SlowEvent>  slowEvents;                   // Min-heap on total time
+
+  AllocationCounters      lastAllocations;              // Counters at the previous mark
+  double                  stageAllocations[kNStages];   // Sum of the allocations of every stage over the events
+  double                  stageBytes[kNStages];         // Sum of the allocated bytes of every stage over the events
+  long                    nEvents;
+
+  void AccountAllocations(int stage);
+
+public:
+  LatencyMonitor(unsigned int nSlowEvents = 100);
+
+  void BeginEvent(long long entry);
+  void SetEventId(unsigned int run, unsigned int event);
+  void Mark(int stage);
+  void EndEvent();
+  void Suspend();
+  void Resume();
+  void Finish();
+
+  void Print();
+  void AddObjects(RecordWriter* writer);
+};
+
+#endif
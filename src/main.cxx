@@ -20,13 +20,34 @@
 #include "AMSRootParticleFactory.hh"
 #endif
 
+#include "record.h"
+#include "options.h"
+#include "writer.h"
+#include "partition.h"
+#include "columnar.h"
+#include "ntuple.h"
+#include "latency.h"
+#include "replay.h"
+#include "workqueue.h"
+#include "selection.h"
+#include "setupcache.h"
+#include "watch.h"
+#include "sampling.h"
+#include "telemetry.h"
+#include "blockcuts.h"
+#include "headerindex.h"
+#include "filestream.h"
+#include "expression.h"
+#include "classifier.h"
+
 // Some global variables
 char releaseName[16];
 char softwareName[10] = "ACCTOFInt";
 char versionNumber[5] = "0.01";
 
-bool IsBadRun(AMSEventR* thisEvent);
 bool IsGoodParticle(ParticleR* thisParticle);
+TH1D* MakeRunCounter(TH1D* hTotal, TH1D* hRunStart);
+const Analysis::Particle* FindAnalysisParticle(const Analysis::Event& event, const ParticleR* pParticle);
 
 /**
  * @brief This is main() function.
@@ -37,6 +58,27 @@ int main(int argc, char* argv[])
 {
   sprintf(releaseName, "%s%s", softwareName, versionNumber);
 
+  // Options (--key=value) are removed from argv here so that the run mode is decided by the positional arguments only.
+  RunOptions options;
+  SetDefaultOptions(&options);
+  if( ( argc = ParseOptions(&options, argc, argv) ) < 0 ) return -1;
+
+  // Warm-up command of the setup cache : ./a.out --setup-cache=<directory> --warm-setup-cache=<list file>
+  if( options.warmSetupList[0] != '\0' )
+  {
+    std::cout << "[" << releaseName << "] RUN MODE : Setup Cache Warm-up" << endl;
+    AMSSetupR::RTI::UseLatest();
+    TkDBc::UseFinal();
+    return WarmSetupCache(options.warmSetupList, options.setupCacheDir);
+  }
+
+  // Build command of the header index : ./a.out --header-index=<index file> --build-header-index=<list file>
+  if( options.headerIndexList[0] != '\0' )
+  {
+    std::cout << "[" << releaseName << "] RUN MODE : Header Index Build" << endl;
+    return BuildHeaderIndex(options.headerIndexList, options.headerIndexFile);
+  }
+
   /*************************************************************************************************************
    *
    * FILE OPENING PHASE
@@ -59,6 +101,15 @@ int main(int argc, char* argv[])
    * 2. Job submission mode
    *   2-1. Standard job submission mode
    *     ./a.out <list file which contains list of files to be analyzed> <output file> ( argc == 3 )
+   *   2-2. Work-queue mode
+   *     ./a.out --work-queue=<shared directory> <list file> <output file> ( argc == 3 )
+   *     Any number of workers on any node take the files one at a time. Each file is analyzed by a forked
+   *     process into <output file base>_<input file base>.root.
+   *
+   * 3. Watch mode
+   *     ./a.out --watch=<incoming directory> <output directory> ( argc == 2 )
+   *     Runs as a daemon. Every completed file arriving in the directory is analyzed by a forked process into
+   *     <output directory>/<run>/<input file base>.root and recorded in <output directory>/processed.ledger.
    */
 
   // AMSChain
@@ -69,8 +120,62 @@ int main(int argc, char* argv[])
   char inputFileName[256];      // File path for single run. (Cat 3.)
   char outputFileName[256];     // The name of the output file to be stored in the disk.
   int  nEntries = 0;            // Number of entries to be analyzed.
+  bool fileWorker  = false;     // This process is forked to analyze one file of the work queue or of the watch mode.
 
-  if( argc == 1 )
+  if( options.workQueue[0] != '\0' )
+  {
+    if( argc != 3 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : --work-queue requires the batch-job mode (<list file> <output file>)!" << endl;
+      return -1;
+    }
+
+    // Returns in the forked process only, with the claimed file. The worker itself returns when the queue is empty.
+    WorkItem item;
+    // The outputs are written to the directory of the claim and moved next to <output file> by the worker once the
+    // item is completed.
+    int status = RunQueueWorker(options.workQueue, argv[1], argv[2], options.heartbeatTimeout, item);
+    if( status != kQueueChild ) return status;
+
+    const char* inputBaseName = strrchr(item.inputFileName.c_str(), '/');
+    inputBaseName = inputBaseName ? inputBaseName + 1 : item.inputFileName.c_str();
+    const char* outputBaseName = strrchr(argv[2], '/');
+    outputBaseName = outputBaseName ? outputBaseName + 1 : argv[2];
+    strcpy(inputFileName, item.inputFileName.c_str());
+    sprintf(outputFileName, "%s/%s_%s.root", item.outputDirectory.c_str(), GetOutputBaseName(outputBaseName).c_str(), GetOutputBaseName(inputBaseName).c_str());
+    fileWorker = true;
+  }
+  else if( options.watchDirectory[0] != '\0' )
+  {
+    if( argc != 2 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : --watch requires the output directory as the only argument!" << endl;
+      return -1;
+    }
+
+    // Returns in the forked process only, with the new file. The daemon itself returns when it is stopped.
+    std::string newFileName, segmentFileName;
+    int status = RunWatchDaemon(options.watchDirectory, argv[1], options.watchInterval, options.watchSettleTime, newFileName, segmentFileName);
+    if( status != kWatchChild ) return status;
+
+    strcpy(inputFileName, newFileName.c_str());
+    strcpy(outputFileName, segmentFileName.c_str());
+    fileWorker = true;
+  }
+
+  if( fileWorker )
+  {
+    std::cout << "[" << releaseName << "] RUN MODE : Single File Worker" << endl;
+
+    if(amsChain.Add(inputFileName) != 1)
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : File open error, [" << inputFileName << "] can not be found!" << endl;
+      return -1;
+    }
+
+    nEntries = amsChain.GetEntries();
+  }
+  else if( argc == 1 )
   {
     std::cout << "[" << releaseName << "] RUN MODE : Single Test Run (Cat. 1)" << endl;
 
@@ -152,6 +257,28 @@ int main(int argc, char* argv[])
     std::cout << "[" << releaseName << "] The file [" << inputFileName << "] is added to the chain." << std::endl;
   }/*}}}*/
 
+  // With --replay only the listed (Run, Event) pairs are read, through the cached per-file event index.
+  std::vector<long long> entryList;
+  if( options.replayList[0] != '\0' )
+  {
+    if( !BuildReplayEntryList(amsChain, options.replayList, options.indexCacheDir, entryList) ) return -1;
+    nEntries = entryList.size();
+  }
+
+  // With --sample only a seeded subset spread over every file of the chain is read. The sampled events carry
+  // the weight (chain entries) / (sampled entries) in the record and in the cut flows.
+  double sampleWeight = 1.;
+  if( options.sampleFraction > 0. )
+  {
+    sampleWeight = BuildSampleEntryList(amsChain, options.sampleMode, options.sampleFraction, options.sampleSeed, entryList);
+    if( sampleWeight <= 0. )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : No entry is sampled!" << endl;
+      return -1;
+    }
+    nEntries = entryList.size();
+  }
+
   std::cout << "[" << releaseName << "] TOTAL EVENTS   : " << nEntries << endl;
   std::cout << "[" << releaseName << "] OUTPUT FILE NAME : " << outputFileName << endl;
 
@@ -161,275 +288,77 @@ int main(int argc, char* argv[])
    *
    ***********************************************************************************************************************/
 
+  // The versions of the RTI and tracker alignment tables. The tracker alignment is needed by the track fits
+  // whether or not the setup cache is used (setupcache.h).
   AMSSetupR::RTI::UseLatest();
   TkDBc::UseFinal();
 
+  // With --setup-cache the cuts take the bad-run flags and the RTI alignment of the cached runs from the
+  // memory-mapped local cache instead of root_setup. Runs which are not cached fall back to the AMS setup.
+  if( options.setupCacheDir[0] != '\0' ) setupCache = new SetupCache(options.setupCacheDir);
+
   const bool setAMSRootDefaults = true;
   AMSRootSupport amsRootSupport(AC::ISSRun, setAMSRootDefaults);
   Analysis::EventFactory& eventFactory = amsRootSupport.EventFactory();
   Analysis::AMSRootParticleFactory& particleFactory = amsRootSupport.ParticleFactory();
 
-  // Variable declaration which will be used for tree construction
-  unsigned int  nCuts = 7;/*{{{*/           // Number of cuts
-  unsigned int  nProcessed = 0;             // Number of processed events
-  unsigned int  nRun;                       // Run number
-  unsigned int  nEvent;                     // Event number
-  unsigned int  nProcessedNumber;           // Number of processed events
-  unsigned int  nLevel1;                    // Number of Level1 triggers
-  unsigned int  nParticle;                  // Number of particles
-  unsigned int  nCharge;                    // Number of charges
-  unsigned int  nTrTrack;                   // Number of the Tracker tracks which are successfully reconstructed
-  unsigned int  nTrdTrack;                  // Number of the TRD tracks which are successfully reconstructed
-  unsigned int  nAntiCluster;               // Number of clusters on the ACC
-  unsigned int  nTofClustersInTime;         // Number of in-time clusters on the TOF
-  unsigned int  nRichRing;                  // Number of successfully reconstructed the RICH rings
-  unsigned int  nRichRingB;                 // Number of successfully reconstructed the RICH rings with algorithm B
-  unsigned int  nBeta;                      // Number of successfully estimated beta(v/c) values
-  unsigned int  nBetaB;                     // Number of successfully estimated beta(v/c) values with algorithm B
-  unsigned int  nBetaH;                     // Number of successfully estimated beta(v/c) values with algorithm H
-  unsigned int  nShower;                    // Number of the ECAL shower objects
-  unsigned int  nVertex;                    // Number of vertices in this event
-  unsigned int  particleType;               // Type of ParticleR
-  float         livetime;                   // Livetime fraction
-  float         utcTime;                    // UTC time
-  float         utcTimeCorrected;           // Corrected UTC time
-  float         orbitAltitude;              // (cm) in GTOD coordinates system.
-  float         orbitLatitude;              // (rad) in GTOD coordinates system.
-  float         orbitLongitude;             // (rad) in GTOD coordinates system.
-  float         orbitLatitudeM;             // (rad) in eccentric dipole coordinate system.
-  float         orbitLongitudeM;            // (rad) in eccentric dipole coordinate system.
-  float         velR;                       // Speed of the ISS in radial direction
-  float         velTheta;                   // Angular speed of the ISS in polar angle direction
-  float         velPhi;                     // Angular speed of the ISS in azimuthal angle direction
-  float         yaw;                        // A parameter describing ISS attitude (tilted angle with respect to the x-axis)
-  float         pitch;                      // A parameter describing ISS attitude (tilted angle with respect to the y-axis)
-  float         roll;                       // A parameter describing ISS attitude (tilted angle with respect to the z-axis)
-  float         gLongitude;                 // Galactic longitude of the incoming particle.
-  float         gLatitude;                  // Galactic latitude of the incoming particle.
-  int           gCoordCalcResult;           // Return value for galactic coordinate calculation.
-  float         sunPosAzimuth;              // Azimuthal angle of the position of the Sun.
-  float         sunPosElevation;            // Elevation angle of the position of the Sun.
-  int           sunPosCalcResult;           // Return value for the Sun's position calculation.
-  unsigned int  unixTime;                   // UNIX time
-  int           isInShadow;                 // Value for check whether the AMS is in ISS solar panel shadow or not.
-  unsigned int  ptlCharge;                  // ParticleR::Charge value
-  float         ptlMomentum;                // ParticleR::Momentum value
-  float         ptlTheta;                   // Direction of the incoming particle (polar angle)
-  float         ptlPhi;                     // Direction of the incoming particle (azimuthal angle)
-  float         ptlCoo[3];
-  float         ptlCutOffStoermer;
-  float         ptlCutOffDipole;
-  float         ptlCutOffMax[2];
-  float         showerEnergyD;
-  float         showerEnergyE;
-  float         showerBDT;
-  float         showerCofG[3];
-  float         showerCofGDist;
-  float         showerCofGdX;
-  float         showerCofGdY;
-  int           tofNClusters;
-  int           tofNUsedHits;
-  float         tofBeta;
-  int           isGoodBeta;
-  int           isTkTofMatch;
-  float         tofReducedChisqT;
-  float         tofReducedChisqC;
-  float         tofDepositedEnergyOnLayer[4];
-  float         tofEstimatedChargeOnLayer[4];
-  float         tofCharge;
-  int           trkFitCodeMS;
-  float         trkRigidityMS;
-  float         trkReducedChisquareMS;
-  int           trkFitCodeFS;
-  float         trkRigidityFS;
-  float         trkReducedChisquareFS;
-  int           trkFitCodeInner;
-  float         trkRigidityInner;
-  float         trkReducedChisquareInner;
-  int           trkEdepLayerJXSideOK[9];
-  int           trkEdepLayerJYSideOK[9];
-  float         trkEdepLayerJ[9];
-  float         trkCharge;
-  float         trkInnerCharge;
-  int           richRebuild;
-  int           richIsGood;
-  int           richIsClean;
-  int           richIsNaF;
-  float         richRingWidth;
-  int           richNHits;
-  float         richBeta;
-  float         richBetaError;
-  float         richChargeSquared;
-  float         richKolmogorovProbability;
-  float         richTheta;
-  float         richPhi;
-  int           trdNClusters;
-  int           trdNTracks;
-  float         trdTrackPhi;
-  float         trdTrackTheta;
-  float         trdTrackChi2;
-  int           trdTrackPattern;
-  float         trdTrackCharge;
-  float         trdDepositedEnergyOnLayer[20];
-  int           trdQtNActiveLayer;
-  int           trdQtIsValid;
-  float         trdQtElectronToProtonLogLikelihoodRatio;
-  float         trdQtHeliumToProtonLogLikelihoodRatio;
-  float         trdQtElectronToHeliumLogLikelihoodRatio;
-  int           trdKNRawHits;
-  int           trdKIsReadAlignmentOK;
-  int           trdKIsReadCalibOK;
-  int           trdKNHits;
-  int           trdKIsValid;
-  float         trdKElectronToProtonLogLikelihoodRatio;
-  float         trdKHeliumToProtonLogLikelihoodRatio;
-  float         trdKElectronToHeliumLogLikelihoodRatio;
-  float         trdKCharge;
-  float         trdKChargeError;
-  int           trdKNUsedHitsForCharge;
-  float         trdKAmpLayer[20];
-  float         trdKTotalPathLength;
-  float         trdKElectronLikelihood;
-  float         trdKProtonLikelihood;
-  float         trdKHeliumLikelihood;
-  /*}}}*/
-
-  // Declare event counter
-  TH1D* hEvtCounter = new TH1D("hEvtCounter", "Event Collecting Status", nCuts, 0., (float)nCuts);
-  hEvtCounter->GetXaxis()->SetBinLabel(1, "Science-run check");
-  hEvtCounter->GetXaxis()->SetBinLabel(2, "DAQ H/W status check");
-  hEvtCounter->GetXaxis()->SetBinLabel(3, "Unbiased physics trigger check");
-  hEvtCounter->GetXaxis()->SetBinLabel(4, "Multiple particles");
-  hEvtCounter->GetXaxis()->SetBinLabel(5, "Tracker alignment test");
-  hEvtCounter->GetXaxis()->SetBinLabel(6, "Good track test");
-  hEvtCounter->GetXaxis()->SetBinLabel(7, "SAA rejection");
-
-  // Make a TFile and TTree
-  TFile* resultFile = new TFile(outputFileName, "RECREATE");
-  TTree* tree  = new TTree(softwareName, releaseName);
-
-  // Assign branches
-  tree->Branch("nRun", &nRun, "nRun/i");/*{{{*/
-  tree->Branch("nEvent", &nEvent, "nEvent/i");
-  tree->Branch("nProcessedNumber", &nProcessedNumber, "nProcessedNumber/i");
-  tree->Branch("nLevel1", &nLevel1, "nLevel1/i");
-  tree->Branch("nParticle", &nParticle, "nParticle/i");
-  tree->Branch("nCharge", &nCharge, "nCharge/i");
-  tree->Branch("nTrTrack", &nTrTrack, "nTrTrack/i");
-  tree->Branch("nTrdTrack", &nTrdTrack, "nTrdTrack/i");
-  tree->Branch("nAntiCluster", &nAntiCluster, "nAntiCluster/i");
-  tree->Branch("nTofClustersInTime", &nTofClustersInTime, "nTofClustersInTime/I");
-  tree->Branch("nRichRing", &nRichRing, "nRichRing/i");
-  tree->Branch("nRichRingB", &nRichRingB, "nRichRingB/i");
-  tree->Branch("nBeta", &nBeta, "nBeta/i");
-  tree->Branch("nBetaB", &nBetaB, "nBetaB/i");
-  tree->Branch("nBetaH", &nBetaH, "nBetaH/i");
-  tree->Branch("nShower", &nShower, "nShower/i");
-  tree->Branch("nVertex", &nVertex, "nVertex/i");
-  tree->Branch("particleType", &particleType, "particleType/i");
-  tree->Branch("livetime", &livetime, "livetime/F");
-  tree->Branch("utcTime", &utcTime, "utcTime/F");
-  tree->Branch("utcTimeCorrected", &utcTimeCorrected, "utcTimeCorrected/F");
-  tree->Branch("orbitAltitude", &orbitAltitude, "orbitAltitude/F");
-  tree->Branch("orbitLatitude", &orbitLatitude, "orbitLatitude/F");
-  tree->Branch("orbitLongitude", &orbitLongitude, "orbitLongitude/F");
-  tree->Branch("orbitLatitudeM", &orbitLatitudeM, "orbitLatitudeM/F");
-  tree->Branch("orbitLongitudeM", &orbitLongitudeM, "orbitLongitudeM/F");
-  tree->Branch("velR", &velR, "velR/F");
-  tree->Branch("velTheta", &velTheta, "velTheta/F");
-  tree->Branch("velPhi", &velPhi, "velPhi/F");
-  tree->Branch("yaw", &yaw, "yaw/F");
-  tree->Branch("pitch", &pitch, "pitch/F");
-  tree->Branch("roll", &roll, "roll/F");
-  tree->Branch("gLongitude", &gLongitude, "gLongitude/F");
-  tree->Branch("gLatitude", &gLatitude, "gLatitude/F");
-  tree->Branch("gCoordCalcResult", &gCoordCalcResult, "gCoordCalcResult/I");
-  tree->Branch("sunPosAzimuth", &sunPosAzimuth, "sunPosAzimuth/F");
-  tree->Branch("sunPosElevation", &sunPosElevation, "sunPosElevation/F");
-  tree->Branch("sunPosCalcResult", &sunPosCalcResult, "sunPosCalcResult/I");
-  tree->Branch("unixTime", &unixTime, "unixTime/i");
-  tree->Branch("isInShadow", &isInShadow, "isInShadow/I");
-  tree->Branch("ptlCharge", &ptlCharge, "ptlCharge/i");
-  tree->Branch("ptlMomentum", &ptlMomentum, "ptlMomentum/F");
-  tree->Branch("ptlTheta", &ptlTheta, "ptlTheta/F");
-  tree->Branch("ptlPhi", &ptlPhi, "ptlPhi/F");
-  tree->Branch("ptlCoo", &ptlCoo, "ptlCoo[3]/F");
-  tree->Branch("ptlCutOffStoermer", &ptlCutOffStoermer, "ptlCutOffStoermer/F");
-  tree->Branch("ptlCutOffDipole", &ptlCutOffDipole, "ptlCutOffDipole/F");
-  tree->Branch("ptlCutOffMax", &ptlCutOffMax, "ptlCutOffMax[2]/F");
-  tree->Branch("showerEnergyD", &showerEnergyD, "showerEnergyD/F");
-  tree->Branch("showerEnergyE", &showerEnergyE, "showerEnergyE/F");
-  tree->Branch("showerBDT", &showerBDT, "showerBDT/F");
-  tree->Branch("showerCofG", &showerCofG, "showerCofG[3]/F");
-  tree->Branch("showerCofGDist", &showerCofGDist, "showerCofGDist/F");
-  tree->Branch("showerCofGdX", &showerCofGdX, "showerCofGdX/F");
-  tree->Branch("showerCofGdY", &showerCofGdY, "showerCofGdY/F");
-  tree->Branch("tofNClusters", &tofNClusters, "tofNClusters/I");
-  tree->Branch("tofNUsedHits", &tofNUsedHits, "tofNUsedHits/I");
-  tree->Branch("tofBeta", &tofBeta, "tofBeta/F");
-  tree->Branch("isGoodBeta", &isGoodBeta, "isGoodBeta/I");
-  tree->Branch("isTkTofMatch", &isTkTofMatch, "isTkTofMatch/I");
-  tree->Branch("tofReducedChisqT", &tofReducedChisqT, "tofReducedChisqT/F");
-  tree->Branch("tofReducedChisqC", &tofReducedChisqC, "tofReducedChisqC/F");
-  tree->Branch("tofDepositedEnergyOnLayer", &tofDepositedEnergyOnLayer, "tofDepositedEnergyOnLayer[4]/F");
-  tree->Branch("tofEstimatedChargeOnLayer", &tofEstimatedChargeOnLayer, "tofEstimatedChargeOnLayer[4]/F");
-  tree->Branch("tofCharge", &tofCharge, "tofCharge/F");
-  tree->Branch("trkFitCodeMS", &trkFitCodeMS, "trkFitCodeMS/I");
-  tree->Branch("trkRigidityMS", &trkRigidityMS, "trkRigidityMS/F");
-  tree->Branch("trkReducedChisquareMS", &trkReducedChisquareMS, "trkReducedChisquareMS/F");
-  tree->Branch("trkFitCodeFS", &trkFitCodeFS, "trkFitCodeFS/I");
-  tree->Branch("trkRigidityFS", &trkRigidityFS, "trkRigidityFS/F");
-  tree->Branch("trkReducedChisquareFS", &trkReducedChisquareFS, "trkReducedChisquareFS/F");
-  tree->Branch("trkFitCodeInner", &trkFitCodeInner, "trkFitCodeInner/I");
-  tree->Branch("trkRigidityInner", &trkRigidityInner, "trkRigidityInner/F");
-  tree->Branch("trkReducedChisquareInner", &trkReducedChisquareInner, "trkReducedChisquareInner/F");
-  tree->Branch("trkEdepLayerJXSideOK", &trkEdepLayerJXSideOK, "trkEdepLayerJXSideOK[9]/I");
-  tree->Branch("trkEdepLayerJYSideOK", &trkEdepLayerJYSideOK, "trkEdepLayerJYSideOK[9]/I");
-  tree->Branch("trkEdepLayerJ", &trkEdepLayerJ, "trkEdepLayerJ[9]/F");
-  tree->Branch("trkCharge", &trkCharge, "trkCharge/F");
-  tree->Branch("trkInnerCharge", &trkInnerCharge, "trkInnerCharge/F");
-  tree->Branch("richRebuild", &richRebuild, "richRebuild/I");
-  tree->Branch("richIsGood", &richIsGood, "richIsGood/I");
-  tree->Branch("richIsClean", &richIsClean, "richIsClean/I");
-  tree->Branch("richIsNaF", &richIsNaF, "richIsNaF/I");
-  tree->Branch("richRingWidth", &richRingWidth, "richRingWidth/F");
-  tree->Branch("richNHits", &richNHits, "richNHits/I");
-  tree->Branch("richBeta", &richBeta, "richBeta/F");
-  tree->Branch("richBetaError", &richBetaError, "richBetaError/F");
-  tree->Branch("richChargeSquared", &richChargeSquared, "richChargeSquared/F");
-  tree->Branch("richKolmogorovProbability", &richKolmogorovProbability, "richKolmogorovProbability/F");
-  tree->Branch("richTheta", &richTheta, "richTheta/F");
-  tree->Branch("richPhi", &richPhi, "richPhi/F");
-  tree->Branch("trdNCluster", &trdNCluster, "trdNCluster/I");
-  tree->Branch("trdNTracks", &trdNTracks, "trdNTracks/I");
-  tree->Branch("trdTrackTheta", &trdTrackTheta, "trdTrackTheta/F");
-  tree->Branch("trdTrackPhi", &trdTrackPhi, "trdTrackPhi/F");
-  tree->Branch("trdTrackChi2", &trdTrackChi2, "trdTrackChi2/F");
-  tree->Branch("trdTrackPattern", &trdTrackPattern, "trdTrackPattern/I");
-  tree->Branch("trdTrackCharge", &trdTrackCharge, "trdTrackCharge/F");
-  tree->Branch("trdDepositedEnergyOnLayer", &trdDepositedEnergyOnLayer, "trdDepositedEnergyOnLayer[2]/F");
-  tree->Branch("trdQtNActiveLayer", &trdQtNActiveLayer, "trdQtNActiveLayer/I");
-  tree->Branch("trdQtIsValid", &trdQtIsValid, "trdQtIsValid/I");
-  tree->Branch("trdQtElectronToProtonLogLikelihoodRatio", &trdQtElectronToProtonLogLikelihoodRatio, "trdQtElectronToProtonLogLikelihoodRatio/F");
-  tree->Branch("trdQtHeliumToProtonLogLikelihoodRatio", &trdQtHeliumToProtonLogLikelihoodRatio, "trdQtHeliumToProtonLogLikelihoodRatio/F");
-  tree->Branch("trdQtElectronToHeliumLogLikelihoodRatio", &trdQtElectronToHeliumLogLikelihoodRatio, "trdQtElectronToHeliumLogLikelihoodRatio/F");
-  tree->Branch("trdKNRawHits", &trdKNRawHits, "trdKNRawHits/I");
-  tree->Branch("trdKIsReadAlignmentOK", &trdKIsReadAlignmentOK, "trdKIsReadAlignmentOK/I");
-  tree->Branch("trdKIsReadCalibOK", &trdKIsReadCalibOK, "trdKIsReadCalibOK/I");
-  tree->Branch("trdKNHits", &trdKNHits, "trdKNHits/I");
-  tree->Branch("trdKIsValid", &trdKIsValid, "trdKIsValid/I");
-  tree->Branch("trdKElectronToProtonLogLikelihoodRatio", &trdKElectronToProtonLogLikelihoodRatio, "trdKElectronToProtonLogLikelihoodRatio/F");
-  tree->Branch("trdKHeliumToProtonLogLikelihoodRatio", &trdKHeliumToProtonLogLikelihoodRatio, "trdKHeliumToProtonLogLikelihoodRatio/F");
-  tree->Branch("trdKElectronToHeliumLogLikelihoodRatio", &trdKElectronToHeliumLogLikelihoodRatio, "trdKElectronToHeliumLogLikelihoodRatio/F");
-  tree->Branch("trdKCharge", &trdKCharge, "trdCharge/F");
-  tree->Branch("trdKChargeError", &trdKChargeError, "trdKChargeError/F");
-  tree->Branch("trdKNUsedHitsForCharge", &trdKNUsedHitsForCharge, "trdKNUsedHitsForCharge/F");
-  tree->Branch("trdKAmpLayer", &trdKAmpLayer, "trdKAmpLayer[20]/F");
-  tree->Branch("trdKTotalPathLength", &trdKTotalPathLength, "trdKTotalPathLength/F");
-  tree->Branch("trdKElectronLikelihood", &trdKElectronLikelihood, "trdKElectronLikelihood/F");
-  tree->Branch("trdKProtonLikelihood", &trdKProtonLikelihood, "trdKProtonLikelihood/F");
-  tree->Branch("trdKHeliumLikelihood", &trdKHeliumLikelihood, "trdKHeliumLikelihood/F");
-  /*}}}*/
+  // Variable declaration. The variables stored in the tree are the members of EventRecord (record.h).
+  unsigned int  nProcessed = 0;             // Number of stored candidates (a candidate may go to several selections)
+
+  // Selections. Without --selections the single-particle cut chain of the program is the only selection and
+  // its cut flow is hEvtCounter of <output file>. With --selections every named selection writes its own tree
+  // and hEvtCounter to <output base>_<name>.root, while the input is read only once.
+  TH1::AddDirectory(kFALSE);
+  SelectionSet selections;
+  if( options.selectionFile[0] == '\0' ) selections.AddDefault();
+  else if( !selections.Load(options.selectionFile) ) return -1;
+  selections.Book();
+  selections.SetWeight(sampleWeight);
+
+  // User expressions. Their variables become columns of every output, so they are compiled before the sinks book
+  // the columns. Their cuts apply to the candidates of every selection, and every selection keeps the cut flow of
+  // the expression cuts of its own candidates (hExpressionCutFlow of its output).
+  ExpressionSet expressions;
+  if( options.expressionFile[0] != '\0' && ( !expressions.Load(options.expressionFile) || !expressions.Compile() ) ) return -1;
+  expressions.Book(selections.GetSize());
+  expressions.SetWeight(sampleWeight);
+
+  // Classifiers. Their output columns are booked with the others. The accepted candidates wait in a batch
+  // and the models are evaluated once per batch, before the records are handed over to the writers.
+  ClassifierSet classifiers(options.classifierBatchSize);
+  if( options.classifierFile[0] != '\0' && !classifiers.Load(options.classifierFile) ) return -1;
+
+  // The output stage. The writer thread owns the TFile and TTree and does Fill/compression/IO
+  // while the event loop goes on with the next events. Every selection has its own sink and writer.
+  // With --partition the records of every nRun go to their own file or basket cluster.
+  // With --backend=columnar the same columns are written as uncompressed memory-mappable arrays instead.
+  // With --backend=rntuple the records are written as an RNTuple, optionally by several writer threads.
+  for(unsigned int s = 0; s < selections.GetSize(); s++)
+  {
+    Selection* selection = selections.GetSelection(s);
+
+    char selectionOutputName[512];
+    if( options.selectionFile[0] == '\0' ) strcpy(selectionOutputName, outputFileName);
+    else sprintf(selectionOutputName, "%s_%s.root", GetOutputBaseName(outputFileName).c_str(), selection->name.c_str());
+
+    OutputSink* sink = NULL;
+    if( options.outputBackend == kBackendColumnar ) sink = new ColumnarSink(selectionOutputName);
+    else if( options.outputBackend == kBackendNTuple ) sink = new NTupleSink(selectionOutputName, softwareName, options.writerThreads, options.ntupleCompression, options.ntuplePageSize);
+    else if( options.partitionMode == kPartitionNone ) sink = new TreeSink(selectionOutputName, softwareName, releaseName);
+    else sink = new PartitionedTreeSink(options.partitionMode, selectionOutputName, softwareName, releaseName);
+
+    selection->sink   = sink;
+    selection->writer = new RecordWriter(sink, options.writerQueueSize, options.writerQueueLimit, options.writerBackpressure, options.writerThreads);
+    if( !selection->writer->Start() ) return -1;
+    selection->writer->AddObject(selection->hCutFlow);
+    if( expressions.GetCutFlow(s) ) selection->writer->AddObject(expressions.GetCutFlow(s));
+  }
+
+  bool          partitioned = ( options.partitionMode != kPartitionNone );
+  bool          inRun       = false;        // A run has been started
+  bool          runChecked  = false;        // The bad-run check was made for checkedRun
+  unsigned int  checkedRun  = 0;
+  unsigned int  currentRun  = 0;            // Run number of the previous event
 
   /**************************************************************************************************************************
    *
@@ -439,20 +368,119 @@ int main(int argc, char* argv[])
 
   unsigned int nProcessCheck = 10000;
 
-  for(unsigned int e = 0; e < nEntries; e++)
+  // Wall time of every stage of every event : read, cuts, acsoft, fill and write.
+  LatencyMonitor latency(options.nSlowEvents);
+
+  // Progress reports for the monitoring of long jobs (--telemetry, --telemetry-prom).
+  Telemetry telemetry(options.telemetryFile, options.telemetryPromFile, options.telemetryInterval, (long)options.telemetryMaxSize * 1024 * 1024);
+  for(unsigned int s = 0; s < selections.GetSize(); s++) telemetry.AddWriter(selections.GetSelection(s)->writer);
+  telemetry.Begin(nEntries);
+
+  long long     nDone             = 0;      // Number of entries taken by the loop
+  long long     nAcceptedEvents   = 0;      // Number of entries with at least one stored candidate
+  unsigned int  nProcessedAtEvent = 0;      // nProcessed at the beginning of the previous entry
+
+  // With --block-cuts the header and trigger bit cuts are evaluated for blocks of entries before the events are read.
+  // With --header-index they are taken from the index, so the rejected events are not read at all.
+  BlockCuts     blockCuts(options.blockCutSize);
+  signed char   blockResults[kNEventCuts];
+  HeaderIndex   headerIndex;
+  if( options.headerIndexFile[0] != '\0' )
   {
+    if( !headerIndex.Open(options.headerIndexFile, amsChain) ) return -1;
+    blockCuts.SetHeaderIndex(&headerIndex);
+  }
+
+  // With --stream-files at most K input files are open and every finished file is released (filestream.h).
+  FileStream    fileStream(options.streamFiles);
+  fileStream.Begin(amsChain, entryList);
+
+  for(unsigned int i = 0; i < nEntries; i++)
+  {
+    Long64_t e = entryList.empty() ? (Long64_t)i : entryList[i];   // Entry of the chain
+
+    if( i % nProcessCheck == 0 || i == nEntries - 1 )
+      cout << "[" << releaseName << "] Processed " << i << " out of " << nEntries << " (" << (float)i/nEntries*100. << "%)" << endl;
+
+    if( nProcessed != nProcessedAtEvent ) nAcceptedEvents++;
+    nProcessedAtEvent = nProcessed;
+    telemetry.Update(nDone, nAcceptedEvents, &amsChain);
+    nDone++;
+
+    // Only the entries which are read are timed. The block loads (timed by BlockCuts) and the entries rejected
+    // by the block cuts are kept out of the event latency.
+    latency.EndEvent();
+
     AMSEventR* pev = NULL;
-    pev = amsChain.GetEvent(e);
+    unsigned int run;
+    if( blockCuts.IsEnabled() )
+    {
+      if( !blockCuts.Contains(i) ) blockCuts.Load(amsChain, entryList, i, nEntries, selections);
+      run = blockCuts.GetRun(i);
+    }
+    else
+    {
+      latency.BeginEvent(e);
+      pev = amsChain.GetEvent(e);
+      run = pev->Run();
+      latency.SetEventId(run, pev->Event());
+      fileStream.Update(amsChain);
+      latency.Mark(kStageRead);
+    }
 
-    // Basic cut processes
-    if( IsBadRun(pev) )/*{{{*/
+    // Run boundary : the counter of the finished run is handed over to the writer behind its records.
+    if( partitioned && ( !inRun || run != currentRun ) )
+    {
+      latency.Suspend();
+      classifiers.Flush(selections);
+      latency.Resume();
+      for(unsigned int s = 0; s < selections.GetSize(); s++)
+      {
+        Selection* selection = selections.GetSelection(s);
+        if( selection->hRunStart )
+        {
+          selection->writer->CommitRunEnd(currentRun, MakeRunCounter(selection->hCutFlow, selection->hRunStart));
+          delete selection->hRunStart;
+        }
+        selection->hRunStart = (TH1D*)selection->hCutFlow->Clone("hRunStart");
+      }
+      currentRun = run;
+      inRun      = true;
+    }
+
+    // Entries rejected by the block cuts are only counted in the cut flows. The others are read now.
+    // The bad-run check comes before the cuts, so the first entry of a run is read for it even when it is rejected.
+    if( blockCuts.IsEnabled() )
+    {
+      if( !blockCuts.IsSurvivor(i) )
+      {
+        if( !runChecked || run != checkedRun )
+        {
+          pev = amsChain.GetEvent(e);
+          fileStream.Update(amsChain);
+          runChecked = true;
+          checkedRun = run;
+          if( IsBadRun(pev) ) break;
+        }
+        selections.RejectEarly(blockCuts.GetRejection(i));
+        continue;
+      }
+      blockCuts.GetResults(i, blockResults);
+      latency.BeginEvent(e);
+      pev = amsChain.GetEvent(e);
+      latency.SetEventId(run, pev->Event());
+      fileStream.Update(amsChain);
+      latency.Mark(kStageRead);
+    }
+
+    // Basic cut processes. The cut chains belong to the selections (selection.h). The cuts shared by every
+    // selection are evaluated once, and every event-level cut at most once per event.
+    if( IsBadRun(pev) )
       break;
-    if( !IsScienceRun(pev) ) continue;
-    hEvtCounter->Fill(0);
-    if( !IsHardwareStatusGood(pev) ) continue;
-    hEvtCounter->Fill(1);
-    if( IsUnbiasedPhysicsTriggerEvent(pev) ) continue;
-    hEvtCounter->Fill(2);
+    runChecked = true;
+    checkedRun = run;
+    if( !selections.BeginEvent(pev, blockCuts.IsEnabled() ? blockResults : NULL) ) continue;
+
     // Here we need to think about how to select a good particle among several particles.
     // In the study of deuteron flux, a particle need to be defined by the following several variables.
     //
@@ -461,246 +489,376 @@ int main(int argc, char* argv[])
     //
     // To measure particle momentum correctly, track should be measured correctly.
     //
-    // 04-02-15 : Currently, just use single particle case.
-    if( pev->nParticle() != 1 ) continue;
-    hEvtCounter->Fill(3);
-    if( !IsTrkAlignmentGood(pev) ) continue;
-    hEvtCounter->Fill(4);
-    if( !IsGoodTrTrack(pev) ) continue;
-    hEvtCounter->Fill(5);
-    if( pev->IsInSAA() ) continue;
-    hEvtCounter->Fill(6);/*}}}*/
-
-    // ACSoft related lines
-    particleFactory.SetAMSTrTrackR(trktrack);
-    if( !amsRootSupport.SwitchToSpecificTrackFitById(id_maxspan) ) continue;
-    Analysis::Event& event = amsRootSupport.BuildEvent(ams, pev);
-
-    // Only do this if you need access to TRD segments/tracks and vertices
-    eventFactory.PerformTrdTracking(event);
-    eventFactory.PerformTrdVertexFinding(event);
-
-    // If you want to use TrdQt, you should always add Analysis::CreateSplineTrack, so it can use the
-    // Tracker track extrapolation to pick up the TRD hits in the tubes and calculate the path length
-    // and also Analysis::FillTrdQt so that the likelihoods are calculated.
-    // Additionally you shold pass Analysis::CreateTrdTrack if you want to examinge the TRD tracks
-    // found by the previous PerformTrdTracking() call, via the Analysis::Particle interface.
-
-    int productionSteps = 0;
-    productionSteps |= Analysis::CreateSplineTrack;
-    productionSteps |= Analysis::CreateTrdTrack;
-    productionSteps |= Analysis::FillTrdQt;
-    eventFactory.FillParticles(event, productionSteps);
-
-    const Analysis::Particle* particle = event.PrimaryParticle();
-    assert(particle);
-
-    // Save data
-    nRun            = pev->Run();
-    nEvent          = pev->Event();
-    nLevel1         = pev->nLevel1();
-    nParticle       = pev->nParticle();
-    nCharge         = pev->nCharge();
-    nTrTrack        = pev->nTrTrack();
-    nTrdTrack       = pev->nTrdTrack();
-    nAntiCluster    = pev->nAntiCluster();
-    nRichRing       = pev->nRichRing();
-    nRichRingB      = pev->nRichRingB();
-    nBeta           = pev->nBeta();
-    nBetaB          = pev->nBetaB();
-    nBetaH          = pev->nBetaH();
-    nShower         = pev->nEcalShower();
-    nVertex         = pev->nVertex();
-    livetime        = pev->LiveTime();
-    utcTime         = header->UTCTime(0);
-    utcTimeError    = header->UTCTime(1);
-    orbitAltitude   = header->RadS;
-    orbitLatitude   = header->ThetaS;
-    orbitLongitude  = header->PhiS;
-    orbitLatitudeM  = header->ThetaM;
-    orbitLongitudeM = header->PhiM;
-    velR            = header->VelocityS;
-    velTheta        = header->VelTheta;
-    velPhi          = header->VelPhi;
-    yaw             = header->Yaw;
-    pitch           = header->Pitch;
-    roll            = header->Roll;
-
-    ParticleR* pParticle = pev->pParticle(0);
-    ptlCharge       = (unsigned int)pParticle->Charge;
-    ptlMomentum     = pParticle->Momentum;
-    ptlTheta        = pParticle->Theta;
-    ptlPhi          = pParticle->Phi;
-
-    BetaHR* pBeta = pParticle->pBetaH();
-    tofBeta = pBeta->GetBeta();
-    if( pBeta->IsGoodBeta() == true ) isGoodBeta = 1;
-    else isGoodBeta = 0;
-    if( pBeta->IsTkTofMatch() == true ) isTkTofMatch = 11;
-    else isTkTofMatch = 0;
-    tofReducedChisqT = pBeta->GetNormChi2T();
-    tofReducedChisqC = pBeta->GetNormChi2C();
-
-    int ncls[4] = {0, 0, 0, 0};
-    nTofClustersInTime = pev->GetNTofClustersInTime(pBeta, ncls);
-
-    TrTrackR* pTrTrack = pParticle->pTrTrack();
-    int id_maxspan     = pTrTrack->iTrTrackPar(1, 0, 0);
-    int id_inner       = pTrTrack->iTrTrackPar(1, 3, 0);
-    int id_fullspan    = pTrTrack->iTrTrackPar(1, 7, 0);
-
-    // Tracker variables from maximum span setting
-    trkFitCodeMS             = id_maxspan;
-    trkRigidityMS            = pTrTrack->GetRigidity(id_maxspan);
-    trkReducedChisquareMS    = pTrTrack->GetNormChisqX(id_maxspan);
-
-    // Tracker variables from full span setting
-    trkFitCodeFS             = id_fullspan;
-    trkRigidityFS            = pTrTrack->GetRigidity(id_fullspan);
-    trkReducedChisquareFS    = pTrTrack->GetNormChisqX(id_fullspan);
-
-    // Tracker variables from inner tracker only setting
-    trkFitCodeInner          = id_inner;
-    trkRigidityInner         = pTrTrack->GetRigidity(id_inner);
-    trkReducedChisquareInner = pTrTrack->GetNormChisqX(id_inner);
-
-    TrRecHitR* pTrRecHit = NULL;          // This should be ParticleR associated hit.
-    trkEdepLayerJ = 0;
-
-    for(int ilayer = 0; ilayer < 9; ilayer++)
-    {
-      pTrRecHit = pTrTrack->GetHitLJ(ilayer);
-      if(pTrTrack->GetEdep(0) != 0) trkEdepLayerJXSideOK[ilayer] = 1;
-      else trkEdepLayerJXSideOK[ilayer] = 0;
-      if(pTrTrack->GetEdep(1) != 0) trkEdepLayerJYSideOK[ilayer] = 1;
-      else trkEdepLayerJYSideOK[ilayer] = 0;
-      trkEdepLayerJ += pTrTrack->GetEdep(0) + pTrTrack->GetEdep(1);
-    }
-    trkCharge = pTrTrack->GetQ();
-    trkInnerCharge = pTrTrack->GetInnerQ();
+    // A selection takes either the first particle (with the single-particle cut, the former behaviour)
+    // or every particle of the event. The particle-level cuts are evaluated per candidate.
+    int nCandidates = selections.GetNCandidates();
+    latency.Mark(kStageCuts);
 
-    RichRingR* richRing = pParticle->pRichRing();
-    if(!richRing)
-    {
-      richRebuild               = -1;
-      richIsGood                = -1;
-      richIsClean               = -1;
-      richIsNaF                 = -1;
-      richRingWidth             = -1;
-      richNHits                 = -1;
-      richBeta                  = -1;
-      richBetaError             = -1;
-      richChargeSquared         = -1;
-      richKolmogorovProbability = -1;
-      richTheta                 = -9;
-      richPhi                   = -9;
-    }
-    else
-    {
-      richRebuild   = (int)richRing->Rebuild();
-      richIsGood    = (int)richRing->IsGood();
-      richIsClean   = (int)richRing->IsClean();
-      richIsNaF     = (int)richRing->IsNaF();
-      richRingWidth = (float)richRing->RingWidth();
-      richNHits     = richRing->getHits();
-      richBeta      = richRing->getBeta();
-      richBetaError = richRing->GetBetaError();
-      richChargeSquared = richRing->getCharge2Estimate();
-      richKolmogorovProbability = richring->getProb();
-      richTheta = richRing->GetTrackTheta();
-      richPhi = richRing->GetTrackPhi();
-    }
+    // The Analysis::Event is built once per event, at the first accepted candidate, and shared by every candidate.
+    Analysis::Event* event      = NULL;
+    bool             eventBuilt = false;
 
-    TrdTrackR* trdTrack = pParticle->pTrdTrack();
-    trdNCluster = pev->nTrdCluster();
-    trdNTracks  = pev->nTrdTrack();
-    if(!trdTrack)
+    for(int iParticle = 0; iParticle < nCandidates; iParticle++)
     {
-      trdTrackTheta     = -9.;
-      trdTrackPhi       = -9.;
-      trdTrackPattern   = -9;
-      trdTrackCharge    = -9;
-      trdTrackEdep      = -9.;
-    }
-    else
-    {
-      trdTrackTheta = trdTrack->Theta;
-      trdTrackPhi   = trdTrack->Phi;
-      trdTrackPattern = trdTrack->Pattern;
-      trdTrackCharge  = trdTrack->Q;
-      trdTrackMeanDepositedEnergy = 0.;
-      for(int i = 0; i < trdTrack->NTrdSegment(); i++)
+      if( !selections.SelectParticle(iParticle) )
       {
-        for(int j = 0; j < trdTrack->pTrdSegment(i)->NTrdCluster(); j++)
+        latency.Mark(kStageCuts);
+        continue;
+      }
+      latency.Mark(kStageCuts);
+
+      // An accepted particle always has a track and a beta (SelectionSet::SelectParticle()).
+      ParticleR* pParticle = pev->pParticle(iParticle);
+
+      // ACSoft related lines
+      // The Analysis::Event is owned by amsRootSupport and refilled for every event. The TRD hit and vertex lists
+      // below are bound by const reference, so that this loop makes no per-event copies of them.
+      // The heap allocations of this stage are reported by the latency monitor (HEAP ALLOCATIONS / EVENT, COUNT_ALLOCATIONS=1 build).
+      // The event is built with the maximum span fit of the first accepted candidate.
+      if( !eventBuilt )
+      {
+        eventBuilt = true;
+        TrTrackR* trktrack   = pParticle->pTrTrack();
+        int       id_maxspan = trktrack->iTrTrackPar(1, 0, 0);
+        particleFactory.SetAMSTrTrackR(trktrack);
+        if( amsRootSupport.SwitchToSpecificTrackFitById(id_maxspan) )
         {
-          trdTrackTotalDepositedEnergy += trdTrack->pTrdSegment(i)->pTrdCluster(j)->EDep;
+          event = &amsRootSupport.BuildEvent(ams, pev);
+
+          // Only do this if you need access to TRD segments/tracks and vertices
+          eventFactory.PerformTrdTracking(*event);
+          eventFactory.PerformTrdVertexFinding(*event);
+
+          // If you want to use TrdQt, you should always add Analysis::CreateSplineTrack, so it can use the
+          // Tracker track extrapolation to pick up the TRD hits in the tubes and calculate the path length
+          // and also Analysis::FillTrdQt so that the likelihoods are calculated.
+          // Additionally you shold pass Analysis::CreateTrdTrack if you want to examinge the TRD tracks
+          // found by the previous PerformTrdTracking() call, via the Analysis::Particle interface.
+
+          int productionSteps = 0;
+          productionSteps |= Analysis::CreateSplineTrack;
+          productionSteps |= Analysis::CreateTrdTrack;
+          productionSteps |= Analysis::FillTrdQt;
+          eventFactory.FillParticles(*event, productionSteps);
         }
       }
-    }
+      if( !event ) continue;
+
+      // The TRD quantities of the record belong to the candidate, not to the primary particle of the event.
+      const Analysis::Particle* particle = FindAnalysisParticle(*event, pParticle);
+      if( !particle ) continue;
+      latency.Mark(kStageACSoft);
+
+      // Save data
+      EventRecord  record;
+      EventRecord* rec = &record;
+      ResetRecord(rec);
+
+      rec->nRun            = pev->Run();
+      rec->nEvent          = pev->Event();
+      rec->nLevel1         = pev->nLevel1();
+      rec->nParticle       = pev->nParticle();
+      rec->iParticle       = iParticle;
+      rec->nCharge         = pev->nCharge();
+      rec->nTrTrack        = pev->nTrTrack();
+      rec->nTrdTrack       = pev->nTrdTrack();
+      rec->nAntiCluster    = pev->nAntiCluster();
+      rec->nRichRing       = pev->nRichRing();
+      rec->nRichRingB      = pev->nRichRingB();
+      rec->nBeta           = pev->nBeta();
+      rec->nBetaB          = pev->nBetaB();
+      rec->nBetaH          = pev->nBetaH();
+      rec->nShower         = pev->nEcalShower();
+      rec->nVertex         = pev->nVertex();
+      rec->livetime        = pev->LiveTime();
+      rec->unixTime        = pev->UTime();
+      rec->weight          = sampleWeight;
+      rec->utcTime         = header->UTCTime(0);
+      utcTimeError    = header->UTCTime(1);
+      rec->orbitAltitude   = header->RadS;
+      rec->orbitLatitude   = header->ThetaS;
+      rec->orbitLongitude  = header->PhiS;
+      rec->orbitLatitudeM  = header->ThetaM;
+      rec->orbitLongitudeM = header->PhiM;
+      rec->velR            = header->VelocityS;
+      rec->velTheta        = header->VelTheta;
+      rec->velPhi          = header->VelPhi;
+      rec->yaw             = header->Yaw;
+      rec->pitch           = header->Pitch;
+      rec->roll            = header->Roll;
+
+      rec->ptlCharge       = (unsigned int)pParticle->Charge;
+      rec->ptlMomentum     = pParticle->Momentum;
+      rec->ptlTheta        = pParticle->Theta;
+      rec->ptlPhi          = pParticle->Phi;
+
+      BetaHR* pBeta = pParticle->pBetaH();
+      rec->tofBeta = pBeta->GetBeta();
+      if( pBeta->IsGoodBeta() == true ) rec->isGoodBeta = 1;
+      else rec->isGoodBeta = 0;
+      if( pBeta->IsTkTofMatch() == true ) rec->isTkTofMatch = 11;
+      else rec->isTkTofMatch = 0;
+      rec->tofReducedChisqT = pBeta->GetNormChi2T();
+      rec->tofReducedChisqC = pBeta->GetNormChi2C();
+
+      int ncls[4] = {0, 0, 0, 0};
+      rec->nTofClustersInTime = pev->GetNTofClustersInTime(pBeta, ncls);
+
+      TrTrackR* pTrTrack = pParticle->pTrTrack();
+      int id_maxspan     = pTrTrack->iTrTrackPar(1, 0, 0);
+      int id_inner       = pTrTrack->iTrTrackPar(1, 3, 0);
+      int id_fullspan    = pTrTrack->iTrTrackPar(1, 7, 0);
+
+      // Tracker variables from maximum span setting
+      rec->trkFitCodeMS             = id_maxspan;
+      rec->trkRigidityMS            = pTrTrack->GetRigidity(id_maxspan);
+      rec->trkReducedChisquareMS    = pTrTrack->GetNormChisqX(id_maxspan);
+
+      // Tracker variables from full span setting
+      rec->trkFitCodeFS             = id_fullspan;
+      rec->trkRigidityFS            = pTrTrack->GetRigidity(id_fullspan);
+      rec->trkReducedChisquareFS    = pTrTrack->GetNormChisqX(id_fullspan);
+
+      // Tracker variables from inner tracker only setting
+      rec->trkFitCodeInner          = id_inner;
+      rec->trkRigidityInner         = pTrTrack->GetRigidity(id_inner);
+      rec->trkReducedChisquareInner = pTrTrack->GetNormChisqX(id_inner);
+
+      // ECAL shower of the particle. The distance of the centre of gravity is measured from the maximum span track.
+      EcalShowerR* pShower = pParticle->pEcalShower();
+      if( !pShower )
+      {
+        rec->showerEnergyD  = -1.;
+        rec->showerEnergyE  = -1.;
+        rec->showerBDT      = -2.;
+        for(int i = 0; i < 3; i++) rec->showerCofG[i] = -999.;
+        rec->showerCofGDist = -1.;
+        rec->showerCofGdX   = -999.;
+        rec->showerCofGdY   = -999.;
+      }
+      else
+      {
+        rec->showerEnergyD  = pShower->EnergyD;
+        rec->showerEnergyE  = pShower->EnergyE;
+        rec->showerBDT      = -2.;          // Filled by the classifiers (--classifiers)
+        for(int i = 0; i < 3; i++) rec->showerCofG[i] = pShower->CofG[i];
+
+        AMSPoint trackPoint;
+        AMSDir   trackDir;
+        pTrTrack->Interpolate(pShower->CofG[2], trackPoint, trackDir, id_maxspan);
+        rec->showerCofGdX   = pShower->CofG[0] - trackPoint.x();
+        rec->showerCofGdY   = pShower->CofG[1] - trackPoint.y();
+        rec->showerCofGDist = sqrt(rec->showerCofGdX * rec->showerCofGdX + rec->showerCofGdY * rec->showerCofGdY);
+
+        // Shower shape : the inputs of the ECAL BDT (config/ecalbdt.classifiers). They stay 0 without a shower.
+        for(int i = 0; i < 3; i++) rec->showerEnergy3C[i] = pShower->Energy3C[i];
+        rec->showerS13R         = pShower->S13R;
+        rec->showerSideLeak     = pShower->SideLeak;
+        rec->showerRearLeak     = pShower->RearLeak;
+        rec->showerDifoSum      = pShower->DifoSum;
+        rec->showerChi2Profile  = pShower->Chi2Profile;
+        for(int i = 0; i < 4; i++) rec->showerParProfile[i] = pShower->ParProfile[i];
+        rec->showerChi2Trans    = pShower->Chi2Trans;
+        for(int i = 0; i < 3; i++) rec->showerSphericityEV[i] = pShower->SphericityEV[i];
+        rec->showerNHits        = pShower->Nhits;
+      }
 
-    const Analysis::TrdQt* trdQtFromTrackerTrack = particle->GetTrdQtInfo();
-    trdQtIsCalibrationGood = trdQtFromTrackerTrack->IsCalibrationGood();
-    trdQtIsSlowControlDataGood = trdQtFromTrackerTrack->IsSlowControlDataGood();
-    trdQtIsInsideTrdGeometricalAcceptance = kTRUE;
-    trdQtIsValid = 1;
-    trdQtActiveStraws = 1;
-    trdQtActiveLayers = 1;
-    trdQtElectronToProtonLogLikelihoodRatio = -1.;
-    trdQtHeliumToProtonLogLikelihoodRatio = -1.;
-    trdQtElectronToHeliumLogLikelihoodRatio = -1.;
+      TrRecHitR* pTrRecHit = NULL;          // This should be ParticleR associated hit.
+      rec->trkEdepLayerJ = 0;
 
-    const std::vector<Analysis::TrdHit>& TrdHit = trdQtFromTrackerTrack->GetAssignedHits();
+      for(int ilayer = 0; ilayer < 9; ilayer++)
+      {
+        pTrRecHit = pTrTrack->GetHitLJ(ilayer);
+        if(pTrTrack->GetEdep(0) != 0) rec->trkEdepLayerJXSideOK[ilayer] = 1;
+        else rec->trkEdepLayerJXSideOK[ilayer] = 0;
+        if(pTrTrack->GetEdep(1) != 0) rec->trkEdepLayerJYSideOK[ilayer] = 1;
+        else rec->trkEdepLayerJYSideOK[ilayer] = 0;
+        rec->trkEdepLayerJ += pTrTrack->GetEdep(0) + pTrTrack->GetEdep(1);
+      }
+      rec->trkCharge = pTrTrack->GetQ();
+      rec->trkInnerCharge = pTrTrack->GetInnerQ();
 
-    const std::vector<Analysis::TrdVertex>& verticesXZ = event.TrdVerticesXZ();
-    const std::vector<Analysis::TrdVertex>& verticesYZ = event.TrdVerticesYZ();
+      RichRingR* richRing = pParticle->pRichRing();
+      if(!richRing)
+      {
+        rec->richRebuild               = -1;
+        rec->richIsGood                = -1;
+        rec->richIsClean               = -1;
+        rec->richIsNaF                 = -1;
+        rec->richRingWidth             = -1;
+        rec->richNHits                 = -1;
+        rec->richBeta                  = -1;
+        rec->richBetaError             = -1;
+        rec->richChargeSquared         = -1;
+        rec->richKolmogorovProbability = -1;
+        rec->richTheta                 = -9;
+        rec->richPhi                   = -9;
+      }
+      else
+      {
+        rec->richRebuild   = (int)richRing->Rebuild();
+        rec->richIsGood    = (int)richRing->IsGood();
+        rec->richIsClean   = (int)richRing->IsClean();
+        rec->richIsNaF     = (int)richRing->IsNaF();
+        rec->richRingWidth = (float)richRing->RingWidth();
+        rec->richNHits     = richRing->getHits();
+        rec->richBeta      = richRing->getBeta();
+        rec->richBetaError = richRing->GetBetaError();
+        rec->richChargeSquared = richRing->getCharge2Estimate();
+        rec->richKolmogorovProbability = richring->getProb();
+        rec->richTheta = richRing->GetTrackTheta();
+        rec->richPhi = richRing->GetTrackPhi();
+      }
 
-    for( std::vector<Analysis::TrdVertex>::const_iterator xzIter = verticesXZ.begin(); xzIter != verticesXZ.end(); ++xzIter)
-    {
-      const Analysis::TrdVertex& xzVertex = *xzIter;
-      for( std::vector<Analysis::TrdVertex>::const_iterator yzIter = verticesYZ.begin(); yzIter != verticesYZ.end(); ++yzIter)
+      TrdTrackR* trdTrack = pParticle->pTrdTrack();
+      rec->trdNCluster = pev->nTrdCluster();
+      rec->trdNTracks  = pev->nTrdTrack();
+      if(!trdTrack)
       {
-        const Analysis::TrdVertex& yzVertex = *yzIter;
-        if( std::max(xzVertex.NumberOfSegments(), yzVertex.NumberOfSegments() ) < 3)
-          continue;
-        if( fabs(xzVertex.Z() - yzVertex.Z() ) < fabs(xzVertex.ErrorZ() + yzVertex.ErrorZ() ))
+        rec->trdTrackTheta     = -9.;
+        rec->trdTrackPhi       = -9.;
+        rec->trdTrackPattern   = -9;
+        rec->trdTrackCharge    = -9;
+        trdTrackEdep      = -9.;
+      }
+      else
+      {
+        rec->trdTrackTheta = trdTrack->Theta;
+        rec->trdTrackPhi   = trdTrack->Phi;
+        rec->trdTrackPattern = trdTrack->Pattern;
+        rec->trdTrackCharge  = trdTrack->Q;
+        trdTrackMeanDepositedEnergy = 0.;
+        for(int i = 0; i < trdTrack->NTrdSegment(); i++)
         {
-          trdQtNTRDVertex++;
+          for(int j = 0; j < trdTrack->pTrdSegment(i)->NTrdCluster(); j++)
+          {
+            trdTrackTotalDepositedEnergy += trdTrack->pTrdSegment(i)->pTrdCluster(j)->EDep;
+          }
         }
       }
-    }
 
-    trdQtElectronToProtonLogLikelihoodRatio = (float)particle->CalculateElectronProtonLikelihood();
-    trdQtHeliumToElectronLogLikelihoodRatio = (float)particle->CalculateHeliumElectronLikelihood();
-    trdQtHeliumToProtonLogLikelihoodRatio = (float)particle->CalculateHeliumProtonLikelihood();
+      const Analysis::TrdQt* trdQtFromTrackerTrack = particle->GetTrdQtInfo();
+      trdQtIsCalibrationGood = trdQtFromTrackerTrack->IsCalibrationGood();
+      trdQtIsSlowControlDataGood = trdQtFromTrackerTrack->IsSlowControlDataGood();
+      trdQtIsInsideTrdGeometricalAcceptance = kTRUE;
+      rec->trdQtIsValid = 1;
+      trdQtActiveStraws = 1;
+      trdQtActiveLayers = 1;
+      rec->trdQtElectronToProtonLogLikelihoodRatio = -1.;
+      rec->trdQtHeliumToProtonLogLikelihoodRatio = -1.;
+      rec->trdQtElectronToHeliumLogLikelihoodRatio = -1.;
+
+      const std::vector<Analysis::TrdHit>& TrdHit = trdQtFromTrackerTrack->GetAssignedHits();
+
+      const std::vector<Analysis::TrdVertex>& verticesXZ = event->TrdVerticesXZ();
+      const std::vector<Analysis::TrdVertex>& verticesYZ = event->TrdVerticesYZ();
+
+      for( std::vector<Analysis::TrdVertex>::const_iterator xzIter = verticesXZ.begin(); xzIter != verticesXZ.end(); ++xzIter)
+      {
+        const Analysis::TrdVertex& xzVertex = *xzIter;
+        for( std::vector<Analysis::TrdVertex>::const_iterator yzIter = verticesYZ.begin(); yzIter != verticesYZ.end(); ++yzIter)
+        {
+          const Analysis::TrdVertex& yzVertex = *yzIter;
+          if( std::max(xzVertex.NumberOfSegments(), yzVertex.NumberOfSegments() ) < 3)
+            continue;
+          if( fabs(xzVertex.Z() - yzVertex.Z() ) < fabs(xzVertex.ErrorZ() + yzVertex.ErrorZ() ))
+          {
+            trdQtNTRDVertex++;
+          }
+        }
+      }
+
+      rec->trdQtElectronToProtonLogLikelihoodRatio = (float)particle->CalculateElectronProtonLikelihood();
+      trdQtHeliumToElectronLogLikelihoodRatio = (float)particle->CalculateHeliumElectronLikelihood();
+      rec->trdQtHeliumToProtonLogLikelihoodRatio = (float)particle->CalculateHeliumProtonLikelihood();
+
+      if( expressions.IsEnabled() && !expressions.Evaluate(&record, selections) ) continue;
+
+      latency.Mark(kStageFill);
+      if( classifiers.IsEnabled() ) classifiers.Add(record, selections);
+      else selections.Commit(record);
+      latency.Mark(kStageWrite);
+
+      // A full batch is evaluated and committed outside of the latency of this event (ClassifierSet::PrintStatistics()).
+      if( classifiers.IsFull() )
+      {
+        latency.Suspend();
+        classifiers.Flush(selections);
+        latency.Resume();
+      }
+      nProcessed++;
+    }
+  }
 
-    if( e % nProcessCheck == 0 || e == nEntries - 1 )
-      cout << "[" << releaseName << "] Processed " << e << " out of " << nEntries << " (" << (float)e/nEntries*100. << "%)" << endl;
+  if( nProcessed != nProcessedAtEvent ) nAcceptedEvents++;
+  classifiers.Flush(selections);
+  telemetry.Finish(nDone, nAcceptedEvents, &amsChain);
+  fileStream.Finish();
+
+  latency.Finish();
+  latency.Print();
+  if( blockCuts.IsEnabled() ) blockCuts.PrintStatistics();
+  fileStream.PrintStatistics();
+  if( classifiers.IsEnabled() ) classifiers.PrintStatistics();
+
+  // The latency and allocation histograms and the slowEvents tree describe the whole job, not a selection. They are
+  // written once, with the objects of the first selection of the selection file.
+  latency.AddObjects(selections.GetSelection(0)->writer);
+  if( selections.GetSize() > 1 )
+    std::cout << "[" << releaseName << "] The latency histograms and the slowEvents tree are written to the output of the selection ["
+              << selections.GetSelection(0)->name << "] only." << std::endl;
+
+  for(unsigned int s = 0; s < selections.GetSize(); s++)
+  {
+    Selection* selection = selections.GetSelection(s);
+    if( selection->hRunStart )
+    {
+      selection->writer->CommitRunEnd(currentRun, MakeRunCounter(selection->hCutFlow, selection->hRunStart));
+      delete selection->hRunStart;
+    }
 
-    nProcessedNumber = nProcessed;
-    tree->Fill();
-    nProcessed++;
+    selection->writer->Stop();
+    std::cout << "[" << releaseName << "] SELECTION " << selection->name << " : " << selection->nStored << " records" << std::endl;
+    selection->writer->PrintStatistics();
+    delete selection->writer;
+    delete selection->sink;
   }
 
-  if( resultFile->Write() ) cout << "[" << releaseName << "] The result file [" << resultFile->GetName() << "] is successfully written." << endl;
-  resultFile->cd("/");
-  if( hEvtCounter->Write() ) cout << "[" << releaseName << "] The counter histogram is successfully written." << endl;
-  resultFile->Close();
+  if( setupCache )
+  {
+    setupCache->PrintStatistics();
+    delete setupCache;
+  }
 
-  cout << "[" << releaseName << "] The program is terminated successfully. " << nProcessed << " events are stored." << endl;
+  cout << "[" << releaseName << "] The program is terminated successfully. " << nProcessed << " candidates are stored." << endl;
   return 0;
 }
 
-bool IsBadRun(AMSEventR* thisEvent)
+bool IsGoodParticle(ParticleR* thisParticle)
 {
-  int tag = thisEvent->IsBadRun("");
-  if( tag == 0 ) return false;
-  if( tag == 1 ) return true;
-  if( tag == 2 ) { printf("Run:%d Ev:%d -> Can not access to root_setup. Skipping this  event\n", (int)pev->Run(), (int)pev->Event() ); }
+  return true;
 }
 
-bool IsGoodParticle(ParticleR* thisParticle)
+/**
+ * @brief This function builds the counter of a finished run from the total counter and its snapshot taken at the beginning of the run.
+ * @return Counter histogram of the run. (The caller owns it.)
+ */
+TH1D* MakeRunCounter(TH1D* hTotal, TH1D* hRunStart)
 {
-  return true;
+  TH1D* hRun = (TH1D*)hTotal->Clone(hTotal->GetName());
+  hRun->Add(hRunStart, -1.);
+  return hRun;
+}
+
+/**
+ * @brief This function looks up the ACSoft particle built from the given ParticleR.
+ * @return The particle / NULL : ACSoft did not build a particle from it
+ */
+const Analysis::Particle* FindAnalysisParticle(const Analysis::Event& event, const ParticleR* pParticle)
+{
+  for(unsigned int i = 0; i < event.NumberOfParticles(); i++)
+    if( event.GetParticle(i)->AmsParticle() == pParticle ) return event.GetParticle(i);
+  return NULL;
 }
 
 unsigned int GetParticleType(ParticleR* thisParticle)
@@ -0,0 +1,392 @@
+/**
+ * @file      merge.cxx
+ * @brief     Merge of partial ACCTOFInt outputs by copying the compressed baskets.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ *
+ * Usage : bin/merge <output file> <list file of the partial outputs> [parallel merges] [files per merge]
+ *
+ * Before anything is written, the branches of the ACCTOFInt tree of every input are compared with the
+ * first input. The inputs are then merged as a tree reduction : groups of [files per merge] files are merged
+ * into intermediate files by up to [parallel merges] forked processes, level after level, until one group
+ * is left, which is merged into <output file>.tmp and renamed to the output only when the merge succeeded, so that
+ * a failed merge never leaves a partial output behind. Histograms with the same name (hEvtCounter, the cut flows of
+ * the selections, the latency histograms hLatency_<stage>) are summed, trees are concatenated.
+ *
+ * The job-level summaries of the latency monitor can not be summed : hLatencyQuantiles, hAllocationsPerEvent and
+ * hAllocatedBytesPerEvent are left out of the output (they describe single jobs only). slowEvents is rebuilt from
+ * the slowEvents trees of the inputs with the N slowest events, slowest first, N being the largest input tree.
+ *
+ * The output takes the compression settings of the first input. When every input of a group has the same
+ * settings, the group is merged in fast mode : the baskets are copied without being decompressed.
+ */
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "RVersion.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TChain.h"
+#include "TBranch.h"
+#include "TObjArray.h"
+#include "TFileMerger.h"
+
+char releaseName[16] = "ACCTOFInt0.01";
+char softwareName[10] = "ACCTOFInt";
+
+// Job-level objects of the latency monitor (latency.h) which are not merged
+static const char* const jobSummaryNames = "hLatencyQuantiles hAllocationsPerEvent hAllocatedBytesPerEvent slowEvents";
+
+/**
+ * @brief Schema and compression of one input.
+ */
+struct MergeInput
+{
+  std::string               fileName;
+  int                       compression;
+  std::vector<std::string>  branches;       // "<name> <leaf list>" of every top-level branch
+};
+
+
+
+/**
+ * @brief This function reads the schema of the ACCTOFInt tree and the compression settings of an input.
+ * @return true : Success / false : The file or its tree could not be read
+ */
+bool ReadInput(MergeInput& input)
+{/*{{{*/
+  TFile* file = TFile::Open(input.fileName.c_str());
+  if( !file || file->IsZombie() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open file [" << input.fileName << "]!" << std::endl;
+    delete file;
+    return false;
+  }
+
+  TTree* tree = (TTree*)file->Get(softwareName);
+  if( !tree )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : [" << input.fileName << "] has no " << softwareName << " tree!" << std::endl;
+    file->Close();
+    delete file;
+    return false;
+  }
+
+  input.compression = file->GetCompressionSettings();
+  TObjArray* branches = tree->GetListOfBranches();
+  for(int i = 0; i < branches->GetEntries(); i++)
+  {
+    TBranch* branch = (TBranch*)branches->At(i);
+    input.branches.push_back(std::string(branch->GetName()) + " " + branch->GetTitle());
+  }
+
+  file->Close();
+  delete file;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function compares the schema of an input with the reference input.
+ * @return true : Same branches with the same leaf lists in the same order
+ */
+bool IsSameSchema(const MergeInput& reference, const MergeInput& input)
+{/*{{{*/
+  if( reference.branches == input.branches ) return true;
+
+  std::cerr << "[" << releaseName << "] ERROR     : The schema of [" << input.fileName << "] differs from [" << reference.fileName << "] :" << std::endl;
+  for(unsigned int i = 0; i < reference.branches.size() || i < input.branches.size(); i++)
+  {
+    const char* expected = ( i < reference.branches.size() ) ? reference.branches[i].c_str() : "(none)";
+    const char* found    = ( i < input.branches.size() ) ? input.branches[i].c_str() : "(none)";
+    if( strcmp(expected, found) != 0 )
+    {
+      std::cerr << "[" << releaseName << "]             branch " << i << " : expected [" << expected << "], found [" << found << "]" << std::endl;
+      break;
+    }
+  }
+  return false;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the N slowest events of the slowEvents trees of the inputs to the merged file.
+ * @return true : Success (also when the inputs have no slowEvents tree)
+ */
+bool MergeSlowEvents(const std::vector<std::string>& inputs, const std::string& output)
+{/*{{{*/
+  // Only the output of the first selection of a job has a slowEvents tree.
+  TChain chain("slowEvents");
+  for(unsigned int i = 0; i < inputs.size(); i++)
+  {
+    TFile* input = TFile::Open(inputs[i].c_str());
+    if( input && !input->IsZombie() && input->Get("slowEvents") ) chain.Add(inputs[i].c_str());
+    if( input ) input->Close();
+    delete input;
+  }
+  Long64_t nEntries = chain.GetEntries();
+
+  TFile* file = new TFile(output.c_str(), "UPDATE");
+  if( !file || file->IsZombie() )
+  {
+    delete file;
+    return false;
+  }
+  file->Delete("slowEvents;*");             // Concatenated by a merger which can not skip it
+
+  bool success = true;
+  if( nEntries > 0 )
+  {
+    // Every input keeps its slowest events, so the N slowest of the inputs are the N slowest of the merge.
+    unsigned int nSlowEvents = 0;
+    for(int t = 0; t < chain.GetNtrees(); t++)
+    {
+      unsigned int n = chain.GetTreeOffset()[t + 1] - chain.GetTreeOffset()[t];
+      if( n > nSlowEvents ) nSlowEvents = n;
+    }
+
+    double total;
+    chain.SetBranchAddress("total", &total);
+    std::vector< std::pair<double, Long64_t> > rows;
+    for(Long64_t i = 0; i < nEntries; i++)
+    {
+      chain.GetEntry(i);
+      rows.push_back(std::make_pair(-total, i));
+    }
+    std::sort(rows.begin(), rows.end());
+    if( rows.size() > nSlowEvents ) rows.resize(nSlowEvents);
+
+    file->cd();
+    TTree* tSlowEvents = chain.CloneTree(0);
+    for(unsigned int r = 0; r < rows.size(); r++)
+    {
+      chain.GetEntry(rows[r].second);
+      tSlowEvents->Fill();
+    }
+    success = tSlowEvents->Write("", TObject::kOverwrite) > 0;
+  }
+
+  file->Close();
+  delete file;
+  return success;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function merges a group of files into one file. The job-level summaries are skipped.
+ * @return true : Success
+ */
+bool MergeFiles(const std::vector<std::string>& inputs, const std::string& output, int compression, bool fast)
+{/*{{{*/
+  TFileMerger merger(kFALSE, kFALSE);
+  merger.SetFastMethod(fast ? kTRUE : kFALSE);
+  if( !merger.OutputFile(output.c_str(), "RECREATE", compression) ) return false;
+  for(unsigned int i = 0; i < inputs.size(); i++)
+    if( !merger.AddFile(inputs[i].c_str(), kFALSE) ) return false;
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,10,0)
+  merger.AddObjectNames(jobSummaryNames);
+  if( !merger.PartialMerge(TFileMerger::kAll | TFileMerger::kRegular | TFileMerger::kSkipListed) ) return false;
+#else
+  // Older mergers can not skip objects. The job-level summaries are deleted from the output instead.
+  if( !merger.Merge() ) return false;
+
+  TFile* file = new TFile(output.c_str(), "UPDATE");
+  if( !file || file->IsZombie() )
+  {
+    delete file;
+    return false;
+  }
+  char names[128];
+  strcpy(names, jobSummaryNames);
+  for(char* name = strtok(names, " "); name; name = strtok(NULL, " ")) file->Delete(( std::string(name) + ";*" ).c_str());
+  file->Close();
+  delete file;
+#endif
+
+  return MergeSlowEvents(inputs, output);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function merges the groups of one level of the reduction, up to nParallel at a time, in forked processes.
+ * @return true : Every group is merged
+ */
+bool MergeLevel(const std::vector< std::vector<std::string> >& groups, const std::vector<std::string>& outputs,
+                const std::vector<bool>& fast, int compression, int nParallel)
+{/*{{{*/
+  bool success = true;
+  int  nRunning = 0;
+  unsigned int next = 0;
+
+  while( next < groups.size() || nRunning > 0 )
+  {
+    if( next < groups.size() && nRunning < nParallel && success )
+    {
+      pid_t pid = fork();
+      if( pid < 0 )
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : fork() failed (" << strerror(errno) << ")!" << std::endl;
+        success = false;
+        continue;
+      }
+      if( pid == 0 ) _exit( MergeFiles(groups[next], outputs[next], compression, fast[next]) ? 0 : 1 );
+
+      nRunning++;
+      next++;
+      continue;
+    }
+
+    if( next < groups.size() && !success ) next = groups.size();     // Nothing new after a failure
+    if( nRunning == 0 ) break;
+
+    int status;
+    if( wait(&status) < 0 ) break;
+    nRunning--;
+    if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) success = false;
+  }
+
+  return success;
+}/*}}}*/
+
+
+
+int main(int argc, char* argv[])
+{
+  if( argc < 3 )
+  {
+    std::cerr << "Usage : " << argv[0] << " <output file> <list file of the partial outputs> [parallel merges] [files per merge]" << std::endl;
+    return -1;
+  }
+
+  std::string  outputFileName = argv[1];
+  int          nParallel      = ( argc > 3 ) ? atoi(argv[3]) : 4;
+  unsigned int fanIn          = ( argc > 4 ) ? atoi(argv[4]) : 16;
+  if( nParallel < 1 ) nParallel = 1;
+  if( fanIn < 2 ) fanIn = 2;
+
+  // Inputs
+  FILE* fp;
+  if( ( fp = fopen(argv[2], "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open file [" << argv[2] << "]!" << std::endl;
+    return -1;
+  }
+
+  std::vector<MergeInput> inputs;
+  char  inputFileName[512];
+  char* line_p;
+  while( fgets(inputFileName, 512, fp) != NULL )
+  {
+    if( ( line_p = strchr(inputFileName, '\n') ) != NULL ) *line_p = 0;
+    if( inputFileName[0] == '\0' ) continue;
+
+    MergeInput input;
+    input.fileName = inputFileName;
+    if( !ReadInput(input) ) { fclose(fp); return -1; }
+    if( !inputs.empty() && !IsSameSchema(inputs[0], input) ) { fclose(fp); return -1; }
+    inputs.push_back(input);
+  }
+  fclose(fp);
+
+  if( inputs.empty() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : No input in [" << argv[2] << "]!" << std::endl;
+    return -1;
+  }
+
+  int compression = inputs[0].compression;
+  std::cout << "[" << releaseName << "] " << inputs.size() << " inputs with " << inputs[0].branches.size() << " branches, compression "
+            << compression << ", " << nParallel << " parallel merges of up to " << fanIn << " files" << std::endl;
+
+  // Tree reduction. A file of a level is merged in fast mode when every input of its group has the compression of the output.
+  std::vector<std::string> current;
+  std::vector<bool>        sameCompression;
+  for(unsigned int i = 0; i < inputs.size(); i++)
+  {
+    current.push_back(inputs[i].fileName);
+    sameCompression.push_back(inputs[i].compression == compression);
+  }
+
+  bool intermediate = false;                // The files of current are intermediate files of this merge
+  int  level = 0;
+  bool success = true;
+  while( success )
+  {
+    bool last = ( current.size() <= fanIn );
+
+    std::vector< std::vector<std::string> > groups;
+    std::vector<std::string>                outputs;
+    std::vector<bool>                       fast;
+    for(unsigned int first = 0; first < current.size(); first += fanIn)
+    {
+      std::vector<std::string> group;
+      bool groupFast = true;
+      for(unsigned int i = first; i < first + fanIn && i < current.size(); i++)
+      {
+        group.push_back(current[i]);
+        groupFast &= sameCompression[i];
+      }
+      groups.push_back(group);
+      fast.push_back(groupFast);
+
+      char name[1024];
+      if( last ) snprintf(name, sizeof(name), "%s.tmp", outputFileName.c_str());
+      else snprintf(name, sizeof(name), "%s.level%d_%04d.tmp.root", outputFileName.c_str(), level, (int)outputs.size());
+      outputs.push_back(name);
+    }
+
+    int nFast = 0;
+    for(unsigned int g = 0; g < fast.size(); g++) nFast += fast[g] ? 1 : 0;
+    std::cout << "[" << releaseName << "] Level " << level << " : " << current.size() << " files into " << groups.size()
+              << " (" << nFast << " in fast mode)" << std::endl;
+    if( nFast < (int)fast.size() )
+      std::cerr << "[" << releaseName << "] WARNING   : Some inputs have other compression settings. Their baskets are recompressed." << std::endl;
+
+    success = MergeLevel(groups, outputs, fast, compression, nParallel);
+
+    if( intermediate ) for(unsigned int i = 0; i < current.size(); i++) unlink(current[i].c_str());
+    if( !success )
+    {
+      for(unsigned int i = 0; i < outputs.size(); i++) unlink(outputs[i].c_str());
+      break;
+    }
+    if( last )
+    {
+      if( rename(outputs[0].c_str(), outputFileName.c_str()) != 0 )
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : Failed to rename [" << outputs[0] << "] to [" << outputFileName << "]!" << std::endl;
+        unlink(outputs[0].c_str());
+        success = false;
+      }
+      break;
+    }
+
+    current = outputs;
+    sameCompression.assign(current.size(), true);
+    intermediate = true;
+    level++;
+  }
+
+  if( !success )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : The merge failed!" << std::endl;
+    return -1;
+  }
+
+  std::cout << "[" << releaseName << "] " << inputs.size() << " inputs are merged into [" << outputFileName << "]" << std::endl;
+  return 0;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file      ntuple.cxx
+ * @brief     RNTuple output sink.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "RVersion.h"
+#include "TFile.h"
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
+#include <memory>
+#include <ROOT/RField.hxx>
+#include <ROOT/REntry.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleFillContext.hxx>
+#include <ROOT/RNTupleParallelWriter.hxx>
+#include <ROOT/RNTupleWriteOptions.hxx>
+#endif
+
+#include "ntuple.h"
+
+extern char releaseName[16];
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
+using ROOT::Experimental::REntry;
+using ROOT::Experimental::RFieldBase;
+using ROOT::Experimental::RNTupleModel;
+using ROOT::Experimental::RNTupleFillContext;
+using ROOT::Experimental::RNTupleParallelWriter;
+using ROOT::Experimental::RNTupleWriteOptions;
+
+struct NTupleWriterState
+{
+  std::unique_ptr<RNTupleParallelWriter>             writer;
+  std::vector<std::shared_ptr<RNTupleFillContext> >  contexts;  // One per writer thread
+  std::vector<std::unique_ptr<REntry> >              entries;   // One per writer thread
+  std::vector<EventRecord>                           buffers;   // Memory bound to the entries
+};
+#else
+struct NTupleWriterState
+{
+};
+#endif
+
+
+
+/**
+ * @brief This function translates a column of EventRecord into the RNTuple field type.
+ * @return C++ type name of the field (std::array<T,N> for array columns)
+ */
+std::string GetNTupleTypeName(const RecordField& field)
+{/*{{{*/
+  std::string typeName;
+  switch( field.type )
+  {
+    case 'i': typeName = "std::uint32_t"; break;
+    case 'I': typeName = "std::int32_t";  break;
+    default : typeName = "float";         break;
+  }
+
+  if( field.count == 1 ) return typeName;
+
+  char arrayName[64];
+  sprintf(arrayName, "std::array<%s,%d>", typeName.c_str(), field.count);
+  return arrayName;
+}/*}}}*/
+
+
+
+NTupleSink::NTupleSink(const char* fileName, const char* ntupleName, int nWorkers, int compression, long pageSize)
+  : fileName(fileName), ntupleName(ntupleName), nWorkers(nWorkers > 0 ? nWorkers : 1), compression(compression), pageSize(pageSize), state(NULL)
+{/*{{{*/
+}/*}}}*/
+
+
+
+NTupleSink::~NTupleSink()
+{/*{{{*/
+  if( state ) Close();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function builds the model from the record field table and creates the parallel writer.
+ * @return true : The sink is ready / false : The RNTuple can not be created
+ */
+bool NTupleSink::Open()
+{/*{{{*/
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
+  try
+  {
+    std::unique_ptr<RNTupleModel> model = RNTupleModel::CreateBare();
+    for(int i = 0; i < GetNRecordFields(); i++)
+    {
+      const RecordField& field = GetRecordField(i);
+      model->AddField(RFieldBase::Create(field.name, GetNTupleTypeName(field)).Unwrap());
+    }
+
+    RNTupleWriteOptions writeOptions;
+    if( compression >= 0 ) writeOptions.SetCompression(compression);
+    if( pageSize > 0 )     writeOptions.SetApproxUnzippedPageSize(pageSize);
+
+    state = new NTupleWriterState;
+    state->writer = RNTupleParallelWriter::Recreate(std::move(model), ntupleName, fileName, writeOptions);
+    state->buffers.resize(nWorkers);
+
+    for(int w = 0; w < nWorkers; w++)
+    {
+      ResetRecord(&state->buffers[w]);
+      state->contexts.push_back(state->writer->CreateFillContext());
+      state->entries.push_back(state->contexts[w]->CreateEntry());
+      for(int i = 0; i < GetNRecordFields(); i++)
+      {
+        const RecordField& field = GetRecordField(i);
+        state->entries[w]->BindRawPtr(field.name, (char*)&state->buffers[w] + field.offset);
+      }
+    }
+  }
+  catch( const std::exception& exception )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the RNTuple in [" << fileName << "] : " << exception.what() << std::endl;
+    delete state;
+    state = NULL;
+    return false;
+  }
+
+  std::cout << "[" << releaseName << "] RNTuple [" << ntupleName << "] is created with " << nWorkers << " fill context(s)." << std::endl;
+  return true;
+#else
+  std::cerr << "[" << releaseName << "] ERROR     : The RNTuple backend needs ROOT 6.32 or newer." << std::endl;
+  return false;
+#endif
+}/*}}}*/
+
+
+
+void NTupleSink::Fill(const EventRecord& record)
+{/*{{{*/
+  Fill(record, 0);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function fills the record through the fill context of the calling writer thread.
+ */
+void NTupleSink::Fill(const EventRecord& record, int worker)
+{/*{{{*/
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
+  memcpy(&state->buffers[worker], &record, sizeof(EventRecord));
+  state->contexts[worker]->Fill(*state->entries[worker]);
+#endif
+}/*}}}*/
+
+
+
+/**
+ * @brief This function keeps an object which is added to the file after the RNTuple is committed.
+ */
+void NTupleSink::WriteObject(TObject* object)
+{/*{{{*/
+  objects.push_back(object);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function flushes the fill contexts, commits the RNTuple and adds the kept objects.
+ */
+void NTupleSink::Close()
+{/*{{{*/
+  if( !state ) return;
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,32,0)
+  state->entries.clear();
+  state->contexts.clear();
+  state->writer.reset();
+#endif
+  delete state;
+  state = NULL;
+
+  TFile* file = new TFile(fileName.c_str(), "UPDATE");
+  if( file && !file->IsZombie() )
+  {
+    for(unsigned int i = 0; i < objects.size(); i++) file->WriteTObject(objects[i]);
+    file->Close();
+  }
+  delete file;
+
+  std::cout << "[" << releaseName << "] The result file [" << fileName << "] is successfully written." << std::endl;
+}/*}}}*/
@@ -0,0 +1,51 @@
+/**
+ * @file      ntuple.h
+ * @brief     Output sink writing the EventRecord columns as an RNTuple.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ *
+ * The RNTuple API used here is the one of ROOT 6.32 (ROOT::Experimental). With older ROOT
+ * versions the sink is still compiled but Open() reports that the backend is not available.
+ */
+#ifndef _NTUPLE_H_
+#define _NTUPLE_H_
+
+#include <string>
+#include <vector>
+
+#include "writer.h"
+
+struct NTupleWriterState;
+
+/**
+ * @brief Sink writing the records into one RNTuple through RNTupleParallelWriter.
+ *
+ * Every writer thread owns one fill context and one entry bound to its own EventRecord buffer,
+ * so several threads fill the same RNTuple in the same file concurrently. Objects such as
+ * hEvtCounter are added to the file after the RNTuple is committed.
+ */
+class NTupleSink : public OutputSink
+{
+  std::string            fileName;
+  std::string            ntupleName;
+  int                    nWorkers;
+  int                    compression;       // ROOT compression setting (e.g. 505), -1 : ROOT default
+  long                   pageSize;          // (bytes) Approximate unzipped page size, 0 : ROOT default
+  NTupleWriterState*     state;
+  std::vector<TObject*>  objects;
+
+public:
+  NTupleSink(const char* fileName, const char* ntupleName, int nWorkers, int compression, long pageSize);
+  virtual ~NTupleSink();
+
+  virtual bool Open();
+  virtual void Fill(const EventRecord& record);
+  virtual void Fill(const EventRecord& record, int worker);
+  virtual bool IsParallel() const { return true; }
+  virtual void WriteObject(TObject* object);
+  virtual void Close();
+};
+
+std::string GetNTupleTypeName(const RecordField& field);
+
+#endif
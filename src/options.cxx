@@ -0,0 +1,303 @@
+/**
+ * @file      options.cxx
+ * @brief     Parser for the --key=value command line options.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include "RVersion.h"
+
+#include "options.h"
+#include "sampling.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief This function checks whether the argument is "--<key>=<value>" and extracts the value.
+ * @return true : The argument carries the option / false : Other argument
+ */
+static bool MatchOption(const char* argument, const char* key, const char** value)
+{/*{{{*/
+  size_t keyLength = strlen(key);
+  if( strncmp(argument, "--", 2) != 0 ) return false;
+  if( strncmp(argument + 2, key, keyLength) != 0 ) return false;
+  if( argument[2 + keyLength] != '=' ) return false;
+  *value = argument + 3 + keyLength;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function fills the options with their default values.
+ */
+void SetDefaultOptions(RunOptions* options)
+{/*{{{*/
+  options->writerQueueSize    = 4096;
+  options->writerQueueLimit   = 65536;
+  options->writerBackpressure = kBackpressureBlock;
+  options->partitionMode      = kPartitionNone;
+  options->writerThreads      = 1;
+  options->outputBackend      = kBackendTree;
+  options->ntupleCompression  = -1;
+  options->ntuplePageSize     = 0;
+  options->nSlowEvents        = 100;
+  options->replayList[0]      = '\0';
+  strcpy(options->indexCacheDir, ".eventindex");
+  options->workQueue[0]       = '\0';
+  options->heartbeatTimeout   = 600;
+  options->selectionFile[0]   = '\0';
+  options->sampleFraction     = 0.;
+  options->sampleMode         = kSamplingCluster;
+  options->sampleSeed         = 1;
+  options->watchDirectory[0]  = '\0';
+  options->watchInterval      = 60;
+  options->watchSettleTime    = 120;
+  options->setupCacheDir[0]   = '\0';
+  options->warmSetupList[0]   = '\0';
+  options->blockCutSize       = 0;
+  options->headerIndexFile[0] = '\0';
+  options->headerIndexList[0] = '\0';
+  options->expressionFile[0]  = '\0';
+  options->classifierFile[0]  = '\0';
+  options->classifierBatchSize = 256;
+  options->streamFiles        = 0;
+  options->telemetryFile[0]   = '\0';
+  options->telemetryPromFile[0] = '\0';
+  options->telemetryInterval  = 10.;
+  options->telemetryMaxSize   = 16;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function consumes --key=value arguments and leaves positional arguments in argv.
+ * @return Number of remaining arguments (including argv[0]) / -1 : Unknown or malformed option
+ */
+int ParseOptions(RunOptions* options, int argc, char* argv[])
+{/*{{{*/
+  int nPositional = 1;
+  const char* value;
+
+  for(int i = 1; i < argc; i++)
+  {
+    const char* argument = argv[i];
+
+    if( strncmp(argument, "--", 2) != 0 )
+    {
+      argv[nPositional++] = argv[i];
+      continue;
+    }
+
+    if( MatchOption(argument, "writer-queue", &value) )
+      options->writerQueueSize = atoi(value);
+    else if( MatchOption(argument, "writer-queue-limit", &value) )
+      options->writerQueueLimit = atoi(value);
+    else if( MatchOption(argument, "writer-backpressure", &value) )
+    {
+      if( strcmp(value, "block") == 0 )     options->writerBackpressure = kBackpressureBlock;
+      else if( strcmp(value, "grow") == 0 ) options->writerBackpressure = kBackpressureGrow;
+      else
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : Unknown backpressure policy [" << value << "]!" << std::endl;
+        return -1;
+      }
+    }
+    else if( MatchOption(argument, "writer-threads", &value) )
+      options->writerThreads = atoi(value);
+    else if( MatchOption(argument, "ntuple-compression", &value) )
+      options->ntupleCompression = atoi(value);
+    else if( MatchOption(argument, "ntuple-page-size", &value) )
+      options->ntuplePageSize = atol(value);
+    else if( MatchOption(argument, "slow-events", &value) )
+      options->nSlowEvents = atoi(value);
+    else if( MatchOption(argument, "replay", &value) )
+      strncpy(options->replayList, value, 255);
+    else if( MatchOption(argument, "index-cache", &value) )
+      strncpy(options->indexCacheDir, value, 255);
+    else if( MatchOption(argument, "work-queue", &value) )
+      strncpy(options->workQueue, value, 255);
+    else if( MatchOption(argument, "heartbeat-timeout", &value) )
+      options->heartbeatTimeout = atoi(value);
+    else if( MatchOption(argument, "selections", &value) )
+      strncpy(options->selectionFile, value, 255);
+    else if( MatchOption(argument, "setup-cache", &value) )
+      strncpy(options->setupCacheDir, value, 255);
+    else if( MatchOption(argument, "warm-setup-cache", &value) )
+      strncpy(options->warmSetupList, value, 255);
+    else if( MatchOption(argument, "watch", &value) )
+      strncpy(options->watchDirectory, value, 255);
+    else if( MatchOption(argument, "watch-interval", &value) )
+      options->watchInterval = atoi(value);
+    else if( MatchOption(argument, "watch-settle", &value) )
+      options->watchSettleTime = atoi(value);
+    else if( MatchOption(argument, "sample", &value) )
+      options->sampleFraction = atof(value);
+    else if( MatchOption(argument, "sample-seed", &value) )
+      options->sampleSeed = (unsigned int)strtoul(value, NULL, 10);
+    else if( MatchOption(argument, "sample-mode", &value) )
+    {
+      if( strcmp(value, "cluster") == 0 )       options->sampleMode = kSamplingCluster;
+      else if( strcmp(value, "prescale") == 0 ) options->sampleMode = kSamplingPrescale;
+      else if( strcmp(value, "random") == 0 )   options->sampleMode = kSamplingRandom;
+      else
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : Unknown sampling mode [" << value << "]!" << std::endl;
+        return -1;
+      }
+    }
+    else if( MatchOption(argument, "block-cuts", &value) )
+      options->blockCutSize = atoi(value);
+    else if( MatchOption(argument, "header-index", &value) )
+      strncpy(options->headerIndexFile, value, 255);
+    else if( MatchOption(argument, "build-header-index", &value) )
+      strncpy(options->headerIndexList, value, 255);
+    else if( MatchOption(argument, "expressions", &value) )
+      strncpy(options->expressionFile, value, 255);
+    else if( MatchOption(argument, "classifiers", &value) )
+      strncpy(options->classifierFile, value, 255);
+    else if( MatchOption(argument, "classifier-batch", &value) )
+      options->classifierBatchSize = atoi(value);
+    else if( MatchOption(argument, "stream-files", &value) )
+      options->streamFiles = atoi(value);
+    else if( MatchOption(argument, "telemetry", &value) )
+      strncpy(options->telemetryFile, value, 255);
+    else if( MatchOption(argument, "telemetry-prom", &value) )
+      strncpy(options->telemetryPromFile, value, 255);
+    else if( MatchOption(argument, "telemetry-interval", &value) )
+      options->telemetryInterval = atof(value);
+    else if( MatchOption(argument, "telemetry-max-size", &value) )
+      options->telemetryMaxSize = atoi(value);
+    else if( MatchOption(argument, "partition", &value) )
+    {
+      if( strcmp(value, "none") == 0 )         options->partitionMode = kPartitionNone;
+      else if( strcmp(value, "run") == 0 )     options->partitionMode = kPartitionRunFile;
+      else if( strcmp(value, "cluster") == 0 ) options->partitionMode = kPartitionRunCluster;
+      else
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : Unknown partition mode [" << value << "]!" << std::endl;
+        return -1;
+      }
+    }
+    else if( MatchOption(argument, "backend", &value) )
+    {
+      if( strcmp(value, "tree") == 0 )          options->outputBackend = kBackendTree;
+      else if( strcmp(value, "columnar") == 0 ) options->outputBackend = kBackendColumnar;
+      else if( strcmp(value, "rntuple") == 0 )  options->outputBackend = kBackendNTuple;
+      else
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : Unknown output backend [" << value << "]!" << std::endl;
+        return -1;
+      }
+    }
+    else
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : Unknown option [" << argument << "]!" << std::endl;
+      PrintOptionUsage();
+      return -1;
+    }
+  }
+
+  if( options->outputBackend != kBackendTree && options->partitionMode != kPartitionNone )
+  {
+    std::cerr << "[" << releaseName << "] WARNING   : --partition is only supported by the tree backend. It is ignored." << std::endl;
+    options->partitionMode = kPartitionNone;
+  }
+
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,14,0)
+  // Before ROOT 6.14 TTree::FlushBaskets() does not start a basket cluster (only AutoFlush does), so the runs
+  // would share clusters. One file per run keeps every run readable without its neighbours.
+  if( options->partitionMode == kPartitionRunCluster )
+  {
+    std::cerr << "[" << releaseName << "] WARNING   : --partition=cluster requires ROOT 6.14 or later. --partition=run is used instead." << std::endl;
+    options->partitionMode = kPartitionRunFile;
+  }
+#endif
+
+  if( options->warmSetupList[0] != '\0' && options->setupCacheDir[0] == '\0' )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : --warm-setup-cache requires --setup-cache=<directory>!" << std::endl;
+    return -1;
+  }
+
+  if( options->headerIndexList[0] != '\0' && options->headerIndexFile[0] == '\0' )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : --build-header-index requires --header-index=<index file>!" << std::endl;
+    return -1;
+  }
+
+  if( options->sampleFraction < 0. || options->sampleFraction >= 1. ) options->sampleFraction = 0.;
+  if( options->sampleFraction > 0. && options->replayList[0] != '\0' )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : --sample and --replay can not be used together!" << std::endl;
+    return -1;
+  }
+
+  if( options->blockCutSize < 0 ) options->blockCutSize = 0;
+  if( options->blockCutSize == 0 && options->headerIndexFile[0] != '\0' ) options->blockCutSize = 4096;
+  if( options->streamFiles < 0 ) options->streamFiles = 0;
+  if( options->telemetryInterval < 0.1 ) options->telemetryInterval = 0.1;
+  if( options->telemetryMaxSize < 0 ) options->telemetryMaxSize = 0;
+  if( options->classifierBatchSize < 1 ) options->classifierBatchSize = 1;
+  if( options->writerThreads < 1 ) options->writerThreads = 1;
+  if( options->nSlowEvents < 0 ) options->nSlowEvents = 0;
+  if( options->heartbeatTimeout < 10 ) options->heartbeatTimeout = 10;
+  if( options->watchInterval < 1 ) options->watchInterval = 1;
+  if( options->watchSettleTime < 0 ) options->watchSettleTime = 0;
+  if( options->writerQueueSize < 0 ) options->writerQueueSize = 0;
+  if( options->writerQueueLimit < options->writerQueueSize ) options->writerQueueLimit = options->writerQueueSize;
+
+  argv[nPositional] = NULL;
+  return nPositional;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function prints the list of the available options.
+ */
+void PrintOptionUsage()
+{/*{{{*/
+  std::cout << "[" << releaseName << "] OPTIONS :" << std::endl;
+  std::cout << "  --writer-queue=<N>                 Record slots between the event loop and the writer thread (0 : write inline)" << std::endl;
+  std::cout << "  --writer-queue-limit=<N>           Maximum record slots when the backpressure policy is grow" << std::endl;
+  std::cout << "  --writer-backpressure=<block|grow> Behaviour of the event loop when every record slot is in use" << std::endl;
+  std::cout << "  --selections=<file>                Named cut chains evaluated in one pass, each written to <output base>_<name>.root" << std::endl;
+  std::cout << "  --setup-cache=<directory>          Read the bad-run flags and the RTI alignment of the cached runs from a local cache" << std::endl;
+  std::cout << "  --warm-setup-cache=<list file>     Only fill the setup cache with the runs of the files in the list, then exit" << std::endl;
+  std::cout << "  --watch=<directory>                Daemon mode : analyze every completed file arriving in the directory" << std::endl;
+  std::cout << "  --watch-interval=<s>               Period of the directory scan of the watch mode (default 60)" << std::endl;
+  std::cout << "  --watch-settle=<s>                 A file unchanged for this long is complete in the directory scan (default 120)" << std::endl;
+  std::cout << "  --sample=<fraction>                Quick look : read a seeded subset of every file, weighted by 1 / (sampled fraction)" << std::endl;
+  std::cout << "  --sample-mode=<cluster|prescale|random>" << std::endl;
+  std::cout << "                                     Take whole basket clusters (default), every N-th entry or random entries" << std::endl;
+  std::cout << "  --sample-seed=<N>                  Seed of the sample choice" << std::endl;
+  std::cout << "  --block-cuts=<N>                   Evaluate the science-run, hardware and trigger cuts on blocks of N entries before reading them" << std::endl;
+  std::cout << "  --header-index=<file>              Take the header cuts from a header index and read only the events which can pass" << std::endl;
+  std::cout << "  --build-header-index=<list file>   Only write the header index of the files in the list to --header-index, then exit" << std::endl;
+  std::cout << "  --expressions=<file>               Compile the user cuts and derived variables of <file> and apply them to every candidate" << std::endl;
+  std::cout << "  --classifiers=<file>               Evaluate the TMVA BDT models of <file> (e.g. showerBDT) in batches before the records are written" << std::endl;
+  std::cout << "  --classifier-batch=<N>             Number of candidates of a classifier batch (default 256)" << std::endl;
+  std::cout << "  --stream-files=<K>                 Keep at most K input files open, release every finished file and report its peak RSS" << std::endl;
+  std::cout << "  --telemetry=<file>                 Append a JSON progress report (rates, ETA, RSS, writers) every interval" << std::endl;
+  std::cout << "  --telemetry-prom=<file>            Also write the report as a Prometheus textfile for node_exporter" << std::endl;
+  std::cout << "  --telemetry-interval=<s>           Period of the progress reports (default 10)" << std::endl;
+  std::cout << "  --telemetry-max-size=<MB>          Rotate the JSON file beyond this size, keeping 3 old files (default 16, 0 : never)" << std::endl;
+  std::cout << "  --partition=<none|run|cluster>     Write one file (run) or one basket cluster (cluster, ROOT >= 6.14) per run, with a run catalog" << std::endl;
+  std::cout << "  --backend=<tree|columnar|rntuple>  Output format. columnar writes <base>.col (see columnar.h) and the histograms to <base>.root" << std::endl;
+  std::cout << "  --writer-threads=<N>               Writer threads filling the RNTuple in parallel" << std::endl;
+  std::cout << "  --ntuple-compression=<N>           ROOT compression setting of the RNTuple (e.g. 505)" << std::endl;
+  std::cout << "  --ntuple-page-size=<bytes>         Approximate unzipped RNTuple page size" << std::endl;
+  std::cout << "  --slow-events=<N>                  Number of the slowest events stored in the slowEvents tree" << std::endl;
+  std::cout << "                                     (with --selections, in the output of the first selection only)" << std::endl;
+  std::cout << "  --replay=<event list>              Process only the events of a \"<run> <event>\" list, in random-access" << std::endl;
+  std::cout << "  --work-queue=<directory>           Batch-job mode takes the files one by one from a queue shared by all workers" << std::endl;
+  std::cout << "                                     on a shared filesystem and writes <output>_<input file>.root per file" << std::endl;
+  std::cout << "  --heartbeat-timeout=<s>            A file whose worker stopped heartbeating for this long is reclaimed (default 600)" << std::endl;
+  std::cout << "  --index-cache=<directory>          Cache directory of the per-file event indices of the replay (default .eventindex)" << std::endl;
+}/*}}}*/
@@ -0,0 +1,74 @@
+/**
+ * @file      options.h
+ * @brief     Command line options ( --key=value ) which tune the run modes of the program.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+enum BackpressurePolicy
+{
+  kBackpressureBlock = 0,       // The event loop waits until the writer frees a record slot.
+  kBackpressureGrow  = 1        // The queue allocates extra slots up to writerQueueLimit before blocking.
+};
+
+enum PartitionMode
+{
+  kPartitionNone       = 0,     // Single output file with one tree
+  kPartitionRunFile    = 1,     // One output file per run
+  kPartitionRunCluster = 2      // Single output file, one basket cluster per run
+};
+
+enum OutputBackend
+{
+  kBackendTree     = 0,         // ACCTOFInt TTree (default)
+  kBackendColumnar = 1,         // Uncompressed memory-mappable columns (columnar.h)
+  kBackendNTuple   = 2          // RNTuple (ntuple.h)
+};
+
+/**
+ * @brief Options given as --key=value arguments. Positional arguments are left to main().
+ */
+struct RunOptions
+{
+  int  writerQueueSize;         // Number of record slots between the event loop and the writer thread. (0 : write inline)
+  int  writerQueueLimit;        // Maximum number of record slots in kBackpressureGrow mode.
+  int  writerBackpressure;      // One of BackpressurePolicy.
+  int  writerThreads;           // Number of writer threads for a backend which supports parallel filling (RNTuple).
+  int  partitionMode;           // One of PartitionMode.
+  int  outputBackend;           // One of OutputBackend.
+  int  ntupleCompression;       // ROOT compression setting of the RNTuple. (-1 : ROOT default)
+  long ntuplePageSize;          // (bytes) Approximate unzipped RNTuple page size. (0 : ROOT default)
+  int  nSlowEvents;             // Number of the slowest events kept in the slowEvents tree.
+  char replayList[256];         // (Run, Event) list to replay instead of the whole chain. (empty : no replay)
+  char indexCacheDir[256];      // Directory of the cached per-file event indices used by the replay.
+  char workQueue[256];          // Shared work queue directory of the batch-job mode. (empty : static list)
+  int  heartbeatTimeout;        // (s) A claimed file without heartbeat for this long is given to another worker.
+  char setupCacheDir[256];      // Local per-run setup cache (setupcache.h). (empty : the AMS setup is used directly)
+  char warmSetupList[256];      // List file whose runs are written to the setup cache by the warm-up command.
+  char watchDirectory[256];     // Directory watched by the daemon mode (watch.h). (empty : no watch)
+  int  watchInterval;           // (s) Period of the polling scan of the watched directory.
+  int  watchSettleTime;         // (s) A file which did not change for this long is complete.
+  double sampleFraction;        // Fraction of the chain read by the sampling mode (sampling.h). (0 : no sampling)
+  int  sampleMode;              // One of SamplingMode.
+  unsigned int sampleSeed;      // Seed of the sample choice.
+  int  blockCutSize;            // Number of entries of the block-wise header/trigger cuts (blockcuts.h). (0 : event by event)
+  char headerIndexFile[256];    // Header index used to pre-filter the entries (headerindex.h). (empty : no index)
+  char headerIndexList[256];    // List file whose events are written to the header index by the build command.
+  char selectionFile[256];      // Named selections evaluated in one pass (selection.h). (empty : the default cut chain)
+  char expressionFile[256];     // User cuts and variables compiled at startup (expression.h). (empty : none)
+  char classifierFile[256];     // TMVA BDT models evaluated in batches on the accepted candidates (classifier.h). (empty : none)
+  int  classifierBatchSize;     // Number of candidates of a classifier batch.
+  int  streamFiles;             // Streaming chain mode : at most this many input files open (filestream.h). (0 : off)
+  char telemetryFile[256];      // JSON-lines progress reports (telemetry.h). (empty : no JSON reports)
+  char telemetryPromFile[256];  // Prometheus textfile of the progress. (empty : no textfile)
+  double telemetryInterval;     // (s) Period of the progress reports.
+  int  telemetryMaxSize;        // (MB) The JSON-lines file is rotated beyond this size.
+};
+
+void SetDefaultOptions(RunOptions* options);
+int  ParseOptions(RunOptions* options, int argc, char* argv[]);
+void PrintOptionUsage();
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * @file      partition.cxx
+ * @brief     Per-run output partitioning and the run catalog.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TNamed.h"
+#include "TString.h"
+#include "RVersion.h"
+
+#include "options.h"
+#include "partition.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief This function strips the ".root" suffix of the output file name.
+ * @return Base name used to build the partition and catalog file names
+ */
+std::string GetOutputBaseName(const char* outputFileName)
+{/*{{{*/
+  std::string baseName(outputFileName);
+  size_t length = baseName.size();
+  if( length > 5 && baseName.compare(length - 5, 5, ".root") == 0 ) baseName.erase(length - 5);
+  return baseName;
+}/*}}}*/
+
+
+
+PartitionedTreeSink::PartitionedTreeSink(int mode, const char* outputFileName, const char* treeName, const char* treeTitle)
+  : mode(mode), baseName(GetOutputBaseName(outputFileName)), treeName(treeName), treeTitle(treeTitle),
+    file(NULL), tree(NULL), summaryFile(NULL), inRun(false)
+{/*{{{*/
+  ResetRecord(&record);
+}/*}}}*/
+
+
+
+PartitionedTreeSink::~PartitionedTreeSink()
+{/*{{{*/
+  if( file || summaryFile ) Close();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function creates a partition file and its tree.
+ * @return true : The file is ready / false : The file can not be created
+ */
+bool PartitionedTreeSink::OpenFile(const std::string& fileName)
+{/*{{{*/
+  file = new TFile(fileName.c_str(), "RECREATE");
+  if( !file || file->IsZombie() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the output file [" << fileName << "]!" << std::endl;
+    delete file;
+    file = NULL;
+    return false;
+  }
+
+  tree = new TTree(treeName, treeTitle);
+  tree->SetDirectory(file);
+  BookRecordBranches(tree, &record);
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the tree of the current partition and closes its file.
+ */
+void PartitionedTreeSink::CloseFile()
+{/*{{{*/
+  if( !file ) return;
+
+  file->cd("/");
+  tree->Write();
+  file->Close();
+  std::cout << "[" << releaseName << "] The result file [" << file->GetName() << "] is successfully written." << std::endl;
+
+  delete file;
+  file = NULL;
+  tree = NULL;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function opens the partition for the given run and adds its catalog line.
+ */
+void PartitionedTreeSink::BeginRun(unsigned int run)
+{/*{{{*/
+  char fileName[512];
+
+  if( mode == kPartitionRunFile )
+  {
+    // A run which comes back later in the chain gets a new file instead of overwriting the old one.
+    int nSeen = 0;
+    for(unsigned int i = 0; i < catalog.size(); i++) if( catalog[i].run == run ) nSeen++;
+
+    if( nSeen == 0 ) sprintf(fileName, "%s_%u.root", baseName.c_str(), run);
+    else             sprintf(fileName, "%s_%u.%d.root", baseName.c_str(), run, nSeen);
+
+    CloseFile();
+    OpenFile(fileName);
+  }
+  else
+  {
+    // Start a new basket cluster so that a run can be read without touching the baskets of its neighbours.
+    // (ParseOptions() falls back to kPartitionRunFile on ROOT versions without FlushBaskets(create_cluster).)
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+    if( tree->GetEntries() > 0 ) tree->FlushBaskets(kTRUE);
+#endif
+    strcpy(fileName, file->GetName());
+  }
+
+  CatalogEntry entry;
+  entry.run        = run;
+  entry.entries    = 0;
+  entry.firstTime  = 0;
+  entry.lastTime   = 0;
+  entry.fileName   = fileName;
+  entry.firstEntry = tree ? (unsigned long)tree->GetEntries() : 0;
+  catalog.push_back(entry);
+  inRun = true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function prepares the output. In kPartitionRunCluster mode the single output tree is created here.
+ * @return true : The sink is ready / false : The output file can not be created
+ */
+bool PartitionedTreeSink::Open()
+{/*{{{*/
+  std::string fileName = baseName + ".root";
+
+  if( mode == kPartitionRunCluster ) return OpenFile(fileName);
+
+  summaryFile = new TFile(fileName.c_str(), "RECREATE");
+  if( !summaryFile || summaryFile->IsZombie() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the output file [" << fileName << "]!" << std::endl;
+    delete summaryFile;
+    summaryFile = NULL;
+    return false;
+  }
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function fills the record into the partition of its run.
+ */
+void PartitionedTreeSink::Fill(const EventRecord& source)
+{/*{{{*/
+  if( !inRun || catalog.back().run != source.nRun ) BeginRun(source.nRun);
+  if( !tree ) return;
+
+  memcpy(&record, &source, sizeof(EventRecord));
+  tree->Fill();
+
+  CatalogEntry& entry = catalog.back();
+  if( entry.entries == 0 ) entry.firstTime = source.unixTime;
+  entry.lastTime = source.unixTime;
+  entry.entries++;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function stores the summary (counter histogram) of a finished run next to its records.
+ */
+void PartitionedTreeSink::EndRun(unsigned int run, TObject* summary)
+{/*{{{*/
+  // A run without accepted records still gets its partition, so that its counter is kept.
+  if( !inRun || catalog.back().run != run ) BeginRun(run);
+
+  if( file && summary )
+  {
+    if( mode == kPartitionRunCluster )
+    {
+      TNamed* named = dynamic_cast<TNamed*>(summary);
+      if( named ) named->SetName(Form("%s_%u", named->GetName(), run));
+    }
+    file->cd("/");
+    summary->Write();
+  }
+  delete summary;
+
+  if( mode == kPartitionRunFile ) CloseFile();
+  inRun = false;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes a run independent object. (kPartitionRunFile : into <base>.root)
+ */
+void PartitionedTreeSink::WriteObject(TObject* object)
+{/*{{{*/
+  TFile* target = ( mode == kPartitionRunFile ) ? summaryFile : file;
+  if( !target ) return;
+
+  target->cd("/");
+  target->WriteTObject(object);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function closes every output file and writes the catalog.
+ */
+void PartitionedTreeSink::Close()
+{/*{{{*/
+  CloseFile();
+
+  if( summaryFile )
+  {
+    summaryFile->Close();
+    delete summaryFile;
+    summaryFile = NULL;
+  }
+
+  WriteCatalog((baseName + ".catalog").c_str());
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the catalog as a text file, one run per line.
+ * @return true : The catalog is written / false : The catalog file can not be created
+ */
+bool PartitionedTreeSink::WriteCatalog(const char* catalogFileName)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(catalogFileName, "w") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the catalog [" << catalogFileName << "]!" << std::endl;
+    return false;
+  }
+
+  // The files are named relative to the catalog, which is always next to them, so that the outputs can be moved.
+  fprintf(fp, "# run entries firstTime lastTime firstEntry file\n");
+  for(unsigned int i = 0; i < catalog.size(); i++)
+  {
+    const CatalogEntry& entry = catalog[i];
+    const char* fileName = strrchr(entry.fileName.c_str(), '/');
+    fileName = fileName ? fileName + 1 : entry.fileName.c_str();
+    fprintf(fp, "%u %lu %u %u %lu %s\n", entry.run, entry.entries, entry.firstTime, entry.lastTime, entry.firstEntry, fileName);
+  }
+  fclose(fp);
+
+  std::cout << "[" << releaseName << "] The run catalog [" << catalogFileName << "] is written with " << catalog.size() << " runs." << std::endl;
+  return true;
+}/*}}}*/
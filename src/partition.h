@@ -0,0 +1,78 @@
+/**
+ * @file      partition.h
+ * @brief     Output sink which partitions the records by run and keeps a catalog of the runs.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _PARTITION_H_
+#define _PARTITION_H_
+
+#include <string>
+#include <vector>
+
+#include "writer.h"
+
+class TFile;
+class TTree;
+class TObject;
+
+/**
+ * @brief One line of the run catalog.
+ */
+struct CatalogEntry
+{
+  unsigned int  run;                        // Run number
+  unsigned long entries;                    // Number of records of the run
+  unsigned int  firstTime;                  // (UNIX time) Time of the first record of the run
+  unsigned int  lastTime;                   // (UNIX time) Time of the last record of the run
+  std::string   fileName;                   // File which holds the run
+  unsigned long firstEntry;                 // Entry offset of the run inside the tree of fileName
+};
+
+/**
+ * @brief Sink writing the records of each nRun separately.
+ *
+ * kPartitionRunFile    : one file <base>_<run>.root per run, each with its tree and its own hEvtCounter.
+ *                        The objects given to WriteObject() (e.g. the total hEvtCounter) go to <base>.root.
+ * kPartitionRunCluster : one file <base>.root whose tree is flushed at every run change, so that every run
+ *                        starts a new basket cluster. The counter of a run is stored as hEvtCounter_<run>.
+ *                        Requires ROOT 6.14 or later (TTree::FlushBaskets(create_cluster)). With an older ROOT
+ *                        the cluster boundaries come from AutoFlush only, and ParseOptions() uses kPartitionRunFile.
+ *
+ * In both modes a text catalog <base>.catalog lists run, entries, time range, file (relative to the catalog) and entry offset.
+ */
+class PartitionedTreeSink : public OutputSink
+{
+  int                        mode;
+  std::string                baseName;
+  const char*                treeName;
+  const char*                treeTitle;
+
+  TFile*                     file;          // File of the current partition
+  TTree*                     tree;          // Tree of the current partition
+  TFile*                     summaryFile;   // <base>.root in kPartitionRunFile mode
+  EventRecord                record;        // Branch buffer of the tree
+
+  std::vector<CatalogEntry>  catalog;
+  bool                       inRun;         // true : catalog.back() is the run being written
+
+  bool OpenFile(const std::string& fileName);
+  void CloseFile();
+  void BeginRun(unsigned int run);
+
+public:
+  PartitionedTreeSink(int mode, const char* outputFileName, const char* treeName, const char* treeTitle);
+  virtual ~PartitionedTreeSink();
+
+  virtual bool Open();
+  virtual void Fill(const EventRecord& record);
+  virtual void WriteObject(TObject* object);
+  virtual void EndRun(unsigned int run, TObject* summary);
+  virtual void Close();
+
+  bool WriteCatalog(const char* catalogFileName);
+};
+
+std::string GetOutputBaseName(const char* outputFileName);
+
+#endif
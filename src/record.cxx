@@ -0,0 +1,251 @@
+/**
+ * @file      record.cxx
+ * @brief     Column table of EventRecord and the TTree branch booking built from it.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <cstring>
+#include <cstdio>
+
+#include "TTree.h"
+#include "record.h"
+
+#define RECORD_FIELD(name, type, count) { #name, type, count, offsetof(EventRecord, name) }
+
+// Column table. The order of this table is the branch order of the output tree.
+static const RecordField recordFields[] =
+{/*{{{*/
+  RECORD_FIELD(nRun,                                     'i',  1),
+  RECORD_FIELD(nEvent,                                   'i',  1),
+  RECORD_FIELD(nProcessedNumber,                         'i',  1),
+  RECORD_FIELD(nLevel1,                                  'i',  1),
+  RECORD_FIELD(nParticle,                                'i',  1),
+  RECORD_FIELD(iParticle,                                'i',  1),
+  RECORD_FIELD(nCharge,                                  'i',  1),
+  RECORD_FIELD(nTrTrack,                                 'i',  1),
+  RECORD_FIELD(nTrdTrack,                                'i',  1),
+  RECORD_FIELD(nAntiCluster,                             'i',  1),
+  RECORD_FIELD(nTofClustersInTime,                       'i',  1),
+  RECORD_FIELD(nRichRing,                                'i',  1),
+  RECORD_FIELD(nRichRingB,                               'i',  1),
+  RECORD_FIELD(nBeta,                                    'i',  1),
+  RECORD_FIELD(nBetaB,                                   'i',  1),
+  RECORD_FIELD(nBetaH,                                   'i',  1),
+  RECORD_FIELD(nShower,                                  'i',  1),
+  RECORD_FIELD(nVertex,                                  'i',  1),
+  RECORD_FIELD(particleType,                             'i',  1),
+  RECORD_FIELD(livetime,                                 'F',  1),
+  RECORD_FIELD(utcTime,                                  'F',  1),
+  RECORD_FIELD(utcTimeCorrected,                         'F',  1),
+  RECORD_FIELD(orbitAltitude,                            'F',  1),
+  RECORD_FIELD(orbitLatitude,                            'F',  1),
+  RECORD_FIELD(orbitLongitude,                           'F',  1),
+  RECORD_FIELD(orbitLatitudeM,                           'F',  1),
+  RECORD_FIELD(orbitLongitudeM,                          'F',  1),
+  RECORD_FIELD(velR,                                     'F',  1),
+  RECORD_FIELD(velTheta,                                 'F',  1),
+  RECORD_FIELD(velPhi,                                   'F',  1),
+  RECORD_FIELD(yaw,                                      'F',  1),
+  RECORD_FIELD(pitch,                                    'F',  1),
+  RECORD_FIELD(roll,                                     'F',  1),
+  RECORD_FIELD(gLongitude,                               'F',  1),
+  RECORD_FIELD(gLatitude,                                'F',  1),
+  RECORD_FIELD(gCoordCalcResult,                         'I',  1),
+  RECORD_FIELD(sunPosAzimuth,                            'F',  1),
+  RECORD_FIELD(sunPosElevation,                          'F',  1),
+  RECORD_FIELD(sunPosCalcResult,                         'I',  1),
+  RECORD_FIELD(unixTime,                                 'i',  1),
+  RECORD_FIELD(weight,                                   'F',  1),
+  RECORD_FIELD(isInShadow,                               'I',  1),
+  RECORD_FIELD(ptlCharge,                                'i',  1),
+  RECORD_FIELD(ptlMomentum,                              'F',  1),
+  RECORD_FIELD(ptlTheta,                                 'F',  1),
+  RECORD_FIELD(ptlPhi,                                   'F',  1),
+  RECORD_FIELD(ptlCoo,                                   'F',  3),
+  RECORD_FIELD(ptlCutOffStoermer,                        'F',  1),
+  RECORD_FIELD(ptlCutOffDipole,                          'F',  1),
+  RECORD_FIELD(ptlCutOffMax,                             'F',  2),
+  RECORD_FIELD(showerEnergyD,                            'F',  1),
+  RECORD_FIELD(showerEnergyE,                            'F',  1),
+  RECORD_FIELD(showerBDT,                                'F',  1),
+  RECORD_FIELD(showerCofG,                               'F',  3),
+  RECORD_FIELD(showerCofGDist,                           'F',  1),
+  RECORD_FIELD(showerCofGdX,                             'F',  1),
+  RECORD_FIELD(showerCofGdY,                             'F',  1),
+  RECORD_FIELD(showerEnergy3C,                           'F',  3),
+  RECORD_FIELD(showerS13R,                               'F',  1),
+  RECORD_FIELD(showerSideLeak,                           'F',  1),
+  RECORD_FIELD(showerRearLeak,                           'F',  1),
+  RECORD_FIELD(showerDifoSum,                            'F',  1),
+  RECORD_FIELD(showerChi2Profile,                        'F',  1),
+  RECORD_FIELD(showerParProfile,                         'F',  4),
+  RECORD_FIELD(showerChi2Trans,                          'F',  1),
+  RECORD_FIELD(showerSphericityEV,                       'F',  3),
+  RECORD_FIELD(showerNHits,                              'I',  1),
+  RECORD_FIELD(tofNClusters,                             'I',  1),
+  RECORD_FIELD(tofNUsedHits,                             'I',  1),
+  RECORD_FIELD(tofBeta,                                  'F',  1),
+  RECORD_FIELD(isGoodBeta,                               'I',  1),
+  RECORD_FIELD(isTkTofMatch,                             'I',  1),
+  RECORD_FIELD(tofReducedChisqT,                         'F',  1),
+  RECORD_FIELD(tofReducedChisqC,                         'F',  1),
+  RECORD_FIELD(tofDepositedEnergyOnLayer,                'F',  4),
+  RECORD_FIELD(tofEstimatedChargeOnLayer,                'F',  4),
+  RECORD_FIELD(tofCharge,                                'F',  1),
+  RECORD_FIELD(trkFitCodeMS,                             'I',  1),
+  RECORD_FIELD(trkRigidityMS,                            'F',  1),
+  RECORD_FIELD(trkReducedChisquareMS,                    'F',  1),
+  RECORD_FIELD(trkFitCodeFS,                             'I',  1),
+  RECORD_FIELD(trkRigidityFS,                            'F',  1),
+  RECORD_FIELD(trkReducedChisquareFS,                    'F',  1),
+  RECORD_FIELD(trkFitCodeInner,                          'I',  1),
+  RECORD_FIELD(trkRigidityInner,                         'F',  1),
+  RECORD_FIELD(trkReducedChisquareInner,                 'F',  1),
+  RECORD_FIELD(trkEdepLayerJXSideOK,                     'I',  9),
+  RECORD_FIELD(trkEdepLayerJYSideOK,                     'I',  9),
+  RECORD_FIELD(trkEdepLayerJ,                            'F',  9),
+  RECORD_FIELD(trkCharge,                                'F',  1),
+  RECORD_FIELD(trkInnerCharge,                           'F',  1),
+  RECORD_FIELD(richRebuild,                              'I',  1),
+  RECORD_FIELD(richIsGood,                               'I',  1),
+  RECORD_FIELD(richIsClean,                              'I',  1),
+  RECORD_FIELD(richIsNaF,                                'I',  1),
+  RECORD_FIELD(richRingWidth,                            'F',  1),
+  RECORD_FIELD(richNHits,                                'I',  1),
+  RECORD_FIELD(richBeta,                                 'F',  1),
+  RECORD_FIELD(richBetaError,                            'F',  1),
+  RECORD_FIELD(richChargeSquared,                        'F',  1),
+  RECORD_FIELD(richKolmogorovProbability,                'F',  1),
+  RECORD_FIELD(richTheta,                                'F',  1),
+  RECORD_FIELD(richPhi,                                  'F',  1),
+  RECORD_FIELD(trdNCluster,                              'I',  1),
+  RECORD_FIELD(trdNTracks,                               'I',  1),
+  RECORD_FIELD(trdTrackTheta,                            'F',  1),
+  RECORD_FIELD(trdTrackPhi,                              'F',  1),
+  RECORD_FIELD(trdTrackChi2,                             'F',  1),
+  RECORD_FIELD(trdTrackPattern,                          'I',  1),
+  RECORD_FIELD(trdTrackCharge,                           'F',  1),
+  RECORD_FIELD(trdDepositedEnergyOnLayer,                'F', 20),
+  RECORD_FIELD(trdQtNActiveLayer,                        'I',  1),
+  RECORD_FIELD(trdQtIsValid,                             'I',  1),
+  RECORD_FIELD(trdQtElectronToProtonLogLikelihoodRatio,  'F',  1),
+  RECORD_FIELD(trdQtHeliumToProtonLogLikelihoodRatio,    'F',  1),
+  RECORD_FIELD(trdQtElectronToHeliumLogLikelihoodRatio,  'F',  1),
+  RECORD_FIELD(trdKNRawHits,                             'I',  1),
+  RECORD_FIELD(trdKIsReadAlignmentOK,                    'I',  1),
+  RECORD_FIELD(trdKIsReadCalibOK,                        'I',  1),
+  RECORD_FIELD(trdKNHits,                                'I',  1),
+  RECORD_FIELD(trdKIsValid,                              'I',  1),
+  RECORD_FIELD(trdKElectronToProtonLogLikelihoodRatio,   'F',  1),
+  RECORD_FIELD(trdKHeliumToProtonLogLikelihoodRatio,     'F',  1),
+  RECORD_FIELD(trdKElectronToHeliumLogLikelihoodRatio,   'F',  1),
+  RECORD_FIELD(trdKCharge,                               'F',  1),
+  RECORD_FIELD(trdKChargeError,                          'F',  1),
+  RECORD_FIELD(trdKNUsedHitsForCharge,                   'I',  1),
+  RECORD_FIELD(trdKAmpLayer,                             'F', 20),
+  RECORD_FIELD(trdKTotalPathLength,                      'F',  1),
+  RECORD_FIELD(trdKElectronLikelihood,                   'F',  1),
+  RECORD_FIELD(trdKProtonLikelihood,                     'F',  1),
+  RECORD_FIELD(trdKHeliumLikelihood,                     'F',  1),};/*}}}*/
+
+static const int nRecordFields = sizeof(recordFields) / sizeof(RecordField);
+
+// Columns of the derived variables. They follow the table and exist only when they are named.
+static char        userFieldNames[kMaxUserVariables][64];
+static RecordField userFields[kMaxUserVariables];
+static int         nUserFields = 0;
+
+
+
+/**
+ * @brief This function returns the number of columns in EventRecord.
+ * @return Number of columns
+ */
+int GetNRecordFields()
+{/*{{{*/
+  return nRecordFields + nUserFields;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the description of the i-th column.
+ * @return Column description
+ */
+const RecordField& GetRecordField(int i)
+{/*{{{*/
+  if( i >= nRecordFields ) return userFields[i - nRecordFields];
+  return recordFields[i];
+}/*}}}*/
+
+
+
+/**
+ * @brief This function looks up a column by its name.
+ * @return Index of the column / -1 : There is no such column
+ */
+int FindRecordField(const char* name)
+{/*{{{*/
+  for(int i = 0; i < GetNRecordFields(); i++)
+    if( strcmp(GetRecordField(i).name, name) == 0 ) return i;
+  return -1;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the size of a column in bytes.
+ * @return Size of the column (all leaf types are 4 bytes wide)
+ */
+size_t GetRecordFieldSize(const RecordField& field)
+{/*{{{*/
+  return 4 * field.count;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function clears every column of the record to zero.
+ */
+void ResetRecord(EventRecord* record)
+{/*{{{*/
+  memset(record, 0, sizeof(EventRecord));
+}/*}}}*/
+
+
+
+/**
+ * @brief This function assigns one branch per column of the record to the given tree.
+ */
+void BookRecordBranches(TTree* tree, EventRecord* record)
+{/*{{{*/
+  char leafList[128];
+
+  for(int i = 0; i < GetNRecordFields(); i++)
+  {
+    const RecordField& field = GetRecordField(i);
+    if( field.count > 1 ) sprintf(leafList, "%s[%d]/%c", field.name, field.count, field.type);
+    else                  sprintf(leafList, "%s/%c", field.name, field.type);
+    tree->Branch(field.name, (char*)record + field.offset, leafList);
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function names the next userVariable slot and appends it to the columns.
+ *        It has to be called before any output is booked.
+ * @return Index of the slot in userVariable / -1 : Every slot is used or the name is taken
+ */
+int AddUserRecordField(const char* name)
+{/*{{{*/
+  if( nUserFields >= kMaxUserVariables || FindRecordField(name) >= 0 || strlen(name) >= 64 ) return -1;
+
+  strcpy(userFieldNames[nUserFields], name);
+  RecordField& field = userFields[nUserFields];
+  field.name   = userFieldNames[nUserFields];
+  field.type   = 'F';
+  field.count  = 1;
+  field.offset = offsetof(EventRecord, userVariable) + nUserFields * sizeof(float);
+  return nUserFields++;
+}/*}}}*/
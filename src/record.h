@@ -0,0 +1,181 @@
+/**
+ * @file      record.h
+ * @brief     Flat per-event output record and its column description.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include <cstddef>
+
+class TTree;
+
+#define kMaxUserVariables 16                // Columns available to the derived variables of the expression file (expression.h)
+
+/**
+ * @brief Plain data holding one row of the ACCTOFInt tree.
+ *
+ * The event loop fills an instance of this structure and hands it over to an output stage.
+ * Every member listed in the record field table (record.cxx) becomes one output column, so the
+ * layout of this structure is the output schema.
+ */
+struct EventRecord
+{
+  unsigned int  nRun;                       // Run number
+  unsigned int  nEvent;                     // Event number
+  unsigned int  nProcessedNumber;           // Number of processed events
+  unsigned int  nLevel1;                    // Number of Level1 triggers
+  unsigned int  nParticle;                  // Number of particles
+  unsigned int  iParticle;                  // Index of the particle described by the record
+  unsigned int  nCharge;                    // Number of charges
+  unsigned int  nTrTrack;                   // Number of the Tracker tracks which are successfully reconstructed
+  unsigned int  nTrdTrack;                  // Number of the TRD tracks which are successfully reconstructed
+  unsigned int  nAntiCluster;               // Number of clusters on the ACC
+  unsigned int  nTofClustersInTime;         // Number of in-time clusters on the TOF
+  unsigned int  nRichRing;                  // Number of successfully reconstructed the RICH rings
+  unsigned int  nRichRingB;                 // Number of successfully reconstructed the RICH rings with algorithm B
+  unsigned int  nBeta;                      // Number of successfully estimated beta(v/c) values
+  unsigned int  nBetaB;                     // Number of successfully estimated beta(v/c) values with algorithm B
+  unsigned int  nBetaH;                     // Number of successfully estimated beta(v/c) values with algorithm H
+  unsigned int  nShower;                    // Number of the ECAL shower objects
+  unsigned int  nVertex;                    // Number of vertices in this event
+  unsigned int  particleType;               // Type of ParticleR
+  float         livetime;                   // Livetime fraction
+  float         utcTime;                    // UTC time
+  float         utcTimeCorrected;           // Corrected UTC time
+  float         orbitAltitude;              // (cm) in GTOD coordinates system.
+  float         orbitLatitude;              // (rad) in GTOD coordinates system.
+  float         orbitLongitude;             // (rad) in GTOD coordinates system.
+  float         orbitLatitudeM;             // (rad) in eccentric dipole coordinate system.
+  float         orbitLongitudeM;            // (rad) in eccentric dipole coordinate system.
+  float         velR;                       // Speed of the ISS in radial direction
+  float         velTheta;                   // Angular speed of the ISS in polar angle direction
+  float         velPhi;                     // Angular speed of the ISS in azimuthal angle direction
+  float         yaw;                        // A parameter describing ISS attitude (tilted angle with respect to the x-axis)
+  float         pitch;                      // A parameter describing ISS attitude (tilted angle with respect to the y-axis)
+  float         roll;                       // A parameter describing ISS attitude (tilted angle with respect to the z-axis)
+  float         gLongitude;                 // Galactic longitude of the incoming particle.
+  float         gLatitude;                  // Galactic latitude of the incoming particle.
+  int           gCoordCalcResult;           // Return value for galactic coordinate calculation.
+  float         sunPosAzimuth;              // Azimuthal angle of the position of the Sun.
+  float         sunPosElevation;            // Elevation angle of the position of the Sun.
+  int           sunPosCalcResult;           // Return value for the Sun's position calculation.
+  unsigned int  unixTime;                   // UNIX time
+  float         weight;                     // Sampling weight of the event (1 without sampling)
+  int           isInShadow;                 // Value for check whether the AMS is in ISS solar panel shadow or not.
+  unsigned int  ptlCharge;                  // ParticleR::Charge value
+  float         ptlMomentum;                // ParticleR::Momentum value
+  float         ptlTheta;                   // Direction of the incoming particle (polar angle)
+  float         ptlPhi;                     // Direction of the incoming particle (azimuthal angle)
+  float         ptlCoo[3];
+  float         ptlCutOffStoermer;
+  float         ptlCutOffDipole;
+  float         ptlCutOffMax[2];
+  float         showerEnergyD;
+  float         showerEnergyE;
+  float         showerBDT;
+  float         showerCofG[3];
+  float         showerCofGDist;
+  float         showerCofGdX;
+  float         showerCofGdY;
+  float         showerEnergy3C[3];          // EcalShowerR::Energy3C, energy fractions within 2, 5 and 8 cm of the shower axis
+  float         showerS13R;                 // EcalShowerR::S13R, lateral ratio of the cell energies
+  float         showerSideLeak;             // Lateral leakage fraction
+  float         showerRearLeak;             // Rear leakage fraction
+  float         showerDifoSum;              // (E_x - E_y) / (E_x + E_y)
+  float         showerChi2Profile;          // Chi2 of the longitudinal profile fit
+  float         showerParProfile[4];        // Parameters of the longitudinal profile fit
+  float         showerChi2Trans;            // Chi2 of the transverse profile fit
+  float         showerSphericityEV[3];      // Eigenvalues of the sphericity tensor
+  int           showerNHits;                // Number of the ECAL hits of the shower
+  int           tofNClusters;
+  int           tofNUsedHits;
+  float         tofBeta;
+  int           isGoodBeta;
+  int           isTkTofMatch;
+  float         tofReducedChisqT;
+  float         tofReducedChisqC;
+  float         tofDepositedEnergyOnLayer[4];
+  float         tofEstimatedChargeOnLayer[4];
+  float         tofCharge;
+  int           trkFitCodeMS;
+  float         trkRigidityMS;
+  float         trkReducedChisquareMS;
+  int           trkFitCodeFS;
+  float         trkRigidityFS;
+  float         trkReducedChisquareFS;
+  int           trkFitCodeInner;
+  float         trkRigidityInner;
+  float         trkReducedChisquareInner;
+  int           trkEdepLayerJXSideOK[9];
+  int           trkEdepLayerJYSideOK[9];
+  float         trkEdepLayerJ[9];
+  float         trkCharge;
+  float         trkInnerCharge;
+  int           richRebuild;
+  int           richIsGood;
+  int           richIsClean;
+  int           richIsNaF;
+  float         richRingWidth;
+  int           richNHits;
+  float         richBeta;
+  float         richBetaError;
+  float         richChargeSquared;
+  float         richKolmogorovProbability;
+  float         richTheta;
+  float         richPhi;
+  int           trdNCluster;
+  int           trdNTracks;
+  float         trdTrackTheta;
+  float         trdTrackPhi;
+  float         trdTrackChi2;
+  int           trdTrackPattern;
+  float         trdTrackCharge;
+  float         trdDepositedEnergyOnLayer[20];
+  int           trdQtNActiveLayer;
+  int           trdQtIsValid;
+  float         trdQtElectronToProtonLogLikelihoodRatio;
+  float         trdQtHeliumToProtonLogLikelihoodRatio;
+  float         trdQtElectronToHeliumLogLikelihoodRatio;
+  int           trdKNRawHits;
+  int           trdKIsReadAlignmentOK;
+  int           trdKIsReadCalibOK;
+  int           trdKNHits;
+  int           trdKIsValid;
+  float         trdKElectronToProtonLogLikelihoodRatio;
+  float         trdKHeliumToProtonLogLikelihoodRatio;
+  float         trdKElectronToHeliumLogLikelihoodRatio;
+  float         trdKCharge;
+  float         trdKChargeError;
+  int           trdKNUsedHitsForCharge;
+  float         trdKAmpLayer[20];
+  float         trdKTotalPathLength;
+  float         trdKElectronLikelihood;
+  float         trdKProtonLikelihood;
+  float         trdKHeliumLikelihood;
+  float         userVariable[kMaxUserVariables];  // Derived variables, named by AddUserRecordField()
+};
+
+/**
+ * @brief Description of one column of EventRecord.
+ *
+ * type follows the ROOT leaflist codes : 'i' (unsigned int), 'I' (int), 'F' (float).
+ */
+struct RecordField
+{
+  const char* name;                         // Column(branch) name
+  char        type;                         // ROOT leaf type code
+  int         count;                        // Number of elements (1 for scalars)
+  size_t      offset;                       // Byte offset inside EventRecord
+};
+
+int                 GetNRecordFields();
+const RecordField&  GetRecordField(int i);
+int                 FindRecordField(const char* name);
+size_t              GetRecordFieldSize(const RecordField& field);
+void                ResetRecord(EventRecord* record);
+void                BookRecordBranches(TTree* tree, EventRecord* record);
+int                 AddUserRecordField(const char* name);
+
+#endif
@@ -0,0 +1,265 @@
+/**
+ * @file      replay.cxx
+ * @brief     Per-file (Run, Event) index and the entry list of the replay mode.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/stat.h>
+
+#include "TChainElement.h"
+
+#ifndef __AMSINC__
+#define __AMSINC__
+#include "amschain.h"
+#include "selector.h"
+#endif
+
+#include "replay.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief Ordering of the index entries by (Run, Event).
+ */
+static bool IsBefore(const EventIndexEntry& a, const EventIndexEntry& b)
+{/*{{{*/
+  if( a.run != b.run ) return a.run < b.run;
+  return a.event < b.event;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function builds the cache file name of an input file.
+ * @return <cache directory>/<sanitized path>.idx
+ */
+static std::string GetCacheFileName(const char* fileName, const char* cacheDirectory)
+{/*{{{*/
+  std::string name(fileName);
+  for(unsigned int i = 0; i < name.size(); i++) if( name[i] == '/' || name[i] == ':' ) name[i] = '_';
+  return std::string(cacheDirectory) + "/" + name + ".idx";
+}/*}}}*/
+
+
+
+/**
+ * @brief This function extracts the run number from an AMS file name (<run>.<sequence>.root).
+ * @return Run number / 0 : The base name does not start with a number
+ */
+static unsigned int GetRunFromFileName(const char* fileName)
+{/*{{{*/
+  const char* baseName = strrchr(fileName, '/');
+  baseName = baseName ? baseName + 1 : fileName;
+
+  char* end;
+  unsigned long run = strtoul(baseName, &end, 10);
+  if( end == baseName || *end != '.' ) return 0;
+  return (unsigned int)run;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads a cached index.
+ * @return true : The cache exists and matches the file / false : The index has to be built
+ */
+bool EventIndex::Load(const std::string& cacheFileName, long long nFileEntries)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(cacheFileName.c_str(), "rb") ) == NULL ) return false;
+
+  char magic[8];
+  long long nCachedFileEntries = -1, nIndexEntries = 0;
+  bool good = fread(magic, 8, 1, fp) == 1 && memcmp(magic, EVENTINDEX_MAGIC, 8) == 0
+           && fread(&nCachedFileEntries, sizeof(long long), 1, fp) == 1 && nCachedFileEntries == nFileEntries
+           && fread(&nIndexEntries, sizeof(long long), 1, fp) == 1;
+
+  if( good )
+  {
+    entries.resize(nIndexEntries);
+    good = nIndexEntries == 0 || fread(&entries[0], sizeof(EventIndexEntry), nIndexEntries, fp) == (size_t)nIndexEntries;
+  }
+  fclose(fp);
+
+  if( !good ) entries.clear();
+  return good;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the index into the cache. (Written to a temporary name first, so a crash leaves no broken cache.)
+ * @return true : The cache is written / false : The cache can not be written
+ */
+bool EventIndex::Save(const std::string& cacheFileName, long long nFileEntries)
+{/*{{{*/
+  std::string temporaryName = cacheFileName + ".tmp";
+  FILE* fp;
+  if( ( fp = fopen(temporaryName.c_str(), "wb") ) == NULL ) return false;
+
+  long long nIndexEntries = entries.size();
+  fwrite(EVENTINDEX_MAGIC, 8, 1, fp);
+  fwrite(&nFileEntries, sizeof(long long), 1, fp);
+  fwrite(&nIndexEntries, sizeof(long long), 1, fp);
+  if( nIndexEntries > 0 ) fwrite(&entries[0], sizeof(EventIndexEntry), nIndexEntries, fp);
+  bool good = ( fclose(fp) == 0 );
+
+  return good && rename(temporaryName.c_str(), cacheFileName.c_str()) == 0;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function scans the headers of every entry of the file.
+ * @return true : The index is built / false : The file can not be read
+ */
+bool EventIndex::Build(const char* fileName)
+{/*{{{*/
+  AMSChain chain;
+  if( chain.Add(fileName) != 1 ) return false;
+
+  Long64_t nFileEntries = chain.GetEntries();
+  entries.clear();
+  entries.reserve(nFileEntries);
+
+  for(Long64_t e = 0; e < nFileEntries; e++)
+  {
+    AMSEventR* pev = chain.GetEvent(e);
+    if( !pev ) continue;
+
+    EventIndexEntry entry;
+    entry.run   = pev->Run();
+    entry.event = pev->Event();
+    entry.entry = e;
+    entries.push_back(entry);
+  }
+
+  std::sort(entries.begin(), entries.end(), IsBefore);
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function loads the index of the file from the cache, or builds and caches it.
+ * @return true : The index is ready / false : The index could not be built
+ */
+bool EventIndex::Open(const char* fileName, long long nFileEntries, const char* cacheDirectory)
+{/*{{{*/
+  std::string cacheFileName = GetCacheFileName(fileName, cacheDirectory);
+  if( Load(cacheFileName, nFileEntries) ) return true;
+
+  std::cout << "[" << releaseName << "] Building the event index of [" << fileName << "]" << std::endl;
+  if( !Build(fileName) ) return false;
+
+  if( mkdir(cacheDirectory, 0755) != 0 && errno != EEXIST )
+    std::cerr << "[" << releaseName << "] WARNING   : Failed to create the index cache directory [" << cacheDirectory << "]." << std::endl;
+  else if( !Save(cacheFileName, nFileEntries) )
+    std::cerr << "[" << releaseName << "] WARNING   : Failed to write the index cache [" << cacheFileName << "]." << std::endl;
+
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function looks up an event.
+ * @return Local entry of the event / -1 : The event is not in this file
+ */
+long long EventIndex::Find(unsigned int run, unsigned int event) const
+{/*{{{*/
+  EventIndexEntry key;
+  key.run   = run;
+  key.event = event;
+  key.entry = 0;
+
+  std::vector<EventIndexEntry>::const_iterator found = std::lower_bound(entries.begin(), entries.end(), key, IsBefore);
+  if( found == entries.end() || found->run != run || found->event != event ) return -1;
+  return found->entry;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function translates a list of (Run, Event) pairs into global entries of the chain.
+ *
+ * The event list file has one "<run> <event>" pair per line. Lines starting with '#' are ignored.
+ * Files whose name starts with a run number which is not in the list are skipped without being indexed.
+ *
+ * @return true : The entry list is built (events which are not found are reported) / false : The event list can not be read
+ */
+bool BuildReplayEntryList(AMSChain& chain, const char* eventListFileName, const char* cacheDirectory, std::vector<long long>& entryList)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(eventListFileName, "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open the event list [" << eventListFileName << "]!" << std::endl;
+    return false;
+  }
+
+  std::vector<EventIndexEntry> wanted;
+  char line[256];
+  while( fgets(line, 256, fp) != NULL )
+  {
+    EventIndexEntry pair;
+    if( line[0] == '#' ) continue;
+    if( sscanf(line, "%u %u", &pair.run, &pair.event) != 2 ) continue;
+    pair.entry = -1;
+    wanted.push_back(pair);
+  }
+  fclose(fp);
+
+  std::sort(wanted.begin(), wanted.end(), IsBefore);
+  std::cout << "[" << releaseName << "] " << wanted.size() << " events are requested for the replay." << std::endl;
+
+  chain.GetEntries();                                       // Fills the tree offsets of the chain
+  Long64_t*  treeOffsets = chain.GetTreeOffset();
+  TObjArray* files       = chain.GetListOfFiles();
+
+  for(int i = 0; i < files->GetEntries(); i++)
+  {
+    const char*  fileName = ((TChainElement*)files->At(i))->GetTitle();
+    unsigned int fileRun  = GetRunFromFileName(fileName);
+
+    bool needed = false;
+    for(unsigned int w = 0; w < wanted.size() && !needed; w++)
+      needed = ( wanted[w].entry < 0 ) && ( fileRun == 0 || wanted[w].run == fileRun );
+    if( !needed ) continue;
+
+    EventIndex index;
+    if( !index.Open(fileName, treeOffsets[i+1] - treeOffsets[i], cacheDirectory) )
+    {
+      std::cerr << "[" << releaseName << "] WARNING   : Failed to index [" << fileName << "]. It is skipped." << std::endl;
+      continue;
+    }
+
+    for(unsigned int w = 0; w < wanted.size(); w++)
+    {
+      if( wanted[w].entry >= 0 ) continue;
+      long long localEntry = index.Find(wanted[w].run, wanted[w].event);
+      if( localEntry >= 0 ) wanted[w].entry = treeOffsets[i] + localEntry;
+    }
+  }
+
+  entryList.clear();
+  for(unsigned int w = 0; w < wanted.size(); w++)
+  {
+    if( wanted[w].entry >= 0 ) entryList.push_back(wanted[w].entry);
+    else std::cerr << "[" << releaseName << "] WARNING   : Run " << wanted[w].run << " Event " << wanted[w].event << " is not found in the input files." << std::endl;
+  }
+
+  // Read the chain forwards.
+  std::sort(entryList.begin(), entryList.end());
+  entryList.erase(std::unique(entryList.begin(), entryList.end()), entryList.end());
+
+  std::cout << "[" << releaseName << "] " << entryList.size() << " events are found for the replay." << std::endl;
+  return true;
+}/*}}}*/
@@ -0,0 +1,50 @@
+/**
+ * @file      replay.h
+ * @brief     Random-access replay of explicit (Run, Event) lists through a cached per-file index.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <string>
+#include <vector>
+
+class AMSChain;
+
+#define EVENTINDEX_MAGIC "ACCTIDX1"
+
+/**
+ * @brief (Run, Event) -> local entry of one input file.
+ */
+struct EventIndexEntry
+{
+  unsigned int        run;
+  unsigned int        event;
+  long long           entry;                // Entry in the tree of the file
+};
+
+/**
+ * @brief Sorted (Run, Event) index of one input file, built once and cached on the disk.
+ *
+ * Cache file : <cache directory>/<file path with '/' and ':' replaced by '_'>.idx
+ *   char[8] EVENTINDEX_MAGIC, long long nFileEntries, long long nIndexEntries, EventIndexEntry[nIndexEntries]
+ * A cache whose nFileEntries does not match the file is rebuilt.
+ */
+class EventIndex
+{
+  std::vector<EventIndexEntry>  entries;
+
+  bool Load(const std::string& cacheFileName, long long nFileEntries);
+  bool Save(const std::string& cacheFileName, long long nFileEntries);
+  bool Build(const char* fileName);
+
+public:
+  bool      Open(const char* fileName, long long nFileEntries, const char* cacheDirectory);
+  long long Find(unsigned int run, unsigned int event) const;
+  size_t    GetSize() const { return entries.size(); }
+};
+
+bool BuildReplayEntryList(AMSChain& chain, const char* eventListFileName, const char* cacheDirectory, std::vector<long long>& entryList);
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file      sampling.cxx
+ * @brief     Entry lists of the cluster, prescale and random sampling modes.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cmath>
+
+#include "TTree.h"
+
+#ifndef __AMSINC__
+#define __AMSINC__
+#include "amschain.h"
+#include "selector.h"
+#endif
+
+#include "sampling.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief Deterministic uniform number in [0, 1) for a key. (SplitMix64 finalizer)
+ */
+static double GetUniform(unsigned long long seed, unsigned long long key)
+{/*{{{*/
+  unsigned long long z = seed * 0x9E3779B97F4A7C15ULL + key + 0x632BE59BD9B4E019ULL;
+  z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+  z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+  z = z ^ ( z >> 31 );
+  return ( z >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}/*}}}*/
+
+
+
+double BuildSampleEntryList(AMSChain& chain, int mode, double fraction, unsigned int seed, std::vector<long long>& entryList)
+{/*{{{*/
+  static const char* modeNames[] = { "none", "cluster", "prescale", "random" };
+
+  Long64_t nChainEntries = chain.GetEntries();
+  entryList.clear();
+
+  if( mode == kSamplingCluster )
+  {
+    // Every file of the chain is visited, so that the sample covers all runs and orbit positions.
+    Long64_t* treeOffsets = chain.GetTreeOffset();
+    int       nTrees      = chain.GetNtrees();
+    for(int t = 0; t < nTrees; t++)
+    {
+      if( chain.LoadTree(treeOffsets[t]) < 0 ) continue;
+      TTree* tree = chain.GetTree();
+      Long64_t nTreeEntries = tree->GetEntries();
+
+      TTree::TClusterIterator cluster = tree->GetClusterIterator(0);
+      Long64_t start;
+      while( ( start = cluster() ) < nTreeEntries )
+      {
+        Long64_t end = cluster.GetNextEntry();
+        if( end > nTreeEntries ) end = nTreeEntries;
+        if( GetUniform(seed, treeOffsets[t] + start) >= fraction ) continue;
+        for(Long64_t e = start; e < end; e++) entryList.push_back(treeOffsets[t] + e);
+      }
+    }
+  }
+  else if( mode == kSamplingPrescale )
+  {
+    Long64_t prescale = (Long64_t)floor(1. / fraction + 0.5);
+    if( prescale < 1 ) prescale = 1;
+    Long64_t phase = (Long64_t)( GetUniform(seed, 0) * prescale );
+    for(Long64_t e = phase; e < nChainEntries; e += prescale) entryList.push_back(e);
+  }
+  else if( mode == kSamplingRandom )
+  {
+    for(Long64_t e = 0; e < nChainEntries; e++)
+      if( GetUniform(seed, e) < fraction ) entryList.push_back(e);
+  }
+
+  std::cout << "[" << releaseName << "] SAMPLING : " << modeNames[mode] << ", " << entryList.size() << " of " << nChainEntries
+            << " entries (" << ( nChainEntries > 0 ? 100. * entryList.size() / nChainEntries : 0. ) << "%)" << std::endl;
+
+  if( entryList.empty() ) return 0.;
+  return (double)nChainEntries / entryList.size();
+}/*}}}*/
@@ -0,0 +1,32 @@
+/**
+ * @file      sampling.h
+ * @brief     Quick-look sampling of a deterministic subset spread over every file of the chain.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _SAMPLING_H_
+#define _SAMPLING_H_
+
+#include <vector>
+
+class AMSChain;
+
+enum SamplingMode
+{
+  kSamplingNone     = 0,
+  kSamplingCluster  = 1,            // Whole basket clusters are taken or skipped (only the taken baskets are read)
+  kSamplingPrescale = 2,            // Every N-th entry, N = 1 / fraction, with a seeded phase
+  kSamplingRandom   = 3             // Every entry with the probability fraction
+};
+
+/**
+ * @brief This function builds the entry list of the sample.
+ *
+ * The choices are a hash of (seed, entry), so the same seed gives the same sample. The weight of every
+ * sampled event is nChainEntries / nSampledEntries, so that weighted counts estimate the full chain.
+ *
+ * @return Weight of the sampled events / 0 : Nothing was sampled
+ */
+double BuildSampleEntryList(AMSChain& chain, int mode, double fraction, unsigned int seed, std::vector<long long>& entryList);
+
+#endif
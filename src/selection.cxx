@@ -0,0 +1,440 @@
+/**
+ * @file      selection.cxx
+ * @brief     Parser and evaluation of the named selections of the multi-selection mode.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "TH1D.h"
+#include "TString.h"
+
+#ifndef __AMSINC__
+#define __AMSINC__
+#include "amschain.h"
+#include "selector.h"
+#endif
+
+#include "writer.h"
+#include "selection.h"
+
+extern char releaseName[16];
+
+/**
+ * @brief Names of the cuts in the selection file and the default labels of their cut flow bins.
+ */
+static const struct
+{
+  const char*   name;
+  int           type;
+  bool          range;              // The cut takes <min> <max>
+  const char*   label;
+} cutDefinitions[kNCutTypes] =
+{
+  { "science-run",     kCutScienceRun,     false, "Science-run check" },
+  { "hardware",        kCutHardwareStatus, false, "DAQ H/W status check" },
+  { "physics-trigger", kCutPhysicsTrigger, false, "Unbiased physics trigger check" },
+  { "single-particle", kCutSingleParticle, false, "Multiple particles" },
+  { "trk-alignment",   kCutTrkAlignment,   false, "Tracker alignment test" },
+  { "outside-saa",     kCutOutsideSAA,     false, "SAA rejection" },
+  { "good-track",      kCutGoodTrTrack,    false, "Good track test" },
+  { "good-beta",       kCutGoodBeta,       false, "Good beta test" },
+  { "charge",          kCutCharge,         true,  "Charge" },
+  { "momentum",        kCutMomentum,       true,  "Momentum" },
+  { "beta",            kCutBeta,           true,  "Beta" }
+};
+
+// The cut chain of the program before the multi-selection mode. It is used when no selection file is given.
+static const int defaultCuts[] = { kCutScienceRun, kCutHardwareStatus, kCutPhysicsTrigger, kCutSingleParticle,
+                                   kCutTrkAlignment, kCutGoodTrTrack, kCutOutsideSAA };
+
+
+
+/**
+ * @brief This function builds a cut of the given type.
+ */
+static SelectionCut MakeCut(int type, float min = 0., float max = 0.)
+{/*{{{*/
+  SelectionCut cut;
+  cut.type  = type;
+  cut.min   = min;
+  cut.max   = max;
+  cut.label = cutDefinitions[type].label;
+  if( cutDefinitions[type].range ) cut.label += Form(" [%g, %g]", min, max);
+  return cut;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function checks whether two cuts are the same cut.
+ */
+static bool IsSameCut(const SelectionCut& a, const SelectionCut& b)
+{/*{{{*/
+  return a.type == b.type && a.min == b.min && a.max == b.max;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function creates an empty selection.
+ */
+static Selection* NewSelection(const char* name, int particleMode)
+{/*{{{*/
+  Selection* selection = new Selection;
+  selection->name              = name;
+  selection->particleMode      = particleMode;
+  selection->nLeadingEventCuts = 0;
+  selection->hCutFlow          = NULL;
+  selection->hRunStart         = NULL;
+  selection->sink              = NULL;
+  selection->writer            = NULL;
+  selection->nStored           = 0;
+  selection->eventAccepted     = false;
+  selection->candidateAccepted = false;
+  return selection;
+}/*}}}*/
+
+
+
+SelectionSet::SelectionSet()
+  : prefixLength(0), event(NULL), weight(1.)
+{/*{{{*/
+}/*}}}*/
+
+
+
+/**
+ * @brief The cut flows, sinks and writers are owned by main(). Only the selections are deleted here.
+ */
+SelectionSet::~SelectionSet()
+{/*{{{*/
+  for(unsigned int i = 0; i < selections.size(); i++) delete selections[i];
+}/*}}}*/
+
+
+
+/**
+ * @brief This function adds the default selection : the single-particle cut chain of the program.
+ * @return true
+ */
+bool SelectionSet::AddDefault()
+{/*{{{*/
+  Selection* selection = NewSelection("default", kParticlesFirst);
+  for(unsigned int i = 0; i < sizeof(defaultCuts) / sizeof(int); i++) selection->cuts.push_back(MakeCut(defaultCuts[i]));
+  selections.push_back(selection);
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads the selections from a text file.
+ *
+ *   # Comment
+ *   selection <name> [first|all]     Starts a selection. (first : only the first particle, all : every particle)
+ *   <cut> [<min> <max>]              Appends a cut to the current selection. (see CutType)
+ *
+ * @return true : The selections are read / false : The file can not be opened or has an error
+ */
+bool SelectionSet::Load(const char* fileName)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(fileName, "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open the selection file [" << fileName << "]!" << std::endl;
+    return false;
+  }
+
+  char line[256];
+  int  nLine = 0;
+  bool good  = true;
+  Selection* current = NULL;
+
+  while( good && fgets(line, 256, fp) != NULL )
+  {
+    nLine++;
+    char  keyword[64], argument[64];
+    float min, max;
+    int   nItems = sscanf(line, "%63s %63s", keyword, argument);
+    if( nItems < 1 || keyword[0] == '#' ) continue;
+
+    if( strcmp(keyword, "selection") == 0 )
+    {
+      if( nItems < 2 ) { good = false; break; }
+
+      int particleMode = kParticlesFirst;
+      char mode[64] = "first";
+      sscanf(line, "%*s %*s %63s", mode);
+      if( strcmp(mode, "all") == 0 ) particleMode = kParticlesAll;
+      else if( strcmp(mode, "first") != 0 ) { good = false; break; }
+
+      current = NewSelection(argument, particleMode);
+      selections.push_back(current);
+      continue;
+    }
+
+    int type = -1;
+    for(int t = 0; t < kNCutTypes; t++) if( strcmp(keyword, cutDefinitions[t].name) == 0 ) type = t;
+    if( type < 0 || !current ) { good = false; break; }
+
+    if( cutDefinitions[type].range )
+    {
+      if( sscanf(line, "%*s %f %f", &min, &max) != 2 ) { good = false; break; }
+      current->cuts.push_back(MakeCut(type, min, max));
+    }
+    else current->cuts.push_back(MakeCut(type));
+  }
+  fclose(fp);
+
+  if( !good )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Syntax error in the selection file [" << fileName << "] line " << nLine << "!" << std::endl;
+    return false;
+  }
+  if( selections.empty() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : No selection is defined in [" << fileName << "]!" << std::endl;
+    return false;
+  }
+
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function finds the shared prefix and books the cut flow of every selection.
+ */
+void SelectionSet::Book()
+{/*{{{*/
+  for(unsigned int s = 0; s < selections.size(); s++)
+  {
+    Selection* selection = selections[s];
+    selection->nLeadingEventCuts = 0;
+    while( selection->nLeadingEventCuts < selection->cuts.size() && selection->cuts[selection->nLeadingEventCuts].type < kNEventCuts )
+      selection->nLeadingEventCuts++;
+
+    unsigned int nCuts = selection->cuts.size();
+    selection->hCutFlow = new TH1D("hEvtCounter", "Event Collecting Status", nCuts, 0., (float)nCuts);
+    for(unsigned int c = 0; c < nCuts; c++) selection->hCutFlow->GetXaxis()->SetBinLabel(c + 1, selection->cuts[c].label.c_str());
+  }
+
+  prefixLength = selections[0]->nLeadingEventCuts;
+  for(unsigned int s = 1; s < selections.size(); s++)
+  {
+    unsigned int length = 0;
+    while( length < prefixLength && length < selections[s]->nLeadingEventCuts && IsSameCut(selections[0]->cuts[length], selections[s]->cuts[length]) )
+      length++;
+    prefixLength = length;
+  }
+
+  std::cout << "[" << releaseName << "] " << selections.size() << " selection(s), " << prefixLength << " shared cut(s) :";
+  for(unsigned int s = 0; s < selections.size(); s++) std::cout << " " << selections[s]->name << "(" << selections[s]->cuts.size() << ")";
+  std::cout << std::endl;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function evaluates one cut on the current event. Event-level results are kept until the next event.
+ * @return true : Passed / false : Rejected
+ */
+bool SelectionSet::PassCut(const SelectionCut& cut, int iParticle)
+{/*{{{*/
+  if( cut.type < kNEventCuts )
+  {
+    int& result = eventCutResult[cut.type];
+    if( result >= 0 ) return result == 1;
+
+    bool pass = false;
+    switch( cut.type )
+    {
+      case kCutScienceRun:     pass = IsScienceRun(event); break;
+      case kCutHardwareStatus: pass = IsHardwareStatusGood(event); break;
+      case kCutPhysicsTrigger: pass = !IsUnbiasedPhysicsTriggerEvent(event); break;
+      case kCutSingleParticle: pass = ( event->nParticle() == 1 ); break;
+      case kCutTrkAlignment:   pass = IsTrkAlignmentGood(event); break;
+      case kCutOutsideSAA:     pass = !event->IsInSAA(); break;
+      default: break;
+    }
+    result = pass ? 1 : 0;
+    return pass;
+  }
+
+  ParticleR* particle = event->pParticle(iParticle);
+  if( !particle ) return false;
+
+  switch( cut.type )
+  {
+    case kCutGoodTrTrack: return IsGoodTrTrack(event, iParticle);
+    case kCutGoodBeta:    return IsGoodBeta(event, iParticle);
+    case kCutCharge:      return particle->Charge >= cut.min && particle->Charge <= cut.max;
+    case kCutMomentum:    return particle->Momentum >= cut.min && particle->Momentum <= cut.max;
+    case kCutBeta:        return particle->Beta >= cut.min && particle->Beta <= cut.max;
+    default: break;
+  }
+
+  return false;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function finds the cut of the shared prefix which rejects an event, from event-level results known
+ *        before the event is read (results[type] : -1 : Unknown, 0 : Failed, 1 : Passed).
+ * @return Position of the rejecting cut in the prefix / -1 : The event can not be rejected without reading it
+ */
+int SelectionSet::FindEarlyRejection(const signed char* results) const
+{/*{{{*/
+  for(unsigned int c = 0; c < prefixLength; c++)
+  {
+    int type = selections[0]->cuts[c].type;
+    if( type >= kNEventCuts || results[type] < 0 ) return -1;
+    if( results[type] == 0 ) return c;
+  }
+  return -1;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function counts an event rejected at the given position of the shared prefix without reading it.
+ */
+void SelectionSet::RejectEarly(int position)
+{/*{{{*/
+  for(unsigned int s = 0; s < selections.size(); s++)
+  {
+    for(int c = 0; c < position; c++) selections[s]->hCutFlow->Fill(c, weight);
+    selections[s]->eventAccepted = false;
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function evaluates the shared prefix once and then the leading event-level cuts of every selection.
+ *        The event-level results which are already known (e.g. from the block cuts, blockcuts.h) are not evaluated again.
+ * @return true : At least one selection is still open for the event / false : Every selection rejected the event
+ */
+bool SelectionSet::BeginEvent(AMSEventR* pev, const signed char* results)
+{/*{{{*/
+  event = pev;
+  for(int c = 0; c < kNEventCuts; c++) eventCutResult[c] = results ? results[c] : -1;
+
+  for(unsigned int c = 0; c < prefixLength; c++)
+  {
+    if( !PassCut(selections[0]->cuts[c], 0) )
+    {
+      for(unsigned int s = 0; s < selections.size(); s++) selections[s]->eventAccepted = false;
+      return false;
+    }
+    for(unsigned int s = 0; s < selections.size(); s++) selections[s]->hCutFlow->Fill(c, weight);
+  }
+
+  bool open = false;
+  for(unsigned int s = 0; s < selections.size(); s++)
+  {
+    Selection* selection = selections[s];
+    selection->eventAccepted = true;
+    for(unsigned int c = prefixLength; c < selection->nLeadingEventCuts; c++)
+    {
+      if( !PassCut(selection->cuts[c], 0) ) { selection->eventAccepted = false; break; }
+      selection->hCutFlow->Fill(c, weight);
+    }
+    open |= selection->eventAccepted;
+  }
+
+  return open;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the number of particles which have to be tried for the current event.
+ */
+int SelectionSet::GetNCandidates()
+{/*{{{*/
+  int nParticle = event->nParticle();
+  int nCandidates = 0;
+
+  for(unsigned int s = 0; s < selections.size(); s++)
+  {
+    if( !selections[s]->eventAccepted ) continue;
+    int n = ( selections[s]->particleMode == kParticlesAll ) ? nParticle : ( nParticle > 0 ? 1 : 0 );
+    if( n > nCandidates ) nCandidates = n;
+  }
+
+  return nCandidates;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function evaluates the remaining cuts of every selection on one particle.
+ *
+ * The record of a candidate needs the track and the beta of the particle. A selection without the good-track
+ * and good-beta cuts can pass a particle without them; it is rejected before the last bin of the cut flow is
+ * filled, so that the last bin always counts the stored candidates.
+ *
+ * @return true : At least one selection accepts the particle
+ */
+bool SelectionSet::SelectParticle(int iParticle)
+{/*{{{*/
+  bool accepted = false;
+  ParticleR* particle = event->pParticle(iParticle);
+  bool storable = particle && particle->pBetaH() && particle->pTrTrack();
+
+  for(unsigned int s = 0; s < selections.size(); s++)
+  {
+    Selection* selection = selections[s];
+    selection->candidateAccepted = false;
+    if( !selection->eventAccepted ) continue;
+    if( selection->particleMode == kParticlesFirst && iParticle > 0 ) continue;
+
+    unsigned int c;
+    for(c = selection->nLeadingEventCuts; c < selection->cuts.size(); c++)
+    {
+      if( !PassCut(selection->cuts[c], iParticle) ) break;
+      if( c + 1 == selection->cuts.size() && !storable ) break;
+      selection->hCutFlow->Fill(c, weight);
+    }
+
+    selection->candidateAccepted = ( c == selection->cuts.size() ) && storable;
+    accepted |= selection->candidateAccepted;
+  }
+
+  return accepted;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function copies the acceptance of the current particle by every selection, for a later Commit().
+ */
+void SelectionSet::GetAccepted(unsigned char* accepted) const
+{/*{{{*/
+  for(unsigned int s = 0; s < selections.size(); s++) accepted[s] = selections[s]->candidateAccepted;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function hands a copy of the record to the writer of every selection which accepted the current particle,
+ *        or which accepted the particle of the record according to accepted (GetAccepted()).
+ */
+void SelectionSet::Commit(const EventRecord& record, const unsigned char* accepted)
+{/*{{{*/
+  for(unsigned int s = 0; s < selections.size(); s++)
+  {
+    Selection* selection = selections[s];
+    if( accepted ? !accepted[s] : !selection->candidateAccepted ) continue;
+
+    EventRecord* rec = selection->writer->Acquire();
+    *rec = record;
+    rec->nProcessedNumber = selection->nStored++;
+    selection->writer->Commit(rec);
+  }
+}/*}}}*/
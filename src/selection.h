@@ -0,0 +1,119 @@
+/**
+ * @file      selection.h
+ * @brief     Named selections (cut chains) evaluated together in one pass over the input.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _SELECTION_H_
+#define _SELECTION_H_
+
+#include <string>
+#include <vector>
+
+#include "record.h"
+
+class AMSEventR;
+class TH1D;
+class OutputSink;
+class RecordWriter;
+
+enum CutType
+{
+  // Event-level cuts
+  kCutScienceRun      = 0,          // science-run     : IsScienceRun()
+  kCutHardwareStatus  = 1,          // hardware        : IsHardwareStatusGood()
+  kCutPhysicsTrigger  = 2,          // physics-trigger : rejects IsUnbiasedPhysicsTriggerEvent()
+  kCutSingleParticle  = 3,          // single-particle : nParticle() == 1
+  kCutTrkAlignment    = 4,          // trk-alignment   : IsTrkAlignmentGood()
+  kCutOutsideSAA      = 5,          // outside-saa     : rejects IsInSAA()
+  kNEventCuts         = 6,
+  // Particle-level cuts
+  kCutGoodTrTrack     = 6,          // good-track      : IsGoodTrTrack()
+  kCutGoodBeta        = 7,          // good-beta       : IsGoodBeta()
+  kCutCharge          = 8,          // charge <min> <max>   : ParticleR::Charge
+  kCutMomentum        = 9,          // momentum <min> <max> : ParticleR::Momentum (GeV/c, signed)
+  kCutBeta            = 10,         // beta <min> <max>     : ParticleR::Beta
+  kNCutTypes          = 11
+};
+
+enum ParticleMode
+{
+  kParticlesFirst = 0,              // Only pParticle(0)
+  kParticlesAll   = 1               // Every particle of the event is a candidate
+};
+
+/**
+ * @brief One step of a cut chain.
+ */
+struct SelectionCut
+{
+  int           type;               // One of CutType
+  float         min;                // Range of the range cuts
+  float         max;
+  std::string   label;              // Bin label of the cut flow
+};
+
+/**
+ * @brief A named cut chain with its own output and cut flow.
+ *
+ * The cut flow has one bin per cut. The event-level cuts which come before the first particle-level
+ * cut count events; the later cuts count (event, particle) candidates. A particle without a track or a beta
+ * can not be stored and is not counted in the last bin, which therefore counts the stored candidates.
+ */
+struct Selection
+{
+  std::string                 name;
+  int                         particleMode;
+  std::vector<SelectionCut>   cuts;
+  unsigned int                nLeadingEventCuts;  // Number of event-level cuts before the first particle-level cut
+
+  TH1D*                       hCutFlow;
+  TH1D*                       hRunStart;          // Snapshot of hCutFlow at the beginning of the current run
+  OutputSink*                 sink;
+  RecordWriter*               writer;
+  unsigned long               nStored;
+
+  bool                        eventAccepted;      // The leading event-level cuts are passed by the current event
+  bool                        candidateAccepted;  // The current particle is accepted
+};
+
+/**
+ * @brief The selections of the job.
+ *
+ * The cuts at the beginning of the chains which are common to every selection (the shared prefix)
+ * are evaluated once per event. Every event-level cut is evaluated at most once per event even when
+ * several selections use it.
+ */
+class SelectionSet
+{
+  std::vector<Selection*>   selections;
+  unsigned int              prefixLength;         // Number of the leading cuts shared by every selection
+  AMSEventR*                event;
+  int                       eventCutResult[kNEventCuts];  // -1 : Not evaluated yet, 0 : Failed, 1 : Passed
+  double                    weight;               // Weight of the cut flow entries (sampling weight)
+
+  bool PassCut(const SelectionCut& cut, int iParticle);
+
+public:
+  SelectionSet();
+  ~SelectionSet();
+
+  bool AddDefault();
+  bool Load(const char* fileName);
+  void Book();
+  void SetWeight(double weight) { this->weight = weight; }
+
+  unsigned int GetSize() const { return selections.size(); }
+  Selection*   GetSelection(unsigned int i) { return selections[i]; }
+
+  int  FindEarlyRejection(const signed char* results) const;
+  void RejectEarly(int position);
+
+  bool BeginEvent(AMSEventR* pev, const signed char* results = NULL);
+  int  GetNCandidates();
+  bool SelectParticle(int iParticle);
+  void GetAccepted(unsigned char* accepted) const;
+  void Commit(const EventRecord& record, const unsigned char* accepted = NULL);
+};
+
+#endif
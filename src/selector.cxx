@@ -4,10 +4,25 @@
 #include "selector.h"
 #endif
 
+#include "setupcache.h"
+
+
+
+/**
+ * @brief This function asks the bad-run list of the setup, through the setup cache when the run is cached.
+ * @return true : The run is a bad run / false : The run is not a bad run
+ */
+static bool IsBadRunInSetup(AMSEventR* thisEvent)
+{/*{{{*/
+  bool badRun;
+  if( setupCache && setupCache->GetBadRun(thisEvent->fHeader.Run, badRun) ) return badRun;
+  return thisEvent->isBadRun(thisEvent->fHeader.Run);
+}/*}}}*/
+
 
 /**
  * @brief   This function checks whether current event contained in bad-run.
- * @return  true : The event is contained in bad-run. (Therefore, it should be rejected.) / false : The event is good to analyze further.
+ * @return  true : The event is contained in bad-run. (The event loop stops so that the outputs are closed.) / false : The event is good to analyze further.
  */
 bool IsBadRun(AMSEventR* thisEvent)
 {/*{{{*/
@@ -15,22 +30,22 @@ bool IsBadRun(AMSEventR* thisEvent)
   if( thisEvent->fHeader.Run == 1306219312 || thisEvent->fHeader.Run == 1306219522 || thisEvent->fHeader.Run == 1306233745 )
   {
     printf("The program is aborted due to input run: %d is a bad run(1).\n", runNumber);
-    exit(0);
+    return true;
   }
   else if( thisEvent->fHeader.Run >= 1307125541 && thisEvent->fHeader.Run <= 1307218054 )
   {
     printf("The program is aborted due to input run: %d is a bad run(2).\n", runNumber);
-    exit(0);
+    return true;
   }
   else if( thisEvent->fHeader.Run == 132119816 )
   {
     printf("The program is aborted due to input run: %d is a bad run(3).\n", runNumber);
-    exit(0);
+    return true;
   }
-  else if( thisEvent->isBadRun(thisEvent->fHeader.Run) )
+  else if( IsBadRunInSetup(thisEvent) )
   {
     printf("The program is aborted due to input run: %d is a bad run(4).\n", runNumber);
-    exit(0);
+    return true;
   }
   else
     return false;
@@ -126,10 +141,12 @@ bool IsACCPatternGood(AMSEventR* thisEvent)
  * @brief
  * @return
  */
-bool IsGoodBeta(AMSEventR* thisEvent)
+bool IsGoodBeta(AMSEventR* thisEvent, int iParticle)
 {/*{{{*/
-  ParticleR* pParticle = thisEvent->pParticle(0);
+  ParticleR* pParticle = thisEvent->pParticle(iParticle);
+  if( !pParticle ) return false;
   BetaR* pBeta = pParticle->pBeta();
+  if( !pBeta ) return false;
 
   if( pBeta->Pattern > 5 )
     return false;
@@ -178,10 +195,10 @@ bool IsInSolarArrays(AMSEventR* thisEvent)
  * @brief
  * @return
  */
-bool IsGoodTrTrack(AMSEventR* thisEvent)
+bool IsGoodTrTrack(AMSEventR* thisEvent, int iParticle)
 {/*{{{*/
   bool debugMode = false;
-  TrTrackR* pTrTrack = thisEvent->pParticle(0)->pTrTrack(); // Choose ParticleR associated TrTrack.
+  TrTrackR* pTrTrack = thisEvent->pParticle(iParticle)->pTrTrack(); // Choose ParticleR associated TrTrack.
 
   if( !pTrTrack )
   {
@@ -282,6 +299,10 @@ bool IsShowerTrackMatched(AMSEventR* thisEvent)
  */
 bool IsTrkAlignmentGood(AMSEventR* thisEvent)
 {/*{{{*/
+  float dL1y, dL9y;
+  if( setupCache && setupCache->GetAlignment(thisEvent->Run(), thisEvent->UTime(), dL1y, dL9y) )
+    return !( dL1y > 35 || dL9y > 45 );
+
   AMSPoint pn1, pn9, pd1, pd9;
   thisEvent->GetRTIdL1L9(0, pn1, pd1, thisEvent->UTime(), 60);
   thisEvent->GetRTIdL1L9(1, pn9, pd9, thisEvent->UTime(), 60);
@@ -3,10 +3,10 @@ bool IsScienceRun(AMSEventR*);
 bool IsHardwareStatusGood(AMSEventR*);
 bool IsUnbiasedPhysicsTriggerEvent(AMSEventR*);
 bool IsACCPatternGood(AMSEventR*);
-bool IsGoodBeta(AMSEventR*);
+bool IsGoodBeta(AMSEventR*, int iParticle = 0);
 bool IsGoodLiveTime(AMSEventR*);
 bool IsInSouthAtlanticAnomaly(AMSEventR*);
 bool IsInSolarArrays(AMSEventR*);
-bool IsGoodTrTrack(AMSEventR*);
+bool IsGoodTrTrack(AMSEventR*, int iParticle = 0);
 bool IsShowerTrackMatched(AMSEventR*);
 bool IsTrkAlignmentGood(AMSEventR*);
@@ -0,0 +1,345 @@
+/**
+ * @file      setupcache.cxx
+ * @brief     Memory-mapped per-run setup cache and its warm-up command.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef __AMSINC__
+#define __AMSINC__
+#include "amschain.h"
+#include "selector.h"
+#endif
+
+#include "setupcache.h"
+
+extern char releaseName[16];
+
+SetupCache* setupCache = NULL;
+
+
+
+/**
+ * @brief This function builds the name of the cache file of a run.
+ */
+static std::string GetCacheFileName(const std::string& directory, unsigned int run)
+{/*{{{*/
+  char name[32];
+  sprintf(name, "/%u.setup", run);
+  return directory + name;
+}/*}}}*/
+
+
+
+SetupCache::SetupCache(const char* directory)
+  : directory(directory), currentRun(0), current(NULL), nHits(0), nMisses(0)
+{/*{{{*/
+}/*}}}*/
+
+
+
+SetupCache::~SetupCache()
+{/*{{{*/
+  for(std::map<unsigned int, MappedRun>::iterator it = runs.begin(); it != runs.end(); ++it)
+    if( it->second.address ) munmap(it->second.address, it->second.size);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function unmaps every run except the current one. (streaming chain mode, filestream.h)
+ */
+void SetupCache::ReleaseOtherRuns()
+{/*{{{*/
+  std::map<unsigned int, MappedRun>::iterator it = runs.begin();
+  while( it != runs.end() )
+  {
+    if( current && it->first == currentRun ) { ++it; continue; }
+    if( it->second.address ) munmap(it->second.address, it->second.size);
+    runs.erase(it++);
+  }
+}/*}}}*/
+
+
+
+/**
+ * @brief This function makes the tables of the run current, mapping its file on the first use.
+ * @return true : The run is in the cache / false : The run is not cached
+ */
+bool SetupCache::SelectRun(unsigned int run)
+{/*{{{*/
+  if( current && currentRun == run ) return current->header != NULL;
+
+  std::map<unsigned int, MappedRun>::iterator found = runs.find(run);
+  if( found == runs.end() )
+  {
+    MappedRun mapped;
+    mapped.address = NULL;
+    mapped.size    = 0;
+    mapped.header  = NULL;
+    mapped.seconds = NULL;
+
+    std::string fileName = GetCacheFileName(directory, run);
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat status;
+    if( fd >= 0 && fstat(fd, &status) == 0 && (size_t)status.st_size >= sizeof(RunSetupHeader) )
+    {
+      void* address = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if( address != MAP_FAILED )
+      {
+        const RunSetupHeader* header = (const RunSetupHeader*)address;
+        if( memcmp(header->magic, SETUPCACHE_MAGIC, 8) == 0 && header->run == run &&
+            (size_t)status.st_size >= sizeof(RunSetupHeader) + header->nSeconds * sizeof(RunSetupSecond) )
+        {
+          mapped.address = address;
+          mapped.size    = status.st_size;
+          mapped.header  = header;
+          mapped.seconds = (const RunSetupSecond*)( header + 1 );
+        }
+        else
+        {
+          std::cerr << "[" << releaseName << "] WARNING   : The setup cache [" << fileName << "] is broken. It is ignored." << std::endl;
+          munmap(address, status.st_size);
+        }
+      }
+    }
+    if( fd >= 0 ) close(fd);
+
+    if( !mapped.header )
+      std::cout << "[" << releaseName << "] Run " << run << " is not in the setup cache. The AMS setup is used." << std::endl;
+    found = runs.insert(std::make_pair(run, mapped)).first;
+  }
+
+  currentRun = run;
+  current    = &found->second;
+  return current->header != NULL;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the cached AMSEventR::isBadRun() of the run.
+ * @return true : The run is cached / false : The caller has to ask the AMS setup
+ */
+bool SetupCache::GetBadRun(unsigned int run, bool& badRun)
+{/*{{{*/
+  if( !SelectRun(run) ) { nMisses++; return false; }
+  badRun = ( current->header->badRun != 0 );
+  nHits++;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the cached L1 and L9 displacements at the given second.
+ * @return true : The second is cached / false : The caller has to ask the AMS setup
+ */
+bool SetupCache::GetAlignment(unsigned int run, unsigned int time, float& dL1y, float& dL9y)
+{/*{{{*/
+  if( !SelectRun(run) ) { nMisses++; return false; }
+
+  const RunSetupHeader* header = current->header;
+  if( time < header->firstTime || time - header->firstTime >= header->nSeconds ) { nMisses++; return false; }
+
+  const RunSetupSecond& second = current->seconds[time - header->firstTime];
+  dL1y = second.dL1y;
+  dL9y = second.dL9y;
+  nHits++;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function prints how many lookups were served by the cache.
+ */
+void SetupCache::PrintStatistics()
+{/*{{{*/
+  unsigned int nCached = 0;
+  for(std::map<unsigned int, MappedRun>::iterator it = runs.begin(); it != runs.end(); ++it)
+    if( it->second.header ) nCached++;
+
+  std::cout << "[" << releaseName << "] SETUP CACHE : " << nCached << " of " << runs.size() << " runs cached, "
+            << nHits << " hits, " << nMisses << " misses" << std::endl;
+}/*}}}*/
+
+
+
+/**
+ * @brief Time range of one run found in the list.
+ */
+struct WarmRun
+{
+  std::string   fileName;                   // One file of the run, used as the event context
+  unsigned int  firstTime;
+  unsigned int  lastTime;
+};
+
+/**
+ * @brief This function reads the cache file of the run, if there is a valid one.
+ * @return true : header and seconds hold the cached tables / false : The run is not cached
+ */
+static bool ReadCachedRun(const std::string& fileName, unsigned int run, RunSetupHeader& header, std::vector<RunSetupSecond>& seconds)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(fileName.c_str(), "rb") ) == NULL ) return false;
+  bool good = fread(&header, sizeof(RunSetupHeader), 1, fp) == 1 &&
+              memcmp(header.magic, SETUPCACHE_MAGIC, 8) == 0 && header.run == run && header.nSeconds > 0;
+  if( good )
+  {
+    seconds.resize(header.nSeconds);
+    good = fread(&seconds[0], sizeof(RunSetupSecond), header.nSeconds, fp) == header.nSeconds;
+  }
+  fclose(fp);
+  return good;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function pre-populates the cache with every run of the files in the list.
+ *
+ * The bad-run flag and the RTI displacements of every second between the first and the last event of the
+ * run are taken from the AMS setup and written to <directory>/<run>.setup. Runs which are already covered
+ * are skipped, so the command can be repeated with growing lists. A run which is cached for other seconds
+ * is rewritten with the union of the cached and the new time ranges; the cached seconds are kept as they are.
+ *
+ * @return 0 : The cache is warm / -1 : The list or the cache directory can not be used
+ */
+int WarmSetupCache(const char* listFileName, const char* directory)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(listFileName, "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open file [" << listFileName << "]!" << std::endl;
+    return -1;
+  }
+  if( mkdir(directory, 0755) != 0 && errno != EEXIST )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the setup cache directory [" << directory << "]!" << std::endl;
+    fclose(fp);
+    return -1;
+  }
+
+  // Time range of every run, from the first and the last event of its files
+  std::map<unsigned int, WarmRun> ranges;
+  char  inputFileName[256];
+  char* line_p;
+  while( fgets(inputFileName, 256, fp) != NULL )
+  {
+    if( ( line_p = strchr(inputFileName, '\n') ) != NULL ) *line_p = 0;
+    if( inputFileName[0] == '\0' ) continue;
+
+    AMSChain chain;
+    if( chain.Add(inputFileName) != 1 || chain.GetEntries() == 0 )
+    {
+      std::cerr << "[" << releaseName << "] WARNING   : Failed to open file [" << inputFileName << "]. It is skipped." << std::endl;
+      continue;
+    }
+
+    AMSEventR* pev = chain.GetEvent(0);
+    unsigned int run       = pev->Run();
+    unsigned int firstTime = pev->UTime();
+    unsigned int lastTime  = chain.GetEvent(chain.GetEntries() - 1)->UTime();
+
+    std::map<unsigned int, WarmRun>::iterator found = ranges.find(run);
+    if( found == ranges.end() )
+    {
+      WarmRun range;
+      range.fileName  = inputFileName;
+      range.firstTime = firstTime;
+      range.lastTime  = lastTime;
+      ranges[run] = range;
+    }
+    else
+    {
+      if( firstTime < found->second.firstTime ) found->second.firstTime = firstTime;
+      if( lastTime > found->second.lastTime ) found->second.lastTime = lastTime;
+    }
+  }
+  fclose(fp);
+
+  int nWritten = 0;
+  for(std::map<unsigned int, WarmRun>::iterator it = ranges.begin(); it != ranges.end(); ++it)
+  {
+    unsigned int   run   = it->first;
+    WarmRun&       range = it->second;
+    std::string    cacheFileName = GetCacheFileName(directory, run);
+    if( range.lastTime < range.firstTime ) continue;
+
+    RunSetupHeader              cached;
+    std::vector<RunSetupSecond> cachedSeconds;
+    bool isCached = ReadCachedRun(cacheFileName, run, cached, cachedSeconds);
+    if( isCached )
+    {
+      unsigned int cachedLastTime = cached.firstTime + cached.nSeconds - 1;
+      if( cached.firstTime <= range.firstTime && range.lastTime <= cachedLastTime ) continue;
+      if( cached.firstTime < range.firstTime ) range.firstTime = cached.firstTime;
+      if( cachedLastTime > range.lastTime ) range.lastTime = cachedLastTime;
+    }
+
+    AMSChain chain;
+    chain.Add(range.fileName.c_str());
+    AMSEventR* pev = chain.GetEvent(0);
+
+    RunSetupHeader header;
+    memcpy(header.magic, SETUPCACHE_MAGIC, 8);
+    header.run       = run;
+    header.badRun    = pev->isBadRun(run) ? 1 : 0;
+    header.firstTime = range.firstTime;
+    header.nSeconds  = range.lastTime - range.firstTime + 1;
+
+    std::vector<RunSetupSecond> seconds(header.nSeconds);
+    for(unsigned int s = 0; s < header.nSeconds; s++)
+    {
+      unsigned int time = header.firstTime + s;
+      if( isCached && time >= cached.firstTime && time - cached.firstTime < cached.nSeconds )
+      {
+        seconds[s] = cachedSeconds[time - cached.firstTime];
+        continue;
+      }
+
+      AMSPoint pn1, pn9, pd1, pd9;
+      int status1 = pev->GetRTIdL1L9(0, pn1, pd1, time, 60);
+      int status9 = pev->GetRTIdL1L9(1, pn9, pd9, time, 60);
+      seconds[s].dL1y   = pd1.y();
+      seconds[s].dL9y   = pd9.y();
+      seconds[s].status = status1 + 16 * status9;
+    }
+
+    // Written under a temporary name, so that running jobs never map a half-written file.
+    std::string temporaryName = cacheFileName + ".tmp";
+    FILE* out;
+    if( ( out = fopen(temporaryName.c_str(), "wb") ) == NULL )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : Failed to write [" << temporaryName << "]!" << std::endl;
+      return -1;
+    }
+    bool good = fwrite(&header, sizeof(RunSetupHeader), 1, out) == 1 &&
+                fwrite(&seconds[0], sizeof(RunSetupSecond), header.nSeconds, out) == header.nSeconds;
+    if( fclose(out) != 0 ) good = false;
+    if( !good || rename(temporaryName.c_str(), cacheFileName.c_str()) != 0 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : Failed to write [" << cacheFileName << "]!" << std::endl;
+      remove(temporaryName.c_str());
+      return -1;
+    }
+
+    std::cout << "[" << releaseName << "] Run " << run << " is cached (" << header.nSeconds << " s)." << std::endl;
+    nWritten++;
+  }
+
+  std::cout << "[" << releaseName << "] The setup cache [" << directory << "] holds " << ranges.size() << " runs of the list ("
+            << nWritten << " new)." << std::endl;
+  return 0;
+}/*}}}*/
@@ -0,0 +1,81 @@
+/**
+ * @file      setupcache.h
+ * @brief     Local per-run cache of the setup (bad-run) and RTI alignment values used by the cuts.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _SETUPCACHE_H_
+#define _SETUPCACHE_H_
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+#define SETUPCACHE_MAGIC "ACCTSET1"
+
+/**
+ * @brief Header of a cache file <cache directory>/<run>.setup, followed by nSeconds RunSetupSecond.
+ */
+struct RunSetupHeader
+{
+  char          magic[8];                   // SETUPCACHE_MAGIC
+  unsigned int  run;
+  int           badRun;                     // AMSEventR::isBadRun(run) of the run
+  unsigned int  firstTime;                  // (UNIX time) Second of the first table row
+  unsigned int  nSeconds;                   // Number of table rows (one per second)
+};
+
+/**
+ * @brief RTI values of one second. (AMSEventR::GetRTIdL1L9 with a 60 s window)
+ */
+struct RunSetupSecond
+{
+  float         dL1y;                       // y of the L1 displacement
+  float         dL9y;                       // y of the L9 displacement
+  int           status;                     // Return values of GetRTIdL1L9 for L1 and L9 (L1 + 16 * L9)
+};
+
+/**
+ * @brief Read-only view of the cache. The file of a run is memory-mapped when the run is first needed
+ *        and stays mapped, so a run change is a swap of the table pointers.
+ *
+ * The cache serves only the setup lookups of the cuts (AMSEventR::isBadRun, AMSEventR::GetRTIdL1L9). The
+ * other setup of the AMS software is not cached : AMSSetupR::RTI::UseLatest() and TkDBc::UseFinal() are
+ * still called at startup, and the tracker alignment (TkDBc) needed by the track fits of the ACSoft stage is
+ * still loaded from the AMS database on a cold node. The RTI tables are read only for the runs which are not
+ * cached.
+ */
+class SetupCache
+{
+  struct MappedRun
+  {
+    void*                 address;
+    size_t                size;
+    const RunSetupHeader* header;
+    const RunSetupSecond* seconds;
+  };
+
+  std::string                         directory;
+  std::map<unsigned int, MappedRun>   runs;         // header == NULL : Not in the cache
+  unsigned int                        currentRun;
+  const MappedRun*                    current;
+  unsigned long                       nHits;
+  unsigned long                       nMisses;
+
+  bool SelectRun(unsigned int run);
+
+public:
+  SetupCache(const char* directory);
+  ~SetupCache();
+
+  bool GetBadRun(unsigned int run, bool& badRun);
+  bool GetAlignment(unsigned int run, unsigned int time, float& dL1y, float& dL9y);
+  void ReleaseOtherRuns();
+  void PrintStatistics();
+};
+
+extern SetupCache* setupCache;              // NULL : The cuts use the setup of the AMS software directly
+
+int WarmSetupCache(const char* listFileName, const char* directory);
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * @file      telemetry.cxx
+ * @brief     JSON-lines and Prometheus textfile progress reports of the event loop.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "TChain.h"
+#include "TFile.h"
+
+#include "timer.h"
+#include "writer.h"
+#include "telemetry.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief This function reads the resident set size of the process.
+ * @return (bytes) Current RSS / 0 : Not available
+ */
+long long GetCurrentRSS()
+{/*{{{*/
+  FILE* fp;
+  long pages = 0, residentPages = 0;
+  if( ( fp = fopen("/proc/self/statm", "r") ) == NULL ) return 0;
+  if( fscanf(fp, "%ld %ld", &pages, &residentPages) != 2 ) residentPages = 0;
+  fclose(fp);
+  return (long long)residentPages * sysconf(_SC_PAGESIZE);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the peak resident set size of the process.
+ * @return (bytes) Peak RSS
+ */
+long long GetPeakRSS()
+{/*{{{*/
+  struct rusage usage;
+  if( getrusage(RUSAGE_SELF, &usage) != 0 ) return 0;
+  return (long long)usage.ru_maxrss * 1024;                  // ru_maxrss is in kB on Linux
+}/*}}}*/
+
+
+
+/**
+ * @brief This function escapes a string for a JSON string literal.
+ */
+static std::string EscapeJSON(const char* text)
+{/*{{{*/
+  std::string escaped;
+  for(const char* c = text; *c; c++)
+  {
+    if( *c == '"' || *c == '\\' ) escaped += '\\';
+    if( (unsigned char)*c < 0x20 ) continue;
+    escaped += *c;
+  }
+  return escaped;
+}/*}}}*/
+
+
+
+Telemetry::Telemetry(const char* jsonFileName, const char* promFileName, double interval, long maxBytes, int nKeep)
+  : jsonFileName(jsonFileName), promFileName(promFileName), interval(interval), maxBytes(maxBytes), nKeep(nKeep),
+    nTotal(0), startTime(0.), lastTime(0.), lastDone(0), lastBytes(0), startBytes(0)
+{/*{{{*/
+  char name[256];
+  if( gethostname(name, 255) != 0 ) strcpy(name, "localhost");
+  name[255] = '\0';
+  hostName = name;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function starts the clock of the reports.
+ */
+void Telemetry::Begin(long long nTotal)
+{/*{{{*/
+  this->nTotal = nTotal;
+  startTime    = lastTime = GetMonotonicTime();
+  startBytes   = lastBytes = TFile::GetFileBytesRead();
+  lastDone     = 0;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes a report if the interval has passed since the previous one.
+ */
+void Telemetry::Update(long long nDone, long long nAccepted, TChain* chain)
+{/*{{{*/
+  if( !IsEnabled() ) return;
+  if( GetMonotonicTime() - lastTime < interval ) return;
+  Report("running", nDone, nAccepted, chain);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the final report.
+ */
+void Telemetry::Finish(long long nDone, long long nAccepted, TChain* chain)
+{/*{{{*/
+  if( !IsEnabled() ) return;
+  Report("finished", nDone, nAccepted, chain);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function shifts <file>.<n> to <file>.<n+1>, dropping the oldest, and moves the JSON file to <file>.1.
+ */
+void Telemetry::Rotate()
+{/*{{{*/
+  char from[512], to[512];
+  for(int n = nKeep - 1; n >= 1; n--)
+  {
+    sprintf(from, "%s.%d", jsonFileName.c_str(), n);
+    sprintf(to, "%s.%d", jsonFileName.c_str(), n + 1);
+    rename(from, to);
+  }
+  sprintf(to, "%s.1", jsonFileName.c_str());
+  rename(jsonFileName.c_str(), to);
+}/*}}}*/
+
+
+
+void Telemetry::Report(const char* state, long long nDone, long long nAccepted, TChain* chain)
+{/*{{{*/
+  double    now       = GetMonotonicTime();
+  double    elapsed   = now - startTime;
+  long long bytes     = TFile::GetFileBytesRead();
+
+  double rate        = ( now > lastTime ) ? ( nDone - lastDone ) / ( now - lastTime ) : 0.;
+  double averageRate = ( elapsed > 0. ) ? nDone / elapsed : 0.;
+  double readRate    = ( now > lastTime ) ? ( bytes - lastBytes ) / ( now - lastTime ) / 1e6 : 0.;
+  double eta         = ( averageRate > 0. && nTotal > nDone ) ? ( nTotal - nDone ) / averageRate : 0.;
+  double accepted    = ( nDone > 0 ) ? (double)nAccepted / nDone : 0.;
+
+  // Current file of the chain
+  std::string fileName;
+  int    fileIndex = -1, nFiles = 0;
+  double fileProgress = 0.;
+  if( chain && chain->GetTreeNumber() >= 0 )
+  {
+    fileIndex = chain->GetTreeNumber();
+    nFiles    = chain->GetNtrees();
+    Long64_t* offsets = chain->GetTreeOffset();
+    Long64_t  nFileEntries = offsets[fileIndex + 1] - offsets[fileIndex];
+    if( nFileEntries > 0 ) fileProgress = (double)( chain->GetReadEntry() - offsets[fileIndex] ) / nFileEntries;
+    if( chain->GetCurrentFile() ) fileName = chain->GetCurrentFile()->GetName();
+  }
+
+  // Writers
+  double busy = 0., stall = 0.;
+  for(unsigned int w = 0; w < writers.size(); w++)
+  {
+    WriterStatistics statistics = writers[w]->GetStatistics();
+    busy  += statistics.writerBusyTime;
+    stall += statistics.producerStallTime;
+  }
+  double utilisation = ( elapsed > 0. && !writers.empty() ) ? busy / ( elapsed * writers.size() ) : 0.;
+
+  long long rss = GetCurrentRSS(), peakRSS = GetPeakRSS();
+  long long unixTime = (long long)time(NULL);
+
+  if( !jsonFileName.empty() )
+  {
+    struct stat status;
+    if( maxBytes > 0 && stat(jsonFileName.c_str(), &status) == 0 && status.st_size >= maxBytes ) Rotate();
+
+    FILE* fp;
+    if( ( fp = fopen(jsonFileName.c_str(), "a") ) != NULL )
+    {
+      fprintf(fp, "{\"time\":%lld,\"job\":\"%s\",\"host\":\"%s\",\"pid\":%d,\"state\":\"%s\","
+                  "\"done\":%lld,\"total\":%lld,\"elapsed_s\":%.1f,\"rate\":%.2f,\"rate_avg\":%.2f,"
+                  "\"read_mb_s\":%.3f,\"read_mb\":%.1f,\"file\":\"%s\",\"file_index\":%d,\"files\":%d,\"file_progress\":%.4f,"
+                  "\"eta_s\":%.0f,\"accepted\":%lld,\"accepted_fraction\":%.5f,\"rss_mb\":%.1f,\"peak_rss_mb\":%.1f,"
+                  "\"writer_utilisation\":%.4f,\"loop_stall_s\":%.3f}\n",
+              unixTime, releaseName, EscapeJSON(hostName.c_str()).c_str(), (int)getpid(), state,
+              nDone, nTotal, elapsed, rate, averageRate,
+              readRate, ( bytes - startBytes ) / 1e6, EscapeJSON(fileName.c_str()).c_str(), fileIndex, nFiles, fileProgress,
+              eta, nAccepted, accepted, rss / 1e6, peakRSS / 1e6,
+              utilisation, stall);
+      fclose(fp);
+    }
+  }
+
+  if( !promFileName.empty() )
+  {
+    // node_exporter may read the file at any time, so it is replaced atomically.
+    std::string temporaryName = promFileName + ".tmp";
+    FILE* fp;
+    if( ( fp = fopen(temporaryName.c_str(), "w") ) != NULL )
+    {
+      char labels[512];
+      snprintf(labels, sizeof(labels), "job=\"%s\",host=\"%s\",pid=\"%d\"", releaseName, EscapeJSON(hostName.c_str()).c_str(), (int)getpid());
+
+      fprintf(fp, "# HELP acctofint_entries_done Entries of the chain processed by the event loop.\n# TYPE acctofint_entries_done gauge\n");
+      fprintf(fp, "acctofint_entries_done{%s} %lld\n", labels, nDone);
+      fprintf(fp, "# HELP acctofint_entries_total Entries to be processed.\n# TYPE acctofint_entries_total gauge\n");
+      fprintf(fp, "acctofint_entries_total{%s} %lld\n", labels, nTotal);
+      fprintf(fp, "# HELP acctofint_events_per_second Event rate since the previous report.\n# TYPE acctofint_events_per_second gauge\n");
+      fprintf(fp, "acctofint_events_per_second{%s} %g\n", labels, rate);
+      fprintf(fp, "# HELP acctofint_events_per_second_average Event rate since the start.\n# TYPE acctofint_events_per_second_average gauge\n");
+      fprintf(fp, "acctofint_events_per_second_average{%s} %g\n", labels, averageRate);
+      fprintf(fp, "# HELP acctofint_read_bytes Bytes read by ROOT since the start.\n# TYPE acctofint_read_bytes gauge\n");
+      fprintf(fp, "acctofint_read_bytes{%s} %lld\n", labels, bytes - startBytes);
+      fprintf(fp, "# HELP acctofint_file_index Index of the current file of the chain.\n# TYPE acctofint_file_index gauge\n");
+      fprintf(fp, "acctofint_file_index{%s} %d\n", labels, fileIndex);
+      fprintf(fp, "# HELP acctofint_file_progress Fraction of the current file processed.\n# TYPE acctofint_file_progress gauge\n");
+      fprintf(fp, "acctofint_file_progress{%s} %g\n", labels, fileProgress);
+      fprintf(fp, "# HELP acctofint_eta_seconds Estimated time to the end of the chain.\n# TYPE acctofint_eta_seconds gauge\n");
+      fprintf(fp, "acctofint_eta_seconds{%s} %g\n", labels, eta);
+      fprintf(fp, "# HELP acctofint_accepted_fraction Fraction of the entries with a stored record.\n# TYPE acctofint_accepted_fraction gauge\n");
+      fprintf(fp, "acctofint_accepted_fraction{%s} %g\n", labels, accepted);
+      fprintf(fp, "# HELP acctofint_peak_rss_bytes Peak resident set size.\n# TYPE acctofint_peak_rss_bytes gauge\n");
+      fprintf(fp, "acctofint_peak_rss_bytes{%s} %lld\n", labels, peakRSS);
+      fprintf(fp, "# HELP acctofint_writer_utilisation Busy time of the writers over the wall time.\n# TYPE acctofint_writer_utilisation gauge\n");
+      fprintf(fp, "acctofint_writer_utilisation{%s} %g\n", labels, utilisation);
+      fprintf(fp, "# HELP acctofint_finished 1 once the event loop is over.\n# TYPE acctofint_finished gauge\n");
+      fprintf(fp, "acctofint_finished{%s} %d\n", labels, strcmp(state, "finished") == 0 ? 1 : 0);
+      fprintf(fp, "# HELP acctofint_last_report_timestamp_seconds UNIX time of this report. A stale value means a stuck job.\n# TYPE acctofint_last_report_timestamp_seconds gauge\n");
+      fprintf(fp, "acctofint_last_report_timestamp_seconds{%s} %lld\n", labels, unixTime);
+
+      if( fclose(fp) == 0 ) rename(temporaryName.c_str(), promFileName.c_str());
+    }
+  }
+
+  lastTime  = now;
+  lastDone  = nDone;
+  lastBytes = bytes;
+}/*}}}*/
@@ -0,0 +1,62 @@
+/**
+ * @file      telemetry.h
+ * @brief     Periodic progress and throughput reports as JSON lines and as a Prometheus textfile.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <string>
+#include <vector>
+
+class TChain;
+class RecordWriter;
+
+/**
+ * @brief Progress reporter of the event loop.
+ *
+ * Update() is cheap and is called for every entry. Every interval it writes one report :
+ *   - as one JSON object per line appended to the JSON file, which is rotated to <file>.1 ... <file>.<nKeep>
+ *     when it grows beyond maxBytes,
+ *   - and as the Prometheus textfile (written under a temporary name and renamed, as node_exporter expects).
+ *
+ * Reported : entries done / total, events/s (since the last report and since the start), MB/s read by ROOT,
+ * current file with its progress, ETA, accepted fraction, current and peak RSS, utilisation of the writers
+ * (busy time / wall time) and the time the event loop waited for the writers.
+ */
+class Telemetry
+{
+  std::string                 jsonFileName;
+  std::string                 promFileName;
+  double                      interval;     // (s)
+  long                        maxBytes;
+  int                         nKeep;
+
+  std::vector<RecordWriter*>  writers;
+  std::string                 hostName;
+  long long                   nTotal;
+  double                      startTime;
+  double                      lastTime;
+  long long                   lastDone;
+  long long                   lastBytes;
+  long long                   startBytes;
+
+  void Rotate();
+  void Report(const char* state, long long nDone, long long nAccepted, TChain* chain);
+
+public:
+  Telemetry(const char* jsonFileName, const char* promFileName, double interval, long maxBytes, int nKeep = 3);
+
+  bool IsEnabled() const { return !jsonFileName.empty() || !promFileName.empty(); }
+  void AddWriter(RecordWriter* writer) { writers.push_back(writer); }
+
+  void Begin(long long nTotal);
+  void Update(long long nDone, long long nAccepted, TChain* chain);
+  void Finish(long long nDone, long long nAccepted, TChain* chain);
+};
+
+long long GetCurrentRSS();
+long long GetPeakRSS();
+
+#endif
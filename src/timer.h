@@ -0,0 +1,23 @@
+/**
+ * @file      timer.h
+ * @brief     Monotonic wall clock used for the throughput and latency bookkeeping.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <time.h>
+
+/**
+ * @brief This function returns the monotonic wall time.
+ * @return Seconds since an arbitrary fixed point
+ */
+inline double GetMonotonicTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,385 @@
+/**
+ * @file      watch.cxx
+ * @brief     Watch-directory daemon : completion detection, ledger and per-run output segments.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/prctl.h>
+#endif
+
+#include "watch.h"
+
+extern char releaseName[16];
+
+static volatile sig_atomic_t stopRequested = 0;
+
+/**
+ * @brief Last state of a file seen by the scan.
+ */
+struct ScannedFile
+{
+  off_t   size;
+  time_t  mtime;
+  time_t  stableSince;                      // (UNIX time) Since when size and mtime did not change
+};
+
+/**
+ * @brief Analyses of a file in the ledger. Only the latest version (size and mtime) of the file is kept.
+ */
+struct LedgerEntry
+{
+  off_t   size;
+  time_t  mtime;
+  bool    done;
+  int     nFailures;
+  bool    interrupted;                      // Interrupted in this session (not in the ledger)
+};
+
+
+
+static void RequestStop(int signal)
+{/*{{{*/
+  stopRequested = 1;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function checks whether the file name ends with ".root".
+ */
+static bool IsRootFile(const char* name)
+{/*{{{*/
+  size_t length = strlen(name);
+  return length > 5 && strcmp(name + length - 5, ".root") == 0 && name[0] != '.';
+}/*}}}*/
+
+
+
+/**
+ * @brief This function accounts one analysis ("done", "failed" or "interrupted") of a version of the file.
+ *        A new version forgets the analyses of the old one.
+ */
+static void RecordAnalysis(LedgerEntry& entry, off_t size, time_t mtime, const char* state)
+{/*{{{*/
+  if( entry.size != size || entry.mtime != mtime )
+  {
+    entry.size        = size;
+    entry.mtime       = mtime;
+    entry.done        = false;
+    entry.nFailures   = 0;
+    entry.interrupted = false;
+  }
+  if( strcmp(state, "done") == 0 ) entry.done = true;
+  else if( strcmp(state, "failed") == 0 ) entry.nFailures++;
+  else entry.interrupted = true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads the ledger.
+ * @return The analyses of the input files
+ */
+static std::map<std::string, LedgerEntry> LoadLedger(const std::string& ledgerFileName)
+{/*{{{*/
+  std::map<std::string, LedgerEntry> processed;
+  FILE* fp;
+  if( ( fp = fopen(ledgerFileName.c_str(), "r") ) == NULL ) return processed;
+
+  char line[512], state[16], fileName[400];
+  long long time, size, mtime;
+  while( fgets(line, 512, fp) != NULL )
+  {
+    if( sscanf(line, "%15s %lld %lld %lld %399s", state, &time, &size, &mtime, fileName) != 5 ) continue;
+
+    std::map<std::string, LedgerEntry>::iterator found = processed.find(fileName);
+    if( found == processed.end() )
+    {
+      LedgerEntry entry;
+      entry.size = -1;
+      entry.mtime = 0;
+      found = processed.insert(std::make_pair(std::string(fileName), entry)).first;
+    }
+    RecordAnalysis(found->second, (off_t)size, (time_t)mtime, state);
+  }
+  fclose(fp);
+
+  return processed;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function checks whether this version of the file has to be analyzed.
+ * @return true : Done, given up after kWatchMaxFailures failures, or interrupted in this session
+ */
+static bool IsProcessed(const std::map<std::string, LedgerEntry>& processed, const std::string& path, off_t size, time_t mtime)
+{/*{{{*/
+  std::map<std::string, LedgerEntry>::const_iterator found = processed.find(path);
+  if( found == processed.end() ) return false;
+
+  const LedgerEntry& entry = found->second;
+  if( entry.size != size || entry.mtime != mtime ) return false;
+  return entry.done || entry.nFailures >= kWatchMaxFailures || entry.interrupted;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function appends one line to the ledger and syncs it, so that a crash never loses a finished file.
+ * @return true : Written / false : The ledger can not be written
+ */
+static bool AppendLedger(const std::string& ledgerFileName, const char* state, const std::string& inputFileName, off_t size, time_t mtime)
+{/*{{{*/
+  FILE* fp;
+  if( ( fp = fopen(ledgerFileName.c_str(), "a") ) == NULL ) return false;
+  fprintf(fp, "%s %lld %lld %lld %s\n", state, (long long)time(NULL), (long long)size, (long long)mtime, inputFileName.c_str());
+  fflush(fp);
+  fsync(fileno(fp));
+  return fclose(fp) == 0;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function finds the run of an AMS file name (<run>.<sequence>.root).
+ * @return Run number as a string / "misc" : The name does not start with a run number
+ */
+static std::string GetRunDirectoryName(const std::string& baseName)
+{/*{{{*/
+  size_t nDigits = 0;
+  while( nDigits < baseName.size() && baseName[nDigits] >= '0' && baseName[nDigits] <= '9' ) nDigits++;
+  if( nDigits == 0 || nDigits >= baseName.size() || baseName[nDigits] != '.' ) return "misc";
+  return baseName.substr(0, nDigits);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function updates the state of one file and adds it to the ready files when it did not change for
+ *        the settle time.
+ * @return true : The file is settling (it changed less than the settle time ago)
+ */
+static bool CheckFile(const std::string& directory, const char* name, int settleTime, time_t now,
+                      std::map<std::string, ScannedFile>& scanned, std::set<std::string>& ready)
+{/*{{{*/
+  struct stat status;
+  if( stat(( directory + "/" + name ).c_str(), &status) != 0 || !S_ISREG(status.st_mode) ) return false;
+
+  std::map<std::string, ScannedFile>::iterator found = scanned.find(name);
+  if( found == scanned.end() || found->second.size != status.st_size || found->second.mtime != status.st_mtime )
+  {
+    ScannedFile file;
+    file.size        = status.st_size;
+    file.mtime       = status.st_mtime;
+    file.stableSince = now;
+    scanned[name] = file;
+    return true;
+  }
+
+  if( now - found->second.stableSince >= settleTime && now - status.st_mtime >= settleTime )
+  {
+    ready.insert(name);
+    return false;
+  }
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function scans the directory and returns the files which did not change for the settle time.
+ * @return true : Some files are settling
+ */
+static bool ScanDirectory(const std::string& directory, int settleTime, std::map<std::string, ScannedFile>& scanned, std::set<std::string>& ready)
+{/*{{{*/
+  DIR* dir;
+  if( ( dir = opendir(directory.c_str()) ) == NULL ) return false;
+
+  time_t now = time(NULL);
+  bool   settling = false;
+  struct dirent* entry;
+  while( ( entry = readdir(dir) ) != NULL )
+    if( IsRootFile(entry->d_name) && CheckFile(directory, entry->d_name, settleTime, now, scanned, ready) ) settling = true;
+  closedir(dir);
+
+  return settling;
+}/*}}}*/
+
+
+
+int RunWatchDaemon(const char* watchDirectory, const char* outputDirectory, int pollInterval, int settleTime,
+                   std::string& inputFileName, std::string& outputFileName)
+{/*{{{*/
+  std::string directory(watchDirectory);
+  std::string ledgerFileName = std::string(outputDirectory) + "/processed.ledger";
+
+  if( mkdir(outputDirectory, 0755) != 0 && errno != EEXIST )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the output directory [" << outputDirectory << "]!" << std::endl;
+    return -1;
+  }
+
+  std::map<std::string, LedgerEntry> processed = LoadLedger(ledgerFileName);
+  std::cout << "[" << releaseName << "] Watching [" << directory << "], " << processed.size() << " files in the ledger." << std::endl;
+
+  int inotifyFd = -1;
+#ifdef __linux__
+  if( ( inotifyFd = inotify_init() ) >= 0 && inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 )
+  {
+    close(inotifyFd);
+    inotifyFd = -1;
+  }
+#endif
+  if( inotifyFd < 0 ) std::cout << "[" << releaseName << "] inotify is not available. The directory is polled every " << pollInterval << " s." << std::endl;
+
+  signal(SIGINT, RequestStop);
+  signal(SIGTERM, RequestStop);
+
+  std::map<std::string, ScannedFile> scanned;
+  std::set<std::string>              ready;
+  time_t                             lastScan = 0;
+  time_t                             nextScan = 0;          // A file seen by inotify or still settling is checked again at this time
+  int                                nDone = 0, nFailed = 0;
+
+  while( !stopRequested )
+  {
+    // Wait for inotify events (or just sleep) until the next scan.
+    if( nextScan == 0 || nextScan > lastScan + pollInterval ) nextScan = lastScan + pollInterval;
+    int timeout = (int)( nextScan - time(NULL) );
+    if( timeout < 0 ) timeout = 0;
+
+    if( inotifyFd >= 0 )
+    {
+      struct pollfd descriptor;
+      descriptor.fd     = inotifyFd;
+      descriptor.events = POLLIN;
+      if( poll(&descriptor, 1, 1000 * timeout) > 0 )
+      {
+#ifdef __linux__
+        char buffer[8192];
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        for(ssize_t offset = 0; offset < length; )
+        {
+          const struct inotify_event* event = (const struct inotify_event*)( buffer + offset );
+          // The file is checked like a scanned one : a close can also end one session of an unfinished transfer.
+          if( event->len > 0 && IsRootFile(event->name) && CheckFile(directory, event->name, settleTime, time(NULL), scanned, ready) )
+            if( time(NULL) + settleTime < nextScan ) nextScan = time(NULL) + settleTime;
+          offset += sizeof(struct inotify_event) + event->len;
+        }
+#endif
+      }
+    }
+    else if( timeout > 0 ) sleep(timeout);
+
+    if( time(NULL) >= nextScan )
+    {
+      bool settling = ScanDirectory(directory, settleTime, scanned, ready);
+      lastScan = time(NULL);
+      nextScan = settling ? lastScan + settleTime : 0;
+    }
+
+    while( !ready.empty() && !stopRequested )
+    {
+      std::string name = *ready.begin();
+      ready.erase(ready.begin());
+
+      std::string path = directory + "/" + name;
+      std::map<std::string, ScannedFile>::const_iterator file = scanned.find(name);
+      if( file == scanned.end() ) continue;
+      off_t  size  = file->second.size;
+      time_t mtime = file->second.mtime;
+      if( IsProcessed(processed, path, size, mtime) ) continue;
+
+      std::string runDirectory = std::string(outputDirectory) + "/" + GetRunDirectoryName(name);
+      mkdir(runDirectory.c_str(), 0755);
+
+      inputFileName  = path;
+      outputFileName = runDirectory + "/" + name;
+
+      std::cout << "[" << releaseName << "] New file [" << path << "] -> [" << outputFileName << "]" << std::endl;
+      std::cout.flush();
+      std::cerr.flush();
+
+      pid_t pid = fork();
+      if( pid < 0 )
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : fork() failed (" << strerror(errno) << ")!" << std::endl;
+        return -1;
+      }
+      if( pid == 0 )
+      {
+        // The child has its own process group, so that a stop signal sent to the group of the daemon (Ctrl-C,
+        // systemd, the batch system) does not kill the file being analyzed. The daemon stops after it.
+        setpgid(0, 0);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+#ifdef __linux__
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        if( inotifyFd >= 0 ) close(inotifyFd);
+        return kWatchChild;
+      }
+
+      int status = 0;
+      while( waitpid(pid, &status, 0) < 0 && errno == EINTR );
+
+      bool success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+      std::map<std::string, LedgerEntry>::iterator found = processed.find(path);
+      if( found == processed.end() )
+      {
+        LedgerEntry entry;
+        entry.size = -1;
+        entry.mtime = 0;
+        found = processed.insert(std::make_pair(path, entry)).first;
+      }
+
+      // A killed analysis or a failure during the stop is not a property of the file. It is not written to the
+      // ledger, so the file is analyzed again after a restart (not by this daemon, to avoid a retry loop).
+      if( !success && ( WIFSIGNALED(status) || stopRequested ) )
+      {
+        RecordAnalysis(found->second, size, mtime, "interrupted");
+        std::cerr << "[" << releaseName << "] WARNING   : The analysis of [" << path << "] was interrupted. It is retried after a restart." << std::endl;
+        continue;
+      }
+      RecordAnalysis(found->second, size, mtime, success ? "done" : "failed");
+
+      if( !AppendLedger(ledgerFileName, success ? "done" : "failed", path, size, mtime) )
+      {
+        std::cerr << "[" << releaseName << "] ERROR     : Failed to write the ledger [" << ledgerFileName << "]!" << std::endl;
+        return -1;
+      }
+
+      if( success ) nDone++;
+      else
+      {
+        std::cerr << "[" << releaseName << "] WARNING   : The analysis of [" << path << "] failed (" << found->second.nFailures << " of "
+                  << kWatchMaxFailures << " attempts)." << std::endl;
+        nFailed++;
+      }
+    }
+  }
+
+  if( inotifyFd >= 0 ) close(inotifyFd);
+  std::cout << "[" << releaseName << "] The watch is stopped : " << nDone << " done, " << nFailed << " failed." << std::endl;
+  return 0;
+}/*}}}*/
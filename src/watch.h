@@ -0,0 +1,40 @@
+/**
+ * @file      watch.h
+ * @brief     Daemon mode which analyzes the run files arriving in a watched directory.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+#include <string>
+
+#define kWatchChild -101                    // Returned by RunWatchDaemon() in the forked process which has to analyze a file
+#define kWatchMaxFailures 3                 // Failed analyses of the same version of a file before it is given up
+
+/**
+ * @brief Watches a directory for completed *.root files and analyzes every new one in a forked process.
+ *
+ * A file is complete when its size and mtime stayed the same for the settle time. The directory is scanned
+ * every poll interval. inotify (closed after writing, moved in) only wakes the daemon up early : the file is
+ * then checked again after the settle time, since a transfer in several sessions closes a partial file.
+ *
+ * Outputs  : <output directory>/<run>/<input file base>.root, one segment per input file of the run.
+ *            A run grows by new segments as its files arrive.
+ * Ledger   : <output directory>/processed.ledger, one "<done|failed> <unix time> <size> <mtime> <input file>"
+ *            line per analysis. A file is a new version when its size or mtime changed, and every version is
+ *            analyzed : a file which is replaced under the same name is analyzed again (its segment is
+ *            overwritten). A version which is done is never analyzed again, so a restart is idempotent. A failed
+ *            version is retried, after a restart too, until it failed kWatchMaxFailures times.
+ *            A segment is complete once its input file is in the ledger as done with its current size and mtime.
+ *
+ * The daemon stops on SIGINT or SIGTERM after the file being analyzed. The analysis runs in its own process group,
+ * so a signal to the group of the daemon does not reach it. An analysis killed by a signal is not written to the
+ * ledger and is retried after a restart.
+ *
+ * @return kWatchChild : (in the forked process) inputFileName and outputFileName are set / 0 : Stopped / -1 : Error
+ */
+int RunWatchDaemon(const char* watchDirectory, const char* outputDirectory, int pollInterval, int settleTime,
+                   std::string& inputFileName, std::string& outputFileName);
+
+#endif
@@ -0,0 +1,434 @@
+/**
+ * @file      workqueue.cxx
+ * @brief     Shared-filesystem work queue and the worker loop of the batch runner.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "workqueue.h"
+
+extern char releaseName[16];
+
+static const char* queueStates[] = { "pending", "claimed", "done", "failed" };
+
+
+
+/**
+ * @brief This function lists the entries of a directory, except the hidden ones, in sorted order.
+ */
+static std::vector<std::string> ListDirectory(const std::string& path)
+{/*{{{*/
+  std::vector<std::string> names;
+  DIR* dir;
+  if( ( dir = opendir(path.c_str()) ) == NULL ) return names;
+
+  struct dirent* entry;
+  while( ( entry = readdir(dir) ) != NULL )
+    if( entry->d_name[0] != '.' ) names.push_back(entry->d_name);
+  closedir(dir);
+
+  std::sort(names.begin(), names.end());
+  return names;
+}/*}}}*/
+
+
+
+WorkQueue::WorkQueue(const char* directory, int heartbeatTimeout)
+  : directory(directory), heartbeatTimeout(heartbeatTimeout)
+{/*{{{*/
+  char hostName[256];
+  if( gethostname(hostName, 255) != 0 ) strcpy(hostName, "localhost");
+  hostName[255] = '\0';
+
+  char name[300];
+  sprintf(name, "%s.%d", hostName, (int)getpid());
+  workerName = name;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function moves an item between two states.
+ * @return true : This worker moved the item / false : The item is gone (another worker moved it first)
+ */
+bool WorkQueue::MoveItem(const std::string& from, const std::string& to)
+{/*{{{*/
+  return rename(from.c_str(), to.c_str()) == 0;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function reads the clock of the shared filesystem, so that the heartbeats of the other nodes are
+ *        compared against the same clock that stamped them.
+ * @return (UNIX time) Current time of the filesystem / Local time if the probe file can not be written
+ */
+time_t WorkQueue::GetFileSystemTime()
+{/*{{{*/
+  std::string probeName = directory + "/.clock." + workerName;
+  FILE* fp;
+  struct stat status;
+  time_t now = time(NULL);
+
+  if( ( fp = fopen(probeName.c_str(), "w") ) == NULL ) return now;
+  fclose(fp);
+  if( stat(probeName.c_str(), &status) == 0 ) now = status.st_mtime;
+  unlink(probeName.c_str());
+
+  return now;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function removes the staging directory of a queue which was not published.
+ */
+static void RemoveStaging(const std::string& staging, const std::vector<std::string>& itemPaths)
+{/*{{{*/
+  for(unsigned int i = 0; i < itemPaths.size(); i++) unlink(itemPaths[i].c_str());
+  for(int i = 0; i < 4; i++) rmdir((staging + "/" + queueStates[i]).c_str());
+  rmdir(staging.c_str());
+}/*}}}*/
+
+
+
+/**
+ * @brief This function removes the output directory of a claim together with the files in it.
+ */
+static void RemoveClaimOutput(const std::string& path)
+{/*{{{*/
+  std::vector<std::string> names = ListDirectory(path);
+  for(unsigned int i = 0; i < names.size(); i++) unlink((path + "/" + names[i]).c_str());
+  rmdir(path.c_str());
+}/*}}}*/
+
+
+
+/**
+ * @brief This function moves the files written for a successful claim into the output directory.
+ *        If a file can not be moved, the files already moved are removed again, so that no partial output is left.
+ * @return true : Every file is in place / false : Nothing is published
+ */
+static bool PublishClaimOutput(const std::string& path, const std::string& outputDirectory)
+{/*{{{*/
+  std::vector<std::string> names = ListDirectory(path);
+  for(unsigned int i = 0; i < names.size(); i++)
+  {
+    if( rename((path + "/" + names[i]).c_str(), (outputDirectory + "/" + names[i]).c_str()) == 0 ) continue;
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to move [" << names[i] << "] to [" << outputDirectory << "] (" << strerror(errno) << ")!" << std::endl;
+    for(unsigned int j = 0; j < i; j++) unlink((outputDirectory + "/" + names[j]).c_str());
+    return false;
+  }
+  rmdir(path.c_str());
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function creates the queue from the list file, unless another worker already did.
+ *
+ * The queue is prepared in a private staging directory and renamed into place, so the other workers
+ * never see a half-filled queue.
+ *
+ * @return true : The queue exists / false : Neither the queue nor the list file can be opened, or the queue can not be written
+ */
+bool WorkQueue::Create(const char* listFileName)
+{/*{{{*/
+  struct stat status;
+  std::string pendingPath = directory + "/pending";
+  if( stat(pendingPath.c_str(), &status) == 0 ) return true;
+
+  FILE* fp;
+  if( ( fp = fopen(listFileName, "r") ) == NULL )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to open file [" << listFileName << "]!" << std::endl;
+    return false;
+  }
+
+  std::string staging = directory + ".init." + workerName;
+  mkdir(staging.c_str(), 0755);
+  for(int i = 0; i < 4; i++) mkdir((staging + "/" + queueStates[i]).c_str(), 0755);
+
+  std::vector<std::string> itemPaths;
+  char inputFileName[256];
+  char* line_p;
+  int   nItems = 0;
+  while( fgets(inputFileName, 256, fp) != NULL )
+  {
+    if( ( line_p = strchr(inputFileName, '\n') ) != NULL ) *line_p = 0;
+    if( inputFileName[0] == '\0' ) continue;
+
+    char itemName[16];
+    sprintf(itemName, "%06d", nItems++);
+    std::string itemPath = staging + "/pending/" + itemName;
+
+    // A queue without some of the files would look complete to every worker. It is not published.
+    FILE* item;
+    bool  written = false;
+    if( ( item = fopen(itemPath.c_str(), "w") ) != NULL )
+    {
+      itemPaths.push_back(itemPath);
+      written = ( fprintf(item, "%s\n", inputFileName) > 0 );
+      written = ( fclose(item) == 0 ) && written;
+    }
+    if( !written )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : Failed to write the queue item [" << itemPath << "] (" << strerror(errno) << ")!" << std::endl;
+      fclose(fp);
+      RemoveStaging(staging, itemPaths);
+      return false;
+    }
+  }
+  fclose(fp);
+
+  if( rename(staging.c_str(), directory.c_str()) == 0 )
+  {
+    std::cout << "[" << releaseName << "] The work queue [" << directory << "] is created with " << nItems << " files." << std::endl;
+    return true;
+  }
+
+  // Another worker was faster. Its queue is used.
+  RemoveStaging(staging, itemPaths);
+
+  return stat(pendingPath.c_str(), &status) == 0;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function takes the first pending item.
+ * @return true : The item is held by this worker / false : Nothing is pending
+ */
+bool WorkQueue::Claim(WorkItem& item)
+{/*{{{*/
+  std::vector<std::string> names = ListDirectory(directory + "/pending");
+
+  for(unsigned int i = 0; i < names.size(); i++)
+  {
+    item.name      = names[i];
+    item.claimPath = directory + "/claimed/" + names[i] + "." + workerName;
+    if( !MoveItem(directory + "/pending/" + names[i], item.claimPath) ) continue;
+
+    // rename() keeps the old mtime, so the first heartbeat is given right away.
+    // If a reclaimer saw the old mtime in between, the claim is gone and the next item is tried.
+    if( !Heartbeat(item) ) continue;
+
+    FILE* fp;
+    char  inputFileName[256];
+    char* line_p;
+    if( ( fp = fopen(item.claimPath.c_str(), "r") ) == NULL ) continue;
+    if( fgets(inputFileName, 256, fp) == NULL ) inputFileName[0] = '\0';
+    fclose(fp);
+    if( ( line_p = strchr(inputFileName, '\n') ) != NULL ) *line_p = 0;
+
+    item.inputFileName = inputFileName;
+    return true;
+  }
+
+  return false;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function renews the heartbeat of a held item.
+ * @return true : The item is still held / false : The claim was taken back by another worker
+ */
+bool WorkQueue::Heartbeat(const WorkItem& item)
+{/*{{{*/
+  return utime(item.claimPath.c_str(), NULL) == 0;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function finishes a held item.
+ * @return true : The item is moved to done or failed / false : The claim was taken back by another worker
+ */
+bool WorkQueue::Complete(const WorkItem& item, bool success)
+{/*{{{*/
+  if( success ) return MoveItem(item.claimPath, directory + "/done/" + item.name);
+  return MoveItem(item.claimPath, directory + "/failed/" + item.name + "." + workerName);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns the items whose claimant stopped heartbeating to the pending state.
+ * @return Number of the items reclaimed by this worker
+ */
+int WorkQueue::ReclaimStale()
+{/*{{{*/
+  std::vector<std::string> names = ListDirectory(directory + "/claimed");
+  if( names.empty() ) return 0;
+
+  time_t now = GetFileSystemTime();
+  int nReclaimed = 0;
+
+  for(unsigned int i = 0; i < names.size(); i++)
+  {
+    std::string claimPath = directory + "/claimed/" + names[i];
+    struct stat status;
+    if( stat(claimPath.c_str(), &status) != 0 ) continue;
+    if( now - status.st_mtime <= heartbeatTimeout ) continue;
+
+    std::string name = names[i].substr(0, names[i].find('.'));
+    if( MoveItem(claimPath, directory + "/pending/" + name) )
+    {
+      std::cout << "[" << releaseName << "] The file " << name << " is reclaimed from the stalled worker " << names[i].substr(name.size() + 1) << std::endl;
+      nReclaimed++;
+    }
+  }
+
+  return nReclaimed;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function counts the items in a state. (pending, claimed, done, failed)
+ */
+int WorkQueue::CountItems(const char* state)
+{/*{{{*/
+  return ListDirectory(directory + "/" + state).size();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function runs the worker loop. Every claimed file is analyzed by a forked process
+ *        while this process keeps the heartbeat of the claim.
+ *
+ * The forked process writes into item.outputDirectory, a directory of the claim next to the output file. Its
+ * files are moved to the output directory only after the item is completed, so an analysis whose claim was
+ * taken back never writes the files of the worker which analyzes the item again.
+ *
+ * @return kQueueChild : (in the forked process) item holds the file to analyze / 0 : The queue is empty / Otherwise : Error
+ */
+int RunQueueWorker(const char* queueDirectory, const char* listFileName, const char* outputFileName, int heartbeatTimeout, WorkItem& item)
+{/*{{{*/
+  WorkQueue queue(queueDirectory, heartbeatTimeout);
+  if( !queue.Create(listFileName) ) return -1;
+
+  std::string outputDirectory(outputFileName);
+  size_t slash = outputDirectory.rfind('/');
+  outputDirectory = ( slash == std::string::npos ) ? "." : outputDirectory.substr(0, slash);
+
+  int heartbeatInterval = heartbeatTimeout / 10;
+  if( heartbeatInterval < 1 ) heartbeatInterval = 1;
+
+  int nDone = 0, nFailed = 0, nLost = 0;
+  std::cout << "[" << releaseName << "] Worker " << queue.GetWorkerName() << " joins the work queue [" << queueDirectory << "]" << std::endl;
+
+  while( true )
+  {
+    queue.ReclaimStale();
+
+    if( !queue.Claim(item) )
+    {
+      // The files held by the other workers may still come back if they stall.
+      if( queue.CountItems("pending") == 0 && queue.CountItems("claimed") == 0 ) break;
+      sleep(heartbeatInterval);
+      continue;
+    }
+
+    std::cout << "[" << releaseName << "] Worker " << queue.GetWorkerName() << " claimed [" << item.inputFileName << "]" << std::endl;
+
+    item.outputDirectory = outputDirectory + "/.claim." + item.name + "." + queue.GetWorkerName();
+    RemoveClaimOutput(item.outputDirectory);
+    if( mkdir(item.outputDirectory.c_str(), 0755) != 0 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : Failed to create [" << item.outputDirectory << "] (" << strerror(errno) << ")!" << std::endl;
+      queue.Complete(item, false);
+      return -1;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid_t pid = fork();
+    if( pid < 0 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : fork() failed (" << strerror(errno) << ")!" << std::endl;
+      queue.Complete(item, false);
+      RemoveClaimOutput(item.outputDirectory);
+      return -1;
+    }
+    if( pid == 0 )
+    {
+#ifdef __linux__
+      prctl(PR_SET_PDEATHSIG, SIGKILL);         // No orphan keeps writing once its claim can not be kept alive
+#endif
+      return kQueueChild;
+    }
+
+    int    status   = 0;
+    bool   lost     = false;
+    time_t lastBeat = time(NULL);
+    while( waitpid(pid, &status, WNOHANG) == 0 )
+    {
+      sleep(1);
+      if( time(NULL) - lastBeat < heartbeatInterval ) continue;
+      lastBeat = time(NULL);
+
+      if( !queue.Heartbeat(item) )
+      {
+        // Another worker took the file back. It is analyzed there; stop writing the same output here.
+        std::cerr << "[" << releaseName << "] WARNING   : The claim on [" << item.inputFileName << "] is lost. The analysis is stopped." << std::endl;
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+        lost = true;
+        break;
+      }
+    }
+
+    if( lost )
+    {
+      RemoveClaimOutput(item.outputDirectory);
+      nLost++;
+      continue;
+    }
+
+    // The outputs are published while the claim is held, and the item is done only when they are in place.
+    // An item whose outputs can not be published is failed, so that it is not taken as done without outputs.
+    bool success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if( success && !PublishClaimOutput(item.outputDirectory, outputDirectory) ) success = false;
+    if( !success ) RemoveClaimOutput(item.outputDirectory);
+
+    if( !queue.Complete(item, success) )
+    {
+      // Another worker analyzes the file again and replaces the published outputs with the same ones.
+      std::cerr << "[" << releaseName << "] WARNING   : The claim on [" << item.inputFileName << "] was lost before completion." << std::endl;
+      nLost++;
+    }
+    else if( success ) nDone++;
+    else
+    {
+      std::cerr << "[" << releaseName << "] WARNING   : The analysis of [" << item.inputFileName << "] failed." << std::endl;
+      nFailed++;
+    }
+  }
+
+  std::cout << "[" << releaseName << "] Worker " << queue.GetWorkerName() << " finished : " << nDone << " done, "
+            << nFailed << " failed, " << nLost << " lost. (queue : " << queue.CountItems("done") << " done, "
+            << queue.CountItems("failed") << " failed)" << std::endl;
+
+  return nFailed > 0 ? 1 : 0;
+}/*}}}*/
@@ -0,0 +1,60 @@
+/**
+ * @file      workqueue.h
+ * @brief     Work queue of input files shared by batch workers on several nodes through a shared filesystem.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+#include <string>
+#include <ctime>
+
+#define kQueueChild -100                    // Returned by RunQueueWorker() in the forked process which has to analyze a file
+
+/**
+ * @brief One input file taken from the queue.
+ */
+struct WorkItem
+{
+  std::string   name;                       // Sequence number of the file in the list (e.g. "000042")
+  std::string   inputFileName;              // Path of the input file
+  std::string   claimPath;                  // <queue>/claimed/<name>.<worker> while the item is held
+  std::string   outputDirectory;            // <output directory>/.claim.<name>.<worker>, where the analysis writes its files
+};
+
+/**
+ * @brief Queue directory on a shared filesystem. Every state change is a rename(), which is atomic.
+ *
+ * <queue>/pending/<name>           : Not yet processed. The file holds the input path.
+ * <queue>/claimed/<name>.<worker>  : Held by <worker> (<host>.<pid>). The mtime is its heartbeat.
+ * <queue>/done/<name>              : Processed successfully, and its outputs are published in the output directory.
+ * <queue>/failed/<name>.<worker>   : The analysis of the file failed on <worker>, or its outputs could not be published.
+ *
+ * A claim whose heartbeat is older than the timeout is moved back to pending by any worker.
+ */
+class WorkQueue
+{
+  std::string   directory;
+  std::string   workerName;
+  int           heartbeatTimeout;           // (s)
+
+  bool   MoveItem(const std::string& from, const std::string& to);
+  time_t GetFileSystemTime();
+
+public:
+  WorkQueue(const char* directory, int heartbeatTimeout);
+
+  bool Create(const char* listFileName);
+  bool Claim(WorkItem& item);
+  bool Heartbeat(const WorkItem& item);
+  bool Complete(const WorkItem& item, bool success);
+  int  ReclaimStale();
+  int  CountItems(const char* state);
+
+  const std::string& GetWorkerName() const { return workerName; }
+};
+
+int RunQueueWorker(const char* queueDirectory, const char* listFileName, const char* outputFileName, int heartbeatTimeout, WorkItem& item);
+
+#endif
@@ -0,0 +1,403 @@
+/**
+ * @file      writer.cxx
+ * @brief     Record queue, writer thread and the TTree output sink.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#include <iostream>
+#include <cstring>
+
+#include "RVersion.h"
+#include "TROOT.h"
+#include "TThread.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include "options.h"
+#include "timer.h"
+#include "writer.h"
+
+extern char releaseName[16];
+
+
+
+/**
+ * @brief Default handling of a run summary : the sink does not partition by run, so the object is dropped.
+ */
+void OutputSink::EndRun(unsigned int run, TObject* summary)
+{/*{{{*/
+  delete summary;
+}/*}}}*/
+
+
+
+TreeSink::TreeSink(const char* fileName, const char* treeName, const char* treeTitle)
+  : fileName(fileName), treeName(treeName), treeTitle(treeTitle), file(NULL), tree(NULL)
+{/*{{{*/
+  ResetRecord(&record);
+}/*}}}*/
+
+
+
+TreeSink::~TreeSink()
+{/*{{{*/
+  if( file ) Close();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function creates the output file and assigns the branches of the tree.
+ * @return true : The file is ready / false : The file can not be created
+ */
+bool TreeSink::Open()
+{/*{{{*/
+  file = new TFile(fileName, "RECREATE");
+  if( !file || file->IsZombie() )
+  {
+    std::cerr << "[" << releaseName << "] ERROR     : Failed to create the output file [" << fileName << "]!" << std::endl;
+    delete file;
+    file = NULL;
+    return false;
+  }
+
+  tree = new TTree(treeName, treeTitle);
+  BookRecordBranches(tree, &record);
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function copies the record into the branch buffer and fills the tree.
+ */
+void TreeSink::Fill(const EventRecord& source)
+{/*{{{*/
+  memcpy(&record, &source, sizeof(EventRecord));
+  tree->Fill();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes an additional object (e.g. the counter histogram) at the top directory.
+ */
+void TreeSink::WriteObject(TObject* object)
+{/*{{{*/
+  file->cd("/");
+  file->WriteTObject(object);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function writes the tree and closes the output file.
+ */
+void TreeSink::Close()
+{/*{{{*/
+  if( !file ) return;
+
+  file->cd("/");
+  if( tree->Write() ) std::cout << "[" << releaseName << "] The result file [" << file->GetName() << "] is successfully written." << std::endl;
+  file->Close();
+
+  delete file;
+  file = NULL;
+  tree = NULL;
+}/*}}}*/
+
+
+
+RecordWriter::RecordWriter(OutputSink* sink, int queueSize, int queueLimit, int backpressure, int nThreads)
+  : sink(sink), queueSize(queueSize), queueLimit(queueLimit), backpressure(backpressure), threaded(queueSize > 0), running(false)
+{/*{{{*/
+  this->nThreads = ( sink->IsParallel() && nThreads > 1 ) ? nThreads : 1;
+  memset(&statistics, 0, sizeof(WriterStatistics));
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&slotFreed, NULL);
+  pthread_cond_init(&slotReady, NULL);
+}/*}}}*/
+
+
+
+RecordWriter::~RecordWriter()
+{/*{{{*/
+  if( running ) Stop();
+  for(unsigned int i = 0; i < slots.size(); i++) delete slots[i];
+  pthread_cond_destroy(&slotReady);
+  pthread_cond_destroy(&slotFreed);
+  pthread_mutex_destroy(&mutex);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function allocates one more record slot. (mutex must be held in threaded mode)
+ * @return The new slot
+ */
+EventRecord* RecordWriter::AllocateSlot()
+{/*{{{*/
+  EventRecord* slot = new EventRecord;
+  slots.push_back(slot);
+  statistics.nSlots = slots.size();
+  return slot;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function opens the sink and starts the writer thread.
+ * @return true : The writer is running / false : The sink could not be opened or the thread could not be started
+ */
+bool RecordWriter::Start()
+{/*{{{*/
+  if( !sink->Open() ) return false;
+
+  if( !threaded )
+  {
+    freeSlots.push_back(AllocateSlot());
+    running = true;
+    return true;
+  }
+
+  // ROOT has to know that objects are touched from more than one thread.
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+  ROOT::EnableThreadSafety();
+#else
+  TThread::Initialize();
+#endif
+
+  for(int i = 0; i < queueSize; i++) freeSlots.push_back(AllocateSlot());
+
+  running = true;
+  threads.resize(nThreads);
+  threadArguments.resize(nThreads);
+  for(int i = 0; i < nThreads; i++)
+  {
+    threadArguments[i].writer = this;
+    threadArguments[i].worker = i;
+    if( pthread_create(&threads[i], NULL, RecordWriter::ThreadMain, &threadArguments[i]) != 0 )
+    {
+      std::cerr << "[" << releaseName << "] ERROR     : Failed to start the writer thread!" << std::endl;
+      threads.resize(i);
+      Stop();
+      return false;
+    }
+  }
+
+  std::cout << "[" << releaseName << "] " << nThreads << " writer thread(s) started with " << queueSize << " record slots." << std::endl;
+  return true;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function hands a cleared record slot to the event loop.
+ * @return The slot to be filled. It has to be returned by Commit().
+ */
+EventRecord* RecordWriter::Acquire()
+{/*{{{*/
+  EventRecord* slot = NULL;
+
+  if( !threaded )
+  {
+    slot = freeSlots.back();
+    ResetRecord(slot);
+    return slot;
+  }
+
+  pthread_mutex_lock(&mutex);
+  if( freeSlots.empty() && backpressure == kBackpressureGrow && (int)slots.size() < queueLimit )
+    freeSlots.push_back(AllocateSlot());
+
+  if( freeSlots.empty() )
+  {
+    double stallBegin = GetMonotonicTime();
+    while( freeSlots.empty() ) pthread_cond_wait(&slotFreed, &mutex);
+    statistics.nProducerStalls++;
+    statistics.producerStallTime += GetMonotonicTime() - stallBegin;
+  }
+
+  slot = freeSlots.back();
+  freeSlots.pop_back();
+  pthread_mutex_unlock(&mutex);
+
+  ResetRecord(slot);
+  return slot;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function passes a filled record slot to the writer.
+ */
+void RecordWriter::Commit(EventRecord* record)
+{/*{{{*/
+  if( !threaded )
+  {
+    double fillBegin = GetMonotonicTime();
+    sink->Fill(*record);
+    statistics.writerBusyTime += GetMonotonicTime() - fillBegin;
+    statistics.nCommitted++;
+    statistics.nWritten++;
+    return;
+  }
+
+  QueueItem item = { record, 0, NULL };
+
+  pthread_mutex_lock(&mutex);
+  readyItems.push_back(item);
+  unsigned long depth = readyItems.size();
+  statistics.nCommitted++;
+  statistics.sumQueueDepth += depth;
+  if( depth > statistics.maxQueueDepth ) statistics.maxQueueDepth = depth;
+  pthread_cond_signal(&slotReady);
+  pthread_mutex_unlock(&mutex);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function passes the summary of a finished run to the writer. It is queued behind the records of the run.
+ */
+void RecordWriter::CommitRunEnd(unsigned int run, TObject* summary)
+{/*{{{*/
+  if( !threaded )
+  {
+    sink->EndRun(run, summary);
+    return;
+  }
+
+  QueueItem item = { NULL, run, summary };
+
+  pthread_mutex_lock(&mutex);
+  readyItems.push_back(item);
+  pthread_cond_signal(&slotReady);
+  pthread_mutex_unlock(&mutex);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function keeps an object which is written into the output after the last record.
+ */
+void RecordWriter::AddObject(TObject* object)
+{/*{{{*/
+  objects.push_back(object);
+}/*}}}*/
+
+
+
+void* RecordWriter::ThreadMain(void* argument)
+{/*{{{*/
+  ThreadArgument* threadArgument = (ThreadArgument*)argument;
+  threadArgument->writer->Drain(threadArgument->worker);
+  return NULL;
+}/*}}}*/
+
+
+
+/**
+ * @brief Body of a writer thread. Fills every committed record until Stop() is called and the queue is empty.
+ */
+void RecordWriter::Drain(int worker)
+{/*{{{*/
+  pthread_mutex_lock(&mutex);
+
+  while( true )
+  {
+    if( readyItems.empty() && running )
+    {
+      double stallBegin = GetMonotonicTime();
+      while( readyItems.empty() && running ) pthread_cond_wait(&slotReady, &mutex);
+      statistics.nWriterStalls++;
+      statistics.writerStallTime += GetMonotonicTime() - stallBegin;
+    }
+    if( readyItems.empty() )
+    {
+      if( !running ) break;
+      continue;                             // Another writer thread took the item.
+    }
+
+    QueueItem item = readyItems.front();
+    readyItems.pop_front();
+    pthread_mutex_unlock(&mutex);
+
+    if( !item.record )
+    {
+      sink->EndRun(item.run, item.summary);
+      pthread_mutex_lock(&mutex);
+      continue;
+    }
+
+    double fillBegin = GetMonotonicTime();
+    sink->Fill(*item.record, worker);
+    double fillTime = GetMonotonicTime() - fillBegin;
+
+    pthread_mutex_lock(&mutex);
+    statistics.nWritten++;
+    statistics.writerBusyTime += fillTime;
+    freeSlots.push_back(item.record);
+    pthread_cond_signal(&slotFreed);
+  }
+
+  pthread_mutex_unlock(&mutex);
+}/*}}}*/
+
+
+
+/**
+ * @brief This function flushes the queue, stops the writer thread, writes the additional objects and closes the sink.
+ */
+void RecordWriter::Stop()
+{/*{{{*/
+  if( !running ) return;
+
+  if( threaded )
+  {
+    pthread_mutex_lock(&mutex);
+    running = false;
+    pthread_cond_broadcast(&slotReady);
+    pthread_mutex_unlock(&mutex);
+    for(unsigned int i = 0; i < threads.size(); i++) pthread_join(threads[i], NULL);
+  }
+  running = false;
+
+  for(unsigned int i = 0; i < objects.size(); i++) sink->WriteObject(objects[i]);
+  sink->Close();
+}/*}}}*/
+
+
+
+/**
+ * @brief This function returns a snapshot of the queue counters.
+ * @return Copy of the counters
+ */
+WriterStatistics RecordWriter::GetStatistics()
+{/*{{{*/
+  if( !threaded ) return statistics;
+
+  pthread_mutex_lock(&mutex);
+  WriterStatistics snapshot = statistics;
+  pthread_mutex_unlock(&mutex);
+  return snapshot;
+}/*}}}*/
+
+
+
+/**
+ * @brief This function prints the queue counters.
+ */
+void RecordWriter::PrintStatistics()
+{/*{{{*/
+  WriterStatistics s = GetStatistics();
+  double meanDepth = s.nCommitted > 0 ? (double)s.sumQueueDepth / s.nCommitted : 0.;
+
+  std::cout << "[" << releaseName << "] WRITER STATISTICS" << std::endl;
+  std::cout << "[" << releaseName << "]   Records committed / written : " << s.nCommitted << " / " << s.nWritten << std::endl;
+  std::cout << "[" << releaseName << "]   Record slots                : " << s.nSlots << std::endl;
+  std::cout << "[" << releaseName << "]   Queue depth (mean / max)    : " << meanDepth << " / " << s.maxQueueDepth << std::endl;
+  std::cout << "[" << releaseName << "]   Event loop stalls           : " << s.nProducerStalls << " (" << s.producerStallTime << " s)" << std::endl;
+  std::cout << "[" << releaseName << "]   Writer stalls               : " << s.nWriterStalls << " (" << s.writerStallTime << " s)" << std::endl;
+  std::cout << "[" << releaseName << "]   Writer busy time            : " << s.writerBusyTime << " s" << std::endl;
+}/*}}}*/
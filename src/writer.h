@@ -0,0 +1,151 @@
+/**
+ * @file      writer.h
+ * @brief     Output stage which moves TTree filling, compression and file I/O off the event loop.
+ * @author    Wooyoung Jang (wyjang)
+ * @date      2015. 04. 01
+ */
+#ifndef _WRITER_H_
+#define _WRITER_H_
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+#include "record.h"
+
+class TFile;
+class TTree;
+class TObject;
+
+/**
+ * @brief Destination of the event records. Only the threads which drain the queue call Fill().
+ *
+ * A sink which returns true from IsParallel() accepts Fill() from several writer threads at the same
+ * time; worker is the index of the calling thread. Other sinks are always drained by one thread.
+ */
+class OutputSink
+{
+public:
+  virtual ~OutputSink() {}
+
+  virtual bool Open() = 0;
+  virtual void Fill(const EventRecord& record) = 0;
+  virtual void Fill(const EventRecord& record, int worker) { Fill(record); }
+  virtual bool IsParallel() const { return false; }
+  virtual void WriteObject(TObject* object) = 0;
+  virtual void Close() = 0;
+
+  // Called after the last record of a run. The sink takes the ownership of the summary object.
+  virtual void EndRun(unsigned int run, TObject* summary);
+};
+
+/**
+ * @brief Sink writing the records as the ACCTOFInt TTree into a single ROOT file.
+ */
+class TreeSink : public OutputSink
+{
+  const char*  fileName;
+  const char*  treeName;
+  const char*  treeTitle;
+  TFile*       file;
+  TTree*       tree;
+  EventRecord  record;                      // Branch buffer of the tree
+
+public:
+  TreeSink(const char* fileName, const char* treeName, const char* treeTitle);
+  virtual ~TreeSink();
+
+  virtual bool Open();
+  virtual void Fill(const EventRecord& record);
+  using OutputSink::Fill;
+  virtual void WriteObject(TObject* object);
+  virtual void Close();
+};
+
+/**
+ * @brief Counters of the record queue.
+ */
+struct WriterStatistics
+{
+  unsigned long nCommitted;                 // Number of records handed over by the event loop
+  unsigned long nWritten;                   // Number of records filled by the writer
+  unsigned long sumQueueDepth;              // Sum of queue depths seen at commit time (for the mean depth)
+  unsigned long maxQueueDepth;              // Largest queue depth
+  unsigned long nSlots;                     // Number of allocated record slots
+  unsigned long nProducerStalls;            // Number of times the event loop waited for a free slot
+  double        producerStallTime;          // (s) Time the event loop spent waiting for a free slot
+  unsigned long nWriterStalls;              // Number of times the writer waited for a record
+  double        writerStallTime;            // (s) Time the writer spent waiting for a record
+  double        writerBusyTime;             // (s) Time the writer spent in OutputSink::Fill()
+};
+
+/**
+ * @brief Entry of the writer queue. Either a record slot or the summary of a finished run.
+ */
+struct QueueItem
+{
+  EventRecord*  record;                     // Filled record slot (NULL for a run summary)
+  unsigned int  run;                        // Run number of the summary
+  TObject*      summary;                    // Summary object of the run (e.g. per-run counter histogram)
+};
+
+/**
+ * @brief Bounded queue of EventRecord slots drained by a dedicated writer thread.
+ *
+ * The event loop takes a free slot with Acquire(), fills it in place and returns it with Commit().
+ * The writer thread copies committed slots into the sink and recycles them. When every slot is in
+ * use the event loop either blocks (kBackpressureBlock) or allocates another slot up to the limit
+ * (kBackpressureGrow). A queue size of 0 disables the thread and fills the sink inline.
+ * A parallel sink is drained by nThreads writer threads.
+ * Run summaries are queued in order with the records so that the sink sees them right after
+ * the last record of their run.
+ */
+class RecordWriter
+{
+  OutputSink*                sink;
+  int                        queueSize;
+  int                        queueLimit;
+  int                        backpressure;
+  bool                       threaded;
+  int                        nThreads;      // Number of writer threads (1 unless the sink is parallel)
+  bool                       running;
+
+  std::vector<EventRecord*>  slots;         // Every allocated slot (owned)
+  std::vector<EventRecord*>  freeSlots;     // Slots which can be acquired by the event loop
+  std::deque<QueueItem>      readyItems;    // Slots and run summaries waiting to be written
+
+  std::vector<pthread_t>     threads;
+  pthread_mutex_t            mutex;
+  pthread_cond_t             slotFreed;
+  pthread_cond_t             slotReady;
+
+  std::vector<TObject*>      objects;       // Objects written after the last record
+  WriterStatistics           statistics;
+
+  struct ThreadArgument
+  {
+    RecordWriter* writer;
+    int           worker;
+  };
+  std::vector<ThreadArgument> threadArguments;
+
+  static void* ThreadMain(void* argument);
+  void         Drain(int worker);
+  EventRecord* AllocateSlot();
+
+public:
+  RecordWriter(OutputSink* sink, int queueSize, int queueLimit, int backpressure, int nThreads = 1);
+  virtual ~RecordWriter();
+
+  bool         Start();
+  EventRecord* Acquire();
+  void         Commit(EventRecord* record);
+  void         CommitRunEnd(unsigned int run, TObject* summary);
+  void         AddObject(TObject* object);
+  void         Stop();
+
+  WriterStatistics GetStatistics();
+  void             PrintStatistics();
+};
+
+#endif